@@ -3,6 +3,29 @@
 
 #pragma once
 
+#include "atrebas-backend.h"
+
+G_BEGIN_DECLS
+
+void   atrebas_backend_load_bundled (AtrebasBackend      *backend,
+                                     const char          *filename,
+                                     AtrebasMapTheme      theme,
+                                     GCancellable        *cancellable,
+                                     GAsyncReadyCallback  callback,
+                                     gpointer             user_data);
+
+G_END_DECLS
+
+
+/**
+ * ATREBAS_BACKEND_SCHEMA_VERSION:
+ *
+ * The version of the database schema, stored as `PRAGMA user_version`. If a
+ * database with a different version is opened, the tables are dropped and
+ * reloaded from the bundled GeoJSON.
+ */
+#define ATREBAS_BACKEND_SCHEMA_VERSION 12
+
 
 /**
  * ATREBAS_BACKEND_TABLES_SQL:
@@ -13,46 +36,324 @@
  * @description: (type utf8): The feature description
  * @description_fr: (type utf8): The feature description (French)
  * @color: (type utf8): A hex color (eg. #FFCC00)
- * @coordinate: (type utf8): The bounding coordinates
+ * @geometry: (type GLib.Bytes): The packed bounding coordinates
  * @slug: (type utf8): The unique identifier
  * @theme: a #AtrebasMapTheme
+ * @min_x: (type double): The western extent
+ * @max_x: (type double): The eastern extent, less than @min_x if the feature
+ *   crosses the antimeridian
+ * @min_y: (type double): The southern extent
+ * @max_y: (type double): The northern extent
+ * @area: (type double): The area, in square kilometres
+ * @n_vertices: (type guint): The number of vertices in @geometry
+ * @label_x: (type double): The longitude of the label point
+ * @label_y: (type double): The latitude of the label point
  *
  * The SQL query used to create the `language`, `territory` and treaty` table,
- * which holds records of their respective features. All field are text, with the
- * caveats of @color being a hex color code, and @coordinates being a
- * stringified JSON array of bounding coordinates for the feature.
+ * which holds records of their respective features. The descriptive fields are
+ * text, with @color being a hex color code; @theme and @n_vertices are
+ * integers, the extents, area and label point are reals, and @geometry is a
+ * blob of the bounding coordinates, packed by atrebas_geometry_encode().
+ *
+ * The extents, area, vertex count and label point are derived from @geometry
+ * when the feature is stored, so a feature can be constructed without a pass
+ * over its vertices. The label point is the pole of inaccessibility of the
+ * largest part; see atrebas_geometry_get_label_point().
+ *
+ * The rowid of each feature is allocated from the Hilbert key of its position
+ * (see GET_FEATURE_SLOT_SQL), so neighbouring features are stored together. A
+ * changed feature keeps its rowid unless its key changes too.
+ *
+ * The extents of each feature are mirrored into the `feature_rtree` R*Tree
+ * index by triggers, so spatial queries only visit candidate rows. The id of an
+ * entry is twice the rowid of its feature; a feature that crosses the
+ * antimeridian has a second entry for its western side, with the next id, so
+ * that neither entry spans the globe.
+ *
+ * The `feature_state` table holds a content hash of each feature, the key of
+ * the source it was last imported from and the update generation of that
+ * source it was last seen in, so unchanged features can be skipped and
+ * features removed upstream can be deleted without touching those loaded from
+ * other sources. The remote and bundled maps of a theme share a key, while a
+ * file loaded with atrebas_backend_load() is keyed by its own name. It is kept apart from the `feature` table, so that marking a
+ * feature as seen does not rewrite its geometry.
+ *
+ * The `feature_cover` table holds a cell covering of each feature, built by
+ * atrebas_geometry_cover() and keyed by the rowid of the feature, so that
+ * most points can be located without reading the geometry.
+ *
+ * The `source` table holds the `ETag` and `Last-Modified` headers of each
+ * remote source, for conditional requests.
+ *
+ * The names and slug of each feature are indexed by the `feature_fts` FTS5
+ * table, which folds case and diacritics. It is an external content table,
+ * so the text is not stored twice, and is kept in sync by triggers.
+ */
+#define ATREBAS_BACKEND_FEATURE_TABLE_SQL                                 \
+"CREATE TABLE IF NOT EXISTS feature ("                                    \
+"  id               TEXT PRIMARY KEY NOT NULL,"                           \
+"  name             TEXT             NOT NULL,"                           \
+"  name_fr          TEXT             NOT NULL,"                           \
+"  description      TEXT             NOT NULL,"                           \
+"  description_fr   TEXT             NOT NULL,"                           \
+"  color            TEXT             NOT NULL,"                           \
+"  geometry         BLOB             NOT NULL,"                           \
+"  slug             TEXT             NOT NULL,"                           \
+"  theme            INTEGER,"                                             \
+"  min_x            REAL             NOT NULL,"                           \
+"  max_x            REAL             NOT NULL,"                           \
+"  min_y            REAL             NOT NULL,"                           \
+"  max_y            REAL             NOT NULL,"                           \
+"  area             REAL             NOT NULL,"                           \
+"  n_vertices       INTEGER          NOT NULL,"                           \
+"  label_x          REAL             NOT NULL,"                           \
+"  label_y          REAL             NOT NULL"                            \
+");"                                                                      \
+"CREATE VIRTUAL TABLE IF NOT EXISTS feature_rtree USING rtree("           \
+"  id, min_x, max_x, min_y, max_y"                                        \
+");"                                                                      \
+"CREATE TRIGGER IF NOT EXISTS feature_rtree_insert"                       \
+"  AFTER INSERT ON feature BEGIN"                                         \
+"    INSERT INTO feature_rtree(id,min_x,max_x,min_y,max_y)"               \
+"      VALUES (new.rowid * 2, new.min_x,"                                 \
+"              CASE WHEN new.min_x <= new.max_x THEN new.max_x"           \
+"                   ELSE 180.0 END,"                                      \
+"              new.min_y, new.max_y);"                                    \
+"    INSERT INTO feature_rtree(id,min_x,max_x,min_y,max_y)"               \
+"      SELECT new.rowid * 2 + 1, -180.0, new.max_x, new.min_y, new.max_y" \
+"      WHERE new.min_x > new.max_x;"                                      \
+"  END;"                                                                  \
+"CREATE TRIGGER IF NOT EXISTS feature_rtree_update"                       \
+"  AFTER UPDATE OF min_x, max_x, min_y, max_y ON feature BEGIN"           \
+"    DELETE FROM feature_rtree"                                           \
+"      WHERE id BETWEEN old.rowid * 2 AND old.rowid * 2 + 1;"             \
+"    INSERT INTO feature_rtree(id,min_x,max_x,min_y,max_y)"               \
+"      VALUES (new.rowid * 2, new.min_x,"                                 \
+"              CASE WHEN new.min_x <= new.max_x THEN new.max_x"           \
+"                   ELSE 180.0 END,"                                      \
+"              new.min_y, new.max_y);"                                    \
+"    INSERT INTO feature_rtree(id,min_x,max_x,min_y,max_y)"               \
+"      SELECT new.rowid * 2 + 1, -180.0, new.max_x, new.min_y, new.max_y" \
+"      WHERE new.min_x > new.max_x;"                                      \
+"  END;"                                                                  \
+"CREATE TRIGGER IF NOT EXISTS feature_rtree_delete"                       \
+"  AFTER DELETE ON feature BEGIN"                                         \
+"    DELETE FROM feature_rtree"                                           \
+"      WHERE id BETWEEN old.rowid * 2 AND old.rowid * 2 + 1;"             \
+"    DELETE FROM feature_state WHERE id=old.id;"                          \
+"    DELETE FROM feature_cover WHERE id=old.rowid;"                       \
+"  END;"                                                                  \
+"CREATE TABLE IF NOT EXISTS feature_state ("                              \
+"  id               TEXT PRIMARY KEY NOT NULL,"                           \
+"  source           TEXT             NOT NULL,"                           \
+"  hash             INTEGER          NOT NULL,"                           \
+"  generation       INTEGER          NOT NULL"                            \
+") WITHOUT ROWID;"                                                        \
+"CREATE INDEX IF NOT EXISTS feature_state_generation"                     \
+"  ON feature_state(source, generation);"                                 \
+"CREATE TABLE IF NOT EXISTS feature_cover ("                              \
+"  id               INTEGER PRIMARY KEY NOT NULL,"                        \
+"  cover            BLOB             NOT NULL"                            \
+");"                                                                      \
+"CREATE TABLE IF NOT EXISTS source ("                                     \
+"  uri              TEXT PRIMARY KEY NOT NULL,"                           \
+"  etag             TEXT,"                                                \
+"  last_modified    TEXT"                                                 \
+");"                                                                      \
+"CREATE VIRTUAL TABLE IF NOT EXISTS feature_fts USING fts5("              \
+"  name, name_fr, slug,"                                                  \
+"  content='feature',"                                                    \
+"  content_rowid='rowid',"                                                \
+"  tokenize='unicode61 remove_diacritics 2'"                              \
+");"                                                                      \
+"CREATE TRIGGER IF NOT EXISTS feature_fts_insert"                         \
+"  AFTER INSERT ON feature BEGIN"                                         \
+"    INSERT INTO feature_fts(rowid,name,name_fr,slug)"                    \
+"      VALUES (new.rowid, new.name, new.name_fr, new.slug);"              \
+"  END;"                                                                  \
+"CREATE TRIGGER IF NOT EXISTS feature_fts_update"                         \
+"  AFTER UPDATE OF name, name_fr, slug ON feature BEGIN"                  \
+"    INSERT INTO feature_fts(feature_fts,rowid,name,name_fr,slug)"        \
+"      VALUES ('delete', old.rowid, old.name, old.name_fr, old.slug);"    \
+"    INSERT INTO feature_fts(rowid,name,name_fr,slug)"                    \
+"      VALUES (new.rowid, new.name, new.name_fr, new.slug);"              \
+"  END;"                                                                  \
+"CREATE TRIGGER IF NOT EXISTS feature_fts_delete"                         \
+"  AFTER DELETE ON feature BEGIN"                                         \
+"    INSERT INTO feature_fts(feature_fts,rowid,name,name_fr,slug)"        \
+"      VALUES ('delete', old.rowid, old.name, old.name_fr, old.slug);"    \
+"  END;"
+
+
+/**
+ * ATREBAS_BACKEND_DROP_TABLES_SQL:
+ *
+ * The SQL query used to drop the tables of an outdated schema.
  */
-#define ATREBAS_BACKEND_FEATURE_TABLE_SQL           \
-"CREATE TABLE IF NOT EXISTS feature ("          \
-"  id               TEXT PRIMARY KEY NOT NULL," \
-"  name             TEXT             NOT NULL," \
-"  name_fr          TEXT             NOT NULL," \
-"  description      TEXT             NOT NULL," \
-"  description_fr   TEXT             NOT NULL," \
-"  color            TEXT             NOT NULL," \
-"  coordinates      TEXT             NOT NULL," \
-"  slug             TEXT             NOT NULL," \
-"  theme            INTEGER"                    \
-");"
+#define ATREBAS_BACKEND_DROP_TABLES_SQL        \
+"DROP TRIGGER IF EXISTS feature_rtree_insert;" \
+"DROP TRIGGER IF EXISTS feature_rtree_update;" \
+"DROP TRIGGER IF EXISTS feature_rtree_delete;" \
+"DROP TRIGGER IF EXISTS feature_fts_insert;"   \
+"DROP TRIGGER IF EXISTS feature_fts_update;"   \
+"DROP TRIGGER IF EXISTS feature_fts_delete;"   \
+"DROP TABLE IF EXISTS feature_rtree;"          \
+"DROP TABLE IF EXISTS feature_fts;"            \
+"DROP TABLE IF EXISTS feature_state;"          \
+"DROP TABLE IF EXISTS feature_cover;"          \
+"DROP TABLE IF EXISTS source;"                 \
+"DROP TABLE IF EXISTS feature;"
 
 
 /**
  * ADD_FEATURE_SQL:
  *
- * Insert or update a language feature.
+ * Insert a language feature, with the rowid `?18`.
+ *
+ * The rowid is a free slot after the Hilbert key of the feature's position
+ * (see GET_FEATURE_SLOT_SQL), so rows are stored in the order of the curve and
+ * features close to each other share database pages.
+ */
+#define ADD_FEATURE_SQL                                                  \
+"INSERT INTO feature(rowid,id,name,name_fr,description,description_fr,"  \
+"                    color,geometry,slug,theme,min_x,max_x,min_y,max_y," \
+"                    area,n_vertices,label_x,label_y)"                   \
+"  VALUES (?18, ?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, ?13," \
+"          ?14, ?15, ?16, ?17);"
+
+
+/**
+ * UPDATE_FEATURE_SQL:
+ *
+ * Update the language feature for `?1` in place, if its rowid is in the slots
+ * of the Hilbert key `?18`. The other parameters are those of ADD_FEATURE_SQL.
+ *
+ * A feature whose position has moved to another key is not updated, so that
+ * it can be removed and inserted again, to keep rows in the order of the curve.
+ */
+#define UPDATE_FEATURE_SQL                               \
+"UPDATE feature SET"                                     \
+"    name=?2, name_fr=?3, description=?4,"               \
+"    description_fr=?5, color=?6, geometry=?7, slug=?8," \
+"    theme=?9, min_x=?10, max_x=?11, min_y=?12,"         \
+"    max_y=?13, area=?14, n_vertices=?15,"               \
+"    label_x=?16, label_y=?17"                           \
+"  WHERE id=?1 AND rowid BETWEEN ?18 AND ?18 + 65535;"
+
+
+/**
+ * GET_FEATURE_SLOT_SQL:
+ *
+ * Get the first free slot after the Hilbert key `?`. There are 65536 slots for
+ * each key, so a result past the last is in the range of the next key.
+ */
+#define GET_FEATURE_SLOT_SQL                     \
+"SELECT IFNULL(MAX(rowid) + 1, ?1) FROM feature" \
+"  WHERE rowid BETWEEN ?1 AND ?1 + 65535;"
+
+
+/**
+ * GET_FEATURE_HASH_SQL:
+ *
+ * Get the content hash of the feature for `id`.
+ */
+#define GET_FEATURE_HASH_SQL     \
+"SELECT hash FROM feature_state" \
+"  WHERE id=?;"
+
+
+/**
+ * SET_FEATURE_STATE_SQL:
+ *
+ * Set the source key `?2`, content hash `?3` and update generation `?4` of
+ * the feature for `?1`.
+ */
+#define SET_FEATURE_STATE_SQL                          \
+"INSERT INTO feature_state(id,source,hash,generation)" \
+"  VALUES (?, ?, ?, ?)"                                \
+"  ON CONFLICT(id) DO UPDATE SET"                      \
+"    source=excluded.source,"                          \
+"    hash=excluded.hash,"                              \
+"    generation=excluded.generation;"
+
+
+/**
+ * GET_FEATURE_COVER_SQL:
+ *
+ * Get the cell covering of the feature with the rowid `?`.
+ */
+#define GET_FEATURE_COVER_SQL     \
+"SELECT cover FROM feature_cover" \
+"  WHERE id=?;"
+
+
+/**
+ * SET_FEATURE_COVER_SQL:
+ *
+ * Set the cell covering `?2` of the feature for `?1`.
+ */
+#define SET_FEATURE_COVER_SQL                 \
+"INSERT INTO feature_cover(id,cover)"         \
+"  SELECT rowid, ?2 FROM feature WHERE id=?1" \
+"  ON CONFLICT(id) DO UPDATE SET"             \
+"    cover=excluded.cover;"
+
+
+/**
+ * NEXT_GENERATION_SQL:
+ *
+ * Get the next update generation for the source key `?`.
+ */
+#define NEXT_GENERATION_SQL                                \
+"SELECT IFNULL(MAX(generation), 0) + 1 FROM feature_state" \
+"  WHERE source=?;"
+
+
+/**
+ * GET_STALE_FEATURES_SQL:
+ *
+ * Get the IDs of the features last imported from the source key `?1` and not
+ * seen since before its update generation `?2`.
  */
-#define ADD_FEATURE_SQL                                                                        \
-"INSERT INTO feature(id,name,name_fr,description,description_fr,color,coordinates,slug,theme)" \
-"  VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)"                                                         \
-"  ON CONFLICT(id) DO UPDATE SET"                                                              \
-"    name=excluded.name,"                                                                      \
-"    name_fr=excluded.name_fr,"                                                                \
-"    description=excluded.description,"                                                        \
-"    description_fr=excluded.description_fr,"                                                  \
-"    color=excluded.color,"                                                                    \
-"    coordinates=excluded.coordinates,"                                                        \
-"    slug=excluded.slug,"                                                                      \
-"    theme=excluded.theme;"
+#define GET_STALE_FEATURES_SQL \
+"SELECT id FROM feature_state" \
+"  WHERE source=?1 AND generation<?2;"
+
+
+/**
+ * REMOVE_STALE_FEATURES_SQL:
+ *
+ * Remove the features last imported from the source key `?1` and not seen
+ * since before its update generation `?2`. Features loaded from other
+ * sources are left alone.
+ */
+#define REMOVE_STALE_FEATURES_SQL             \
+"DELETE FROM feature"                         \
+"  WHERE id IN (SELECT id FROM feature_state" \
+"                 WHERE source=?1 AND generation<?2);"
+
+
+/**
+ * GET_SOURCE_SQL:
+ *
+ * Get the `ETag` and `Last-Modified` headers of the source for `uri`.
+ */
+#define GET_SOURCE_SQL                   \
+"SELECT etag, last_modified FROM source" \
+"  WHERE uri=?;"
+
+
+/**
+ * SET_SOURCE_SQL:
+ *
+ * Set the `ETag` and `Last-Modified` headers of the source for `uri`.
+ */
+#define SET_SOURCE_SQL                       \
+"INSERT INTO source(uri,etag,last_modified)" \
+"  VALUES (?, ?, ?)"                         \
+"  ON CONFLICT(uri) DO UPDATE SET"           \
+"    etag=excluded.etag,"                    \
+"    last_modified=excluded.last_modified;"
 
 
 /**
@@ -65,31 +366,121 @@
 "  WHERE id=?;"
 
 
+/**
+ * FEATURE_SUMMARY_COLUMNS:
+ *
+ * The feature columns needed for display, in the order of the `feature` table
+ * but without the geometry.
+ */
+#define FEATURE_SUMMARY_COLUMNS                                        \
+"feature.id, feature.name, feature.name_fr, feature.description,"      \
+" feature.description_fr, feature.color, feature.slug, feature.theme," \
+" feature.min_x, feature.max_x, feature.min_y, feature.max_y,"         \
+" feature.area, feature.n_vertices, feature.label_x, feature.label_y"
+
+
 /**
  * SEARCH_FEATURES_SQL:
  *
- * Search features by name.
+ * Search features by name, with the FTS5 query `?1`, returning the `?2`
+ * closest to the query string `?3` by edit distance.
+ *
+ * Candidates are ranked by rowid, so the feature rows are only read for the
+ * results that are returned, and then without the geometry.
+ */
+#define SEARCH_FEATURES_SQL                                     \
+"SELECT " FEATURE_SUMMARY_COLUMNS " FROM ("                     \
+"  SELECT feature.rowid AS rid,"                                \
+"         atrebas_distance(?3, feature.name) AS distance"       \
+"    FROM feature"                                              \
+"    INNER JOIN feature_fts ON feature.rowid=feature_fts.rowid" \
+"    WHERE feature_fts MATCH ?1"                                \
+"    ORDER BY distance, rid"                                    \
+"    LIMIT ?2"                                                  \
+"  ) AS ranked"                                                 \
+"  INNER JOIN feature ON feature.rowid=ranked.rid"              \
+"  ORDER BY ranked.distance, ranked.rid"
+
+
+/**
+ * BOUNDED_SEARCH_FEATURES_SQL:
+ *
+ * Search features by name, with the FTS5 query `?1`, within the extents
+ * `?4` (east), `?5` (west), `?6` (north) and `?7` (south), returning the `?2`
+ * closest to the query string `?3` by edit distance.
+ *
+ * The R*Tree stores single-precision extents, so the candidates are checked
+ * against the exact extents before they are ranked. Both entries of a feature
+ * across the antimeridian may match, so candidates are taken by rowid.
  */
-#define SEARCH_FEATURES_SQL   \
-"SELECT * FROM feature"       \
-"  WHERE name LIKE ? LIMIT ?"
+#define BOUNDED_SEARCH_FEATURES_SQL                                  \
+"SELECT " FEATURE_SUMMARY_COLUMNS " FROM ("                          \
+"  SELECT feature.rowid AS rid,"                                     \
+"         atrebas_distance(?3, feature.name) AS distance"            \
+"    FROM feature"                                                   \
+"    INNER JOIN feature_fts ON feature.rowid=feature_fts.rowid"      \
+"    WHERE feature_fts MATCH ?1"                                     \
+"      AND feature.rowid IN (SELECT id / 2 FROM feature_rtree"       \
+"        WHERE min_x<=?4 AND max_x>=?5 AND min_y<=?6 AND max_y>=?7)" \
+"      AND CASE WHEN feature.min_x<=feature.max_x"                   \
+"        THEN feature.min_x<=?4 AND feature.max_x>=?5"               \
+"        ELSE feature.min_x<=?4 OR feature.max_x>=?5 END"            \
+"      AND feature.min_y<=?6 AND feature.max_y>=?7"                  \
+"    ORDER BY distance, rid"                                         \
+"    LIMIT ?2"                                                       \
+"  ) AS ranked"                                                      \
+"  INNER JOIN feature ON feature.rowid=ranked.rid"                   \
+"  ORDER BY ranked.distance, ranked.rid"
 
 
 /**
- * GET_FEATURES_SQL:
+ * LOCATE_FEATURES_SQL:
  *
- * Search features by name.
+ * Get the features with extents containing the point at `?1` (longitude) and
+ * `?2` (latitude). The longitude must be in the range -180 to 180.
  */
-#define GET_FEATURES_SQL \
-"SELECT * FROM feature"
+#define LOCATE_FEATURES_SQL                                  \
+"SELECT feature.* FROM feature"                              \
+"  WHERE feature.rowid IN (SELECT id / 2 FROM feature_rtree" \
+"    WHERE min_x<=?1 AND max_x>=?1 AND min_y<=?2 AND max_y>=?2)"
 
 
 /**
  * GET_FEATURE_SQL:
  *
- * Get the language feature for `id`.
+ * Get the language feature for `id`, without the geometry.
  */
-#define GET_FEATURE_SQL \
-"SELECT * FROM feature" \
+#define GET_FEATURE_SQL                           \
+"SELECT " FEATURE_SUMMARY_COLUMNS " FROM feature" \
 "  WHERE id=?;"
 
+
+/**
+ * GET_GEOMETRY_SQL:
+ *
+ * Get the geometry of the feature for `id`.
+ */
+#define GET_GEOMETRY_SQL       \
+"SELECT geometry FROM feature" \
+"  WHERE id=?;"
+
+
+/**
+ * GET_FEATURE_ROW_SQL:
+ *
+ * Get the feature with the rowid `?1`.
+ */
+#define GET_FEATURE_ROW_SQL \
+"SELECT * FROM feature"     \
+"  WHERE rowid=?;"
+
+
+/**
+ * GET_EXTENTS_SQL:
+ *
+ * Get the rowid and extents of every feature.
+ */
+#define GET_EXTENTS_SQL                    \
+"SELECT rowid, min_x, max_x, min_y, max_y" \
+"  FROM feature;"
+
@@ -73,6 +73,48 @@ atrebas_geocode_parameters_add_string (GHashTable *parameters,
   g_hash_table_replace (parameters, (gpointer)key, val);
 }
 
+void
+atrebas_geocode_parameters_add_int (GHashTable *parameters,
+                                    const char *key,
+                                    int         value)
+{
+  GValue *val;
+
+  val = g_new0 (GValue, 1);
+  g_value_init (val, G_TYPE_INT);
+  g_value_set_int (val, value);
+
+  g_hash_table_replace (parameters, (gpointer)key, val);
+}
+
+void
+atrebas_geocode_parameters_add_uint (GHashTable   *parameters,
+                                     const char   *key,
+                                     unsigned int  value)
+{
+  GValue *val;
+
+  val = g_new0 (GValue, 1);
+  g_value_init (val, G_TYPE_UINT);
+  g_value_set_uint (val, value);
+
+  g_hash_table_replace (parameters, (gpointer)key, val);
+}
+
+void
+atrebas_geocode_parameters_add_pointer (GHashTable *parameters,
+                                        const char *key,
+                                        gpointer    value)
+{
+  GValue *val;
+
+  val = g_new0 (GValue, 1);
+  g_value_init (val, G_TYPE_POINTER);
+  g_value_set_pointer (val, value);
+
+  g_hash_table_replace (parameters, (gpointer)key, val);
+}
+
 /**
  * atrebas_geocode_parameters_for_coordinates:
  * @latitude: a north-west position
@@ -1,11 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // SPDX-FileCopyrightText: 2022 Andy Holmes <andrew.g.r.holmes@gmail.com>
-// SPDX-FileCopyrightText: Copyright 1994-2006 W Randolph Franklin (WRF)
 
 #define G_LOG_DOMAIN "atrebas-backend"
 
 #include "config.h"
 
+#include <math.h>
+
 #include <geocode-glib/geocode-glib.h>
 #include <gio/gio.h>
 #include <json-glib/json-glib.h>
@@ -14,12 +15,22 @@
 
 #include "atrebas-backend.h"
 #include "atrebas-backend-private.h"
+#include "atrebas-enums.h"
 #include "atrebas-feature.h"
+#include "atrebas-feature-private.h"
+#include "atrebas-geojson-reader.h"
+#include "atrebas-geometry.h"
 #include "atrebas-macros.h"
+#include "atrebas-spatial-index.h"
 
 
 #define NATIVE_LAND_API     "https://native-land.ca/api/index.php"
+#define BUNDLED_DATABASE    PACKAGE_DATADIR"/maps/atrebas.db"
 #define QUERY_DEFAULT_LIMIT 1000
+#define PROGRESS_INTERVAL   500
+#define READER_POOL_SIZE    4
+#define PROGRESS_HANDLER_N  1000
+#define IMPORT_HIGH_WATER   256
 
 
 /**
@@ -34,15 +45,71 @@
  * themed maps.
  */
 
+enum {
+  STMT_ADD_FEATURE,
+  STMT_BOUNDED_SEARCH_FEATURES,
+  STMT_GET_EXTENTS,
+  STMT_GET_FEATURE,
+  STMT_GET_FEATURE_COVER,
+  STMT_GET_FEATURE_HASH,
+  STMT_GET_FEATURE_ROW,
+  STMT_GET_FEATURE_SLOT,
+  STMT_GET_GEOMETRY,
+  STMT_GET_SOURCE,
+  STMT_GET_STALE_FEATURES,
+  STMT_LOCATE_FEATURES,
+  STMT_NEXT_GENERATION,
+  STMT_REMOVE_FEATURE,
+  STMT_REMOVE_STALE_FEATURES,
+  STMT_SEARCH_FEATURES,
+  STMT_SET_FEATURE_COVER,
+  STMT_SET_FEATURE_STATE,
+  STMT_SET_SOURCE,
+  STMT_UPDATE_FEATURE,
+  N_STATEMENTS,
+};
+
+/* The operation running on a connection, checked by its progress handler */
+typedef struct
+{
+  GCancellable *cancellable;
+  gint64        deadline;
+} OperationContext;
+
 struct _AtrebasBackend
 {
   GObject       parent_instance;
 
-  SoupSession  *session;
+  char         *api_uri;
   sqlite3      *connection;
   char         *path;
-  sqlite3_stmt *stmts[5];
+  sqlite3_stmt *stmts[N_STATEMENTS];
   GAsyncQueue  *operations;
+  unsigned int  sequence;
+  OperationContext context;
+
+  /* Coalesced operations */
+  GMutex        coalesce_lock;
+  GHashTable   *coalesce;
+
+  /* Read-only connections */
+  GAsyncQueue  *queries;
+  GPtrArray    *readers;
+  unsigned int  readers_ready : 1;
+
+  /* Resident index of feature extents, published by the writer */
+  GMutex        index_lock;
+  AtrebasSpatialIndex *index;
+  unsigned int  index_serial;
+  unsigned int  index_published;
+
+  /* Live features by ID, as weak references */
+  GMutex        features_lock;
+  GHashTable   *features;
+  unsigned int  features_epoch;
+  unsigned int  features_prune;
+
+  unsigned int  bundled : 1;
   unsigned int  closed : 1;
 };
 
@@ -54,6 +121,8 @@ G_DEFINE_TYPE_WITH_CODE (AtrebasBackend, atrebas_backend, G_TYPE_OBJECT,
 
 enum {
   PROP_0,
+  PROP_API_URI,
+  PROP_BUNDLED,
   PROP_PATH,
   N_PROPERTIES
 };
@@ -61,14 +130,12 @@ enum {
 static GParamSpec *properties[N_PROPERTIES] = { NULL, };
 
 enum {
-  STMT_ADD_FEATURE,
-  STMT_GET_FEATURE,
-  STMT_GET_FEATURES,
-  STMT_REMOVE_FEATURE,
-  STMT_SEARCH_FEATURES,
-  N_STATEMENTS,
+  PROGRESS,
+  N_SIGNALS
 };
 
+static unsigned int signals[N_SIGNALS] = { 0, };
+
 static gconstpointer statements[N_STATEMENTS] = { NULL, };
 
 static GeocodeBackend *default_backend = NULL;
@@ -76,10 +143,15 @@ static GeocodeBackend *default_backend = NULL;
 
 /*
  * The source URIs for native-land.ca
+ *
+ * The remote and bundled maps of a theme share a source key, so features
+ * missing from an update are removed whichever of them they were first
+ * imported from.
  */
 typedef struct
 {
-  char        *uri;
+  char            *uri;
+  char            *source;
   AtrebasMapTheme  theme;
 } MapSource;
 
@@ -89,22 +161,26 @@ map_source_free (gpointer data)
   MapSource *source = data;
 
   g_clear_pointer (&source->uri, g_free);
+  g_clear_pointer (&source->source, g_free);
   g_clear_pointer (&source, g_free);
 }
 
-/* Native Lands Digital */
+/* Native Lands Digital, relative to AtrebasBackend:api-uri */
 static MapSource nl_languages = {
-  "https://native-land.ca/api/index.php?maps=languages",
+  "?maps=languages",
+  "languages",
   ATREBAS_MAP_THEME_LANGUAGE,
 };
 
 static MapSource nl_territories = {
-  "https://native-land.ca/api/index.php?maps=territories",
+  "?maps=territories",
+  "territories",
   ATREBAS_MAP_THEME_TERRITORY,
 };
 
 static MapSource nl_treaties = {
-  "https://native-land.ca/api/index.php?maps=treaties",
+  "?maps=treaties",
+  "treaties",
   ATREBAS_MAP_THEME_TREATY,
 };
 
@@ -117,16 +193,19 @@ static MapSource *remote_sources[] = {
 /* Bundled GeoJSON */
 static MapSource bundled_languages = {
   "file://"PACKAGE_DATADIR"/maps/indigenousLanguages.json",
+  "languages",
   ATREBAS_MAP_THEME_LANGUAGE,
 };
 
 static MapSource bundled_territories = {
   "file://"PACKAGE_DATADIR"/maps/indigenousTerritories.json",
+  "territories",
   ATREBAS_MAP_THEME_TERRITORY,
 };
 
 static MapSource bundled_treaties = {
   "file://"PACKAGE_DATADIR"/maps/indigenousTreaties.json",
+  "treaties",
   ATREBAS_MAP_THEME_TREATY,
 };
 
@@ -137,200 +216,235 @@ static MapSource *local_sources[] = {
 };
 
 
-/**
- * geojson_pnpoly:
- * @coordinates: a #JsonArray
- * @x: X-axis coordinate of the test point
- * @y: Y-axis coordinate of the test point
- *
- * Check if the point (@x, @y) is within the boundaries of the polygon described
- * by @coordinates.
- *
- * @coordinates must be the `coordinates` field of a GeoJSON fragment containing
- * a `Polygon` type.
- *
- * Based on "pnpoly":
- *     Copyright 1994-2006 W Randolph Franklin (WRF)
- *     https://wrf.ecse.rpi.edu/Research/Short_Notes/pnpoly.html
+/*
+ * Ranking
  *
- * Returns: %TRUE if inside, %FALSE if outside
+ * Search results are ranked by the edit distance between the query and the
+ * feature name. Both are normalized and case-folded into UCS-4 once, and the
+ * distance is computed with Myers' bit-parallel algorithm (in Hyyrö's
+ * formulation), which handles queries of up to 64 characters in O(n) words.
+ * Longer queries fall back to the two-row dynamic programming algorithm.
  */
-static inline gboolean
-geojson_pnpoly (JsonArray *coordinates,
-                double     x,
-                double     y)
+#define RANK_PEQ_SIZE 128
+
+typedef struct
 {
-  gboolean ret = FALSE;
-  JsonArray *polygon;
-  unsigned int n_vertices = 0;
+  gunichar     *chars;
+  long          len;
 
-  polygon = json_array_get_array_element (coordinates, 0);
-  n_vertices = json_array_get_length (polygon);
+  /* Match vectors for each character in the pattern, by open addressing */
+  gunichar      peq_char[RANK_PEQ_SIZE];
+  guint64       peq_mask[RANK_PEQ_SIZE];
+} RankPattern;
 
-  for (unsigned int i = 0, j = n_vertices - 1; i < n_vertices; j = i++)
-    {
-      JsonArray *next = json_array_get_array_element (polygon, i);
-      double nextx = json_array_get_double_element (next, 0);
-      double nexty = json_array_get_double_element (next, 1);
+static gunichar *
+rank_normalize (const char *str,
+                long       *len)
+{
+  g_autofree char *normalized = NULL;
+  g_autofree char *folded = NULL;
 
-      JsonArray *prev = json_array_get_array_element (polygon, j);
-      double prevx = json_array_get_double_element (prev, 0);
-      double prevy = json_array_get_double_element (prev, 1);
+  *len = 0;
 
-      if ((nexty > y) != (prevy > y) &&
-          (x < (prevx - nextx) * (y - nexty) / (prevy - nexty) + nextx))
-       ret = !ret;
-    }
+  if (str == NULL || !g_utf8_validate (str, -1, NULL))
+    return NULL;
 
-  return ret;
+  normalized = g_utf8_normalize (str, -1, G_NORMALIZE_ALL_COMPOSE);
+  folded = g_utf8_casefold (normalized, -1);
+
+  return g_utf8_to_ucs4_fast (folded, -1, len);
 }
 
-/**
- * geojson_intersect:
- * @coordinates: a #JsonArray
- * @left: left extent
- * @top: top extent
- * @right: right extent
- * @bottom: bottom extent
- *
- * Check if the bounding box defined by @top, @right, @bottom and @left
- * intersects with the extents of the polygon described by @coordinates.
- *
- * @coordinates must be the `coordinates` field of a GeoJSON fragment containing
- * a `Polygon` type.
- *
- * Returns: %TRUE if inside, %FALSE if outside
- */
-static inline gboolean
-geojson_intersect (JsonArray *coordinates,
-                   double     left,
-                   double     top,
-                   double     right,
-                   double     bottom)
+static inline unsigned int
+rank_peq_slot (const RankPattern *pattern,
+               gunichar           c)
 {
-  JsonArray *polygon;
-  unsigned int n_vertices = 0;
-  double max_x = 0.0;
-  double min_x = 0.0;
-  double max_y = 0.0;
-  double min_y = 0.0;
+  unsigned int slot = (c * 2654435761U) % RANK_PEQ_SIZE;
 
-  polygon = json_array_get_array_element (coordinates, 0);
-  n_vertices = json_array_get_length (polygon);
+  /* The table can't fill, since the pattern is at most 64 characters */
+  while (pattern->peq_char[slot] != 0 && pattern->peq_char[slot] != c)
+    slot = (slot + 1) % RANK_PEQ_SIZE;
 
-  for (unsigned int i = 0; i < n_vertices; i++)
-    {
-      JsonArray *point = json_array_get_array_element (polygon, i);
-      double x = json_array_get_double_element (point, 0);
-      double y = json_array_get_double_element (point, 1);
+  return slot;
+}
 
-      if G_UNLIKELY (i == 0)
-        {
-          min_x = x;
-          min_y = y;
-          max_x = x;
-          max_y = y;
-        }
-      else
-        {
-          if (min_x > x)
-            min_x = x;
+static void
+rank_pattern_init (RankPattern *pattern,
+                   const char  *query)
+{
+  *pattern = (RankPattern){ 0, };
+  pattern->chars = rank_normalize (query, &pattern->len);
 
-          if (min_y > y)
-            min_y = y;
+  if (pattern->len == 0 || pattern->len > 64)
+    return;
 
-          if (max_x < x)
-            max_x = x;
+  for (long i = 0; i < pattern->len; i++)
+    {
+      unsigned int slot = rank_peq_slot (pattern, pattern->chars[i]);
 
-          if (max_y < y)
-            max_y = y;
-        }
+      pattern->peq_char[slot] = pattern->chars[i];
+      pattern->peq_mask[slot] |= G_GUINT64_CONSTANT (1) << i;
     }
-
-  return (min_x <= right && left <= max_x &&
-          min_y <= bottom && top <= max_y);
 }
 
+static void
+rank_pattern_clear (RankPattern *pattern)
+{
+  g_clear_pointer (&pattern->chars, g_free);
+}
 
-// https://gist.github.com/sahib/2622023
-// Utf8 aware levenshtein
-static inline int
-levenshtein_strcmp0 (const char *name1,
-                     const char *name2)
+static unsigned int
+rank_distance_dp (const gunichar *s,
+                  long            n,
+                  const gunichar *t,
+                  long            m)
 {
-  g_autofree char *s = NULL;
-  g_autofree char *t = NULL;
-  int n, m;
+  g_autofree unsigned int *row = NULL;
+  row = g_new (unsigned int, m + 1);
+
+  for (long j = 0; j <= m; j++)
+    row[j] = j;
 
-  if G_UNLIKELY (!g_utf8_validate (name1, -1, NULL) ||
-                 !g_utf8_validate (name2, -1, NULL))
-    return 0;
+  for (long i = 1; i <= n; i++)
+    {
+      unsigned int diagonal = row[0];
+
+      row[0] = i;
+
+      for (long j = 1; j <= m; j++)
+        {
+          unsigned int above = row[j];
+          unsigned int cost = diagonal + (s[i - 1] != t[j - 1]);
 
-  s = g_utf8_normalize (name1, -1, G_NORMALIZE_ALL_COMPOSE);
-  n = (s) ? g_utf8_strlen (s, -1) + 1 : 0;
+          row[j] = MIN (MIN (above, row[j - 1]) + 1, cost);
+          diagonal = above;
+        }
+    }
 
-  t = g_utf8_normalize (name2, -1, G_NORMALIZE_ALL_COMPOSE);
-  m = (t) ? g_utf8_strlen (t, -1) + 1 : 0;
+  return row[m];
+}
 
-  // Nothing to compute really..
-  if G_UNLIKELY (n < 2)
-      return m;
+static unsigned int
+rank_distance (const RankPattern *pattern,
+               const gunichar    *text,
+               long               len)
+{
+  guint64 pv, mv, last;
+  unsigned int score;
 
-  if G_UNLIKELY (m < 2)
-    return n;
+  if (pattern->len == 0)
+    return len;
 
-  // String matrix
-  int d[n][m];
+  if (len == 0)
+    return pattern->len;
 
-  // Init first row|column to 0...n|m
-  for (int i = 0; i < n; i++)
-    d[i][0] = i;
+  if (pattern->len > 64)
+    return rank_distance_dp (pattern->chars, pattern->len, text, len);
 
-  for (int j = 0; j < m; j++)
-    d[0][j] = j;
+  pv = G_MAXUINT64;
+  mv = 0;
+  last = G_GUINT64_CONSTANT (1) << (pattern->len - 1);
+  score = pattern->len;
 
-  for (int i = 1; i < n; i++)
+  for (long i = 0; i < len; i++)
     {
-      // Current char in string s
-      gunichar cats = g_utf8_get_char (g_utf8_offset_to_pointer (s, i - 1));
+      unsigned int slot = rank_peq_slot (pattern, text[i]);
+      guint64 eq = pattern->peq_mask[slot];
+      guint64 xv, xh, ph, mh;
+
+      xv = eq | mv;
+      xh = (((eq & pv) + pv) ^ pv) | eq;
+      ph = mv | ~(xh | pv);
+      mh = pv & xh;
+
+      if (ph & last)
+        score++;
+      else if (mh & last)
+        score--;
+
+      /* Shifting in a set bit gives the global, rather than local, distance */
+      ph = (ph << 1) | 1;
+      mh = mh << 1;
+      pv = mh | ~(xv | ph);
+      mv = ph & xv;
+    }
 
-      for (int j = 1; j < m; j++)
-        {
-          // Do -1 only once
-          int jm1 = j - 1;
-          int im1 = i - 1;
+  return score;
+}
 
-          gunichar tats = g_utf8_get_char (g_utf8_offset_to_pointer (t, jm1));
+static void
+rank_pattern_free (gpointer data)
+{
+  RankPattern *pattern = data;
 
-          // a = above cell, b = left cell, c = left above celli
-          int a = d[im1][j] + 1;
-          int b = d[i][jm1] + 1;
-          int c = d[im1][jm1] + (tats != cats);
+  rank_pattern_clear (pattern);
+  g_free (pattern);
+}
 
-          // Compute the minimum of a,b,c and set MIN(a,b,c) to cell d[i][j]
-          d[i][j] = (a < b) ? MIN (a, c) : MIN (b, c);
-        }
+/*
+ * atrebas_distance(query, name)
+ *
+ * An SQL function returning the edit distance between @query and @name, so
+ * that results can be ranked and limited by SQLite. The query is a bound
+ * parameter, so its pattern is compiled once per statement.
+ */
+static void
+rank_distance_func (sqlite3_context  *context,
+                    int               argc,
+                    sqlite3_value   **argv)
+{
+  RankPattern *pattern;
+  g_autofree gunichar *text = NULL;
+  long len;
+
+  g_assert (argc == 2);
+
+  text = rank_normalize ((const char *)sqlite3_value_text (argv[1]), &len);
+
+  if ((pattern = sqlite3_get_auxdata (context, 0)) != NULL)
+    {
+      sqlite3_result_int (context, rank_distance (pattern, text, len));
+      return;
     }
 
-  // The result is stored in the very right down cell
-  return d[n - 1][m - 1];
+  pattern = g_new (RankPattern, 1);
+  rank_pattern_init (pattern, (const char *)sqlite3_value_text (argv[0]));
+  sqlite3_result_int (context, rank_distance (pattern, text, len));
+
+  /* SQLite takes ownership, even if it frees the pattern immediately */
+  sqlite3_set_auxdata (context, 0, pattern, rank_pattern_free);
 }
 
 static int
-levenshtein_sort (gconstpointer a,
-                  gconstpointer b,
-                  gpointer      user_data)
+rank_register_functions (sqlite3 *connection)
 {
-  const char *name1 = geocode_place_get_name (GEOCODE_PLACE (a));
-  const char *name2 = geocode_place_get_name (GEOCODE_PLACE (b));
-  const char *query = user_data;
-
-  return levenshtein_strcmp0 (query, name1) - levenshtein_strcmp0 (query, name2);
+  return sqlite3_create_function_v2 (connection,
+                                     "atrebas_distance",
+                                     2,
+                                     SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                     NULL,
+                                     rank_distance_func,
+                                     NULL,
+                                     NULL,
+                                     NULL);
 }
 
 
 /*
  * Operation Queue
+ *
+ * Operations are ordered by mode, then by the I/O priority of the task, then
+ * in the order they were queued. Imports run at %G_PRIORITY_LOW, so
+ * interactive queries are taken ahead of any that haven't started.
+ *
+ * An operation may have a coalescing key, in which case it supersedes any
+ * operation with the same key that hasn't started yet. The superseded
+ * operations are cancelled when they reach the front of the queue, and the
+ * key is forgotten when the latest operation for it is freed.
+ *
+ * While an operation runs, the #OperationContext of its connection holds its
+ * cancellable and deadline, which the progress handler checks so that a
+ * running statement is interrupted promptly.
  */
 typedef enum
 {
@@ -344,13 +458,156 @@ typedef struct
   GTask           *task;
   GTaskThreadFunc  task_func;
   OperationMode    task_mode;
+  gpointer         key;
+  unsigned int     sequence;
+  gint64           deadline;
 } OperationClosure;
 
+static OperationClosure *
+operation_closure_new (AtrebasBackend  *self,
+                       GTask           *task,
+                       GTaskThreadFunc  task_func,
+                       OperationMode    task_mode,
+                       gpointer         key)
+{
+  OperationClosure *closure;
+
+  closure = g_new0 (OperationClosure, 1);
+  closure->task = task ? g_object_ref (task) : NULL;
+  closure->task_func = task_func;
+  closure->task_mode = task_mode;
+  closure->key = key;
+  closure->sequence = (unsigned int)g_atomic_int_add (&self->sequence, 1);
+
+  if (key != NULL)
+    {
+      g_mutex_lock (&self->coalesce_lock);
+      g_hash_table_insert (self->coalesce,
+                           key,
+                           GUINT_TO_POINTER (closure->sequence));
+      g_mutex_unlock (&self->coalesce_lock);
+    }
+
+  return closure;
+}
+
+static int
+operation_closure_compare (gconstpointer a,
+                           gconstpointer b,
+                           gpointer      user_data)
+{
+  static const int mode_order[] = {
+    [OPERATION_CRITICAL] = 0,
+    [OPERATION_DEFAULT] = 1,
+    [OPERATION_TERMINAL] = 2,
+  };
+  const OperationClosure *closure1 = a;
+  const OperationClosure *closure2 = b;
+  int priority1, priority2;
+
+  if (closure1->task_mode != closure2->task_mode)
+    return mode_order[closure1->task_mode] - mode_order[closure2->task_mode];
+
+  priority1 = closure1->task ? g_task_get_priority (closure1->task) : 0;
+  priority2 = closure2->task ? g_task_get_priority (closure2->task) : 0;
+
+  if (priority1 != priority2)
+    return (priority1 < priority2) ? -1 : 1;
+
+  /* The difference is used to tolerate the counter wrapping */
+  return (int)(closure1->sequence - closure2->sequence);
+}
+
+static gboolean
+operation_closure_superseded (OperationClosure *closure)
+{
+  AtrebasBackend *self;
+  gpointer latest;
+  gboolean ret = FALSE;
+
+  if (closure->key == NULL)
+    return FALSE;
+
+  self = g_task_get_source_object (closure->task);
+
+  g_mutex_lock (&self->coalesce_lock);
+  if (g_hash_table_lookup_extended (self->coalesce, closure->key, NULL, &latest))
+    ret = (GPOINTER_TO_UINT (latest) != closure->sequence);
+  g_mutex_unlock (&self->coalesce_lock);
+
+  return ret;
+}
+
+static int
+operation_context_progress (void *data)
+{
+  OperationContext *context = data;
+
+  if (g_cancellable_is_cancelled (context->cancellable))
+    return 1;
+
+  if (context->deadline > 0 && g_get_monotonic_time () >= context->deadline)
+    return 1;
+
+  return 0;
+}
+
+static void
+operation_closure_run (OperationClosure *closure,
+                       OperationContext *context)
+{
+  if (!G_IS_TASK (closure->task) || g_task_get_completed (closure->task))
+    return;
+
+  if (operation_closure_superseded (closure))
+    {
+      g_task_return_new_error (closure->task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_CANCELLED,
+                               "Operation superseded");
+      return;
+    }
+
+  if (closure->deadline > 0 && g_get_monotonic_time () >= closure->deadline)
+    {
+      g_task_return_new_error (closure->task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_TIMED_OUT,
+                               "Operation timed out");
+      return;
+    }
+
+  context->cancellable = g_task_get_cancellable (closure->task);
+  context->deadline = closure->deadline;
+
+  closure->task_func (closure->task,
+                      g_task_get_source_object (closure->task),
+                      g_task_get_task_data (closure->task),
+                      g_task_get_cancellable (closure->task));
+
+  context->cancellable = NULL;
+  context->deadline = 0;
+}
+
 static inline void
 operation_closure_free (gpointer data)
 {
   OperationClosure *closure = data;
 
+  /* Forget the key once the latest operation for it is finished or dropped,
+   * since it may be reused for something else */
+  if (closure->key != NULL && closure->task != NULL)
+    {
+      AtrebasBackend *self = g_task_get_source_object (closure->task);
+      gpointer latest;
+
+      g_mutex_lock (&self->coalesce_lock);
+      if (g_hash_table_lookup_extended (self->coalesce, closure->key, NULL, &latest) &&
+          GPOINTER_TO_UINT (latest) == closure->sequence)
+        g_hash_table_remove (self->coalesce, closure->key);
+      g_mutex_unlock (&self->coalesce_lock);
+    }
+
   g_clear_object (&closure->task);
   g_clear_pointer (&closure, g_free);
 }
@@ -380,17 +637,12 @@ atrebas_backend_thread (gpointer data)
   while ((closure = g_async_queue_pop (tasks)) != NULL)
     {
       unsigned int mode = closure->task_mode;
+      AtrebasBackend *self = g_task_get_source_object (closure->task);
 
-      if (G_IS_TASK (closure->task) && !g_task_get_completed (closure->task))
-        {
-          closure->task_func (closure->task,
-                              g_task_get_source_object (closure->task),
-                              g_task_get_task_data (closure->task),
-                              g_task_get_cancellable (closure->task));
+      operation_closure_run (closure, &self->context);
 
-          if (mode == OPERATION_CRITICAL && g_task_had_error (closure->task))
-            mode = OPERATION_TERMINAL;
-        }
+      if (mode == OPERATION_CRITICAL && g_task_had_error (closure->task))
+        mode = OPERATION_TERMINAL;
 
       g_clear_pointer (&closure, operation_closure_free);
 
@@ -410,28 +662,18 @@ atrebas_backend_thread (gpointer data)
 }
 
 static void
-atrebas_backend_thread_push (AtrebasBackend      *self,
-                         GTask           *task,
-                         GTaskThreadFunc  task_func,
-                         OperationMode    task_mode)
+atrebas_backend_operation_push (AtrebasBackend   *self,
+                                OperationClosure *closure)
 {
-  OperationClosure *closure;
-
-  g_assert (ATREBAS_IS_BACKEND (self));
-  g_assert (G_IS_TASK (task));
-  g_assert (task_func != NULL);
-
-  closure = g_new0 (OperationClosure, 1);
-  closure->task = g_object_ref (task);
-  closure->task_func = task_func;
-  closure->task_mode = task_mode;
-
   g_async_queue_lock (self->operations);
 
   if (!self->closed)
     {
       self->closed = (closure->task_mode == OPERATION_TERMINAL);
-      g_async_queue_push_unlocked (self->operations, g_steal_pointer (&closure));
+      g_async_queue_push_sorted_unlocked (self->operations,
+                                          g_steal_pointer (&closure),
+                                          operation_closure_compare,
+                                          NULL);
     }
 
   g_async_queue_unlock (self->operations);
@@ -439,543 +681,2273 @@ atrebas_backend_thread_push (AtrebasBackend      *self,
   g_clear_pointer (&closure, operation_closure_cancel);
 }
 
+static void
+atrebas_backend_thread_push (AtrebasBackend      *self,
+                         GTask           *task,
+                         GTaskThreadFunc  task_func,
+                         OperationMode    task_mode)
+{
+  OperationClosure *closure;
+
+  g_assert (ATREBAS_IS_BACKEND (self));
+  g_assert (G_IS_TASK (task));
+  g_assert (task_func != NULL);
+
+  closure = operation_closure_new (self, task, task_func, task_mode, NULL);
+  atrebas_backend_operation_push (self, closure);
+}
+
+
 /*
- * BackendQuery
+ * Reader Pool
+ *
+ * The thread above is the only writer. When the database is in WAL mode,
+ * queries are instead dispatched to a small pool of threads, each with its
+ * own read-only connection and prepared statements, so that they can run
+ * concurrently with each other and with imports.
+ *
+ * A task function gets the statements for the connection it runs on with
+ * atrebas_backend_get_statement(), so the same functions serve both lanes.
  */
+static const unsigned int reader_statements[] = {
+  STMT_BOUNDED_SEARCH_FEATURES,
+  STMT_GET_FEATURE,
+  STMT_GET_FEATURE_COVER,
+  STMT_GET_FEATURE_ROW,
+  STMT_GET_GEOMETRY,
+  STMT_LOCATE_FEATURES,
+  STMT_SEARCH_FEATURES,
+};
+
+static GPrivate reader_stmts = G_PRIVATE_INIT (NULL);
+
 typedef struct
 {
-  char         *location;
-  double        latitude;
-  double        longitude;
-  unsigned int  limit;
-  unsigned int  bounded : 1;
-  struct
-    {
-      double left;
-      double top;
-      double right;
-      double bottom;
-    } viewbox;
-} BackendQuery;
+  GAsyncQueue      *queries;
+  sqlite3          *connection;
+  sqlite3_stmt     *stmts[N_STATEMENTS];
+  OperationContext  context;
+} BackendReader;
 
-static BackendQuery *
-backend_query_new (GHashTable *parameters)
+static void
+backend_reader_free (gpointer data)
 {
-  BackendQuery *query = NULL;
-  GValue *value;
+  BackendReader *reader = data;
 
-  query = g_new0 (BackendQuery, 1);
-  query->limit = QUERY_DEFAULT_LIMIT;
+  for (unsigned int i = 0; i < N_STATEMENTS; i++)
+    g_clear_pointer (&reader->stmts[i], sqlite3_finalize);
 
-  if (g_hash_table_contains (parameters, "lat") &&
-      g_hash_table_contains (parameters, "lon"))
-    {
-      value = g_hash_table_lookup (parameters, "lat");
-      query->latitude = g_value_get_double (value);
+  g_clear_pointer (&reader->connection, sqlite3_close);
+  g_clear_pointer (&reader->queries, g_async_queue_unref);
+  g_free (reader);
+}
 
-      value = g_hash_table_lookup (parameters, "lon");
-      query->longitude = g_value_get_double (value);
-    }
+static BackendReader *
+backend_reader_new (AtrebasBackend  *self,
+                    GError         **error)
+{
+  BackendReader *reader;
+  int rc;
 
-  /* A custom Geocode parameter; a free-form search string */
-  if ((value = g_hash_table_lookup (parameters, "location")) != NULL &&
-      G_VALUE_HOLDS_STRING (value))
-    query->location = g_value_dup_string (value);
+  reader = g_new0 (BackendReader, 1);
+  reader->queries = g_async_queue_ref (self->queries);
 
-  /* A custom Geocode parameter; defines a limit on results. */
-  if ((value = g_hash_table_lookup (parameters, "limit")) != NULL &&
-      G_VALUE_HOLDS_UINT (value))
-    query->limit = g_value_get_uint (value);
+  rc = sqlite3_open_v2 (self->path,
+                        &reader->connection,
+                        (SQLITE_OPEN_READONLY |
+                         SQLITE_OPEN_NOMUTEX),
+                        NULL);
 
-  /* A custom Geocode parameter; defines whether the search results are
-   * restricted to a specific area.
-   */
-  if ((value = g_hash_table_lookup (parameters, "bounded")) != NULL &&
-      G_VALUE_HOLDS_BOOLEAN (value))
-    {
-      query->bounded = g_value_get_boolean (value);
+  if (rc == SQLITE_OK)
+    rc = rank_register_functions (reader->connection);
 
-      if ((value = g_hash_table_lookup (parameters, "viewbox")) != NULL &&
-          G_VALUE_HOLDS_STRING (value))
-        {
-          const char *viewbox;
-          g_auto (GStrv) bounds = NULL;
+  for (unsigned int i = 0; rc == SQLITE_OK && i < G_N_ELEMENTS (reader_statements); i++)
+    {
+      unsigned int index = reader_statements[i];
 
-          viewbox = g_value_get_string (value);
-          bounds = g_strsplit (viewbox, ",", -1);
+      rc = sqlite3_prepare_v2 (reader->connection,
+                               statements[index],
+                               -1,
+                               &reader->stmts[index],
+                               NULL);
+    }
 
-          if (g_strv_length (bounds) == 4)
-            {
-              query->viewbox.left = g_ascii_strtod (bounds[0], NULL);
-              query->viewbox.top = g_ascii_strtod (bounds[1], NULL);
-              query->viewbox.right = g_ascii_strtod (bounds[2], NULL);
-              query->viewbox.bottom = g_ascii_strtod (bounds[3], NULL);
-            }
-        }
+  if (rc != SQLITE_OK)
+    {
+      g_set_error (error,
+                   GEOCODE_ERROR,
+                   GEOCODE_ERROR_INTERNAL_SERVER,
+                   "%s: \"%s\": [%i] %s",
+                   G_STRFUNC, self->path, rc, sqlite3_errstr (rc));
+      g_clear_pointer (&reader, backend_reader_free);
+      return NULL;
     }
 
-  return query;
+  /* A checkpoint may briefly lock out readers */
+  sqlite3_busy_timeout (reader->connection, 1000);
+  sqlite3_progress_handler (reader->connection,
+                            PROGRESS_HANDLER_N,
+                            operation_context_progress,
+                            &reader->context);
+
+  return reader;
 }
 
-static void
-backend_query_free (gpointer data)
+static gpointer
+atrebas_backend_reader_thread (gpointer data)
+{
+  BackendReader *reader = data;
+  OperationClosure *closure = NULL;
+
+  g_private_set (&reader_stmts, reader->stmts);
+
+  while ((closure = g_async_queue_pop (reader->queries)) != NULL)
+    {
+      unsigned int mode = closure->task_mode;
+
+      operation_closure_run (closure, &reader->context);
+      g_clear_pointer (&closure, operation_closure_free);
+
+      if (mode == OPERATION_TERMINAL)
+        break;
+    }
+
+  g_private_set (&reader_stmts, NULL);
+  g_clear_pointer (&reader, backend_reader_free);
+
+  return NULL;
+}
+
+static inline sqlite3_stmt *
+atrebas_backend_get_statement (AtrebasBackend *self,
+                               unsigned int    index)
+{
+  sqlite3_stmt **stmts = g_private_get (&reader_stmts);
+
+  return stmts != NULL ? stmts[index] : self->stmts[index];
+}
+
+static void
+atrebas_backend_start_readers (AtrebasBackend *self)
+{
+  sqlite3_stmt *stmt = NULL;
+  gboolean is_wal = FALSE;
+  unsigned int n_readers;
+
+  g_assert (ATREBAS_IS_BACKEND (self));
+  g_assert (self->connection != NULL);
+
+  /* Concurrent readers require write-ahead logging, which in turn requires
+   * a database file that other connections can open */
+  if (sqlite3_prepare_v2 (self->connection,
+                          "PRAGMA journal_mode;",
+                          -1,
+                          &stmt,
+                          NULL) == SQLITE_OK &&
+      sqlite3_step (stmt) == SQLITE_ROW)
+    is_wal = (g_ascii_strcasecmp ((const char *)sqlite3_column_text (stmt, 0), "wal") == 0);
+  g_clear_pointer (&stmt, sqlite3_finalize);
+
+  if (!is_wal)
+    return;
+
+  n_readers = CLAMP (g_get_num_processors () - 1, 1, READER_POOL_SIZE);
+
+  for (unsigned int i = 0; i < n_readers; i++)
+    {
+      g_autoptr (GError) error = NULL;
+      BackendReader *reader;
+      GThread *thread;
+
+      if ((reader = backend_reader_new (self, &error)) == NULL)
+        {
+          g_warning ("%s: %s", G_STRFUNC, error->message);
+          break;
+        }
+
+      thread = g_thread_try_new ("atrebas-reader",
+                                 atrebas_backend_reader_thread,
+                                 reader,
+                                 &error);
+
+      if G_UNLIKELY (thread == NULL)
+        {
+          g_warning ("%s: %s", G_STRFUNC, error->message);
+          g_clear_pointer (&reader, backend_reader_free);
+          break;
+        }
+
+      g_ptr_array_add (self->readers, thread);
+    }
+
+  g_async_queue_lock (self->queries);
+  self->readers_ready = (self->readers->len > 0);
+  g_async_queue_unlock (self->queries);
+}
+
+static void
+atrebas_backend_stop_readers (AtrebasBackend *self)
+{
+  OperationClosure *closure;
+
+  g_assert (ATREBAS_IS_BACKEND (self));
+
+  /* Queries pushed from here on are routed to the writer */
+  g_async_queue_lock (self->queries);
+  self->readers_ready = FALSE;
+
+  for (unsigned int i = 0; i < self->readers->len; i++)
+    {
+      closure = operation_closure_new (self, NULL, NULL, OPERATION_TERMINAL, NULL);
+      g_async_queue_push_sorted_unlocked (self->queries,
+                                          closure,
+                                          operation_closure_compare,
+                                          NULL);
+    }
+
+  g_async_queue_unlock (self->queries);
+
+  /* Wait for the readers to finish */
+  g_ptr_array_set_size (self->readers, 0);
+
+  /* Cancel any queries left behind */
+  g_async_queue_lock (self->queries);
+
+  while ((closure = g_async_queue_try_pop_unlocked (self->queries)) != NULL)
+    g_clear_pointer (&closure, operation_closure_cancel);
+
+  g_async_queue_unlock (self->queries);
+}
+
+static void
+atrebas_backend_query_push (AtrebasBackend  *self,
+                            GTask           *task,
+                            GTaskThreadFunc  task_func,
+                            gpointer         key,
+                            gint64           deadline)
+{
+  OperationClosure *closure;
+
+  g_assert (ATREBAS_IS_BACKEND (self));
+  g_assert (G_IS_TASK (task));
+  g_assert (task_func != NULL);
+
+  closure = operation_closure_new (self, task, task_func, OPERATION_DEFAULT, key);
+  closure->deadline = deadline;
+
+  g_async_queue_lock (self->queries);
+
+  if (self->readers_ready)
+    {
+      g_async_queue_push_sorted_unlocked (self->queries,
+                                          closure,
+                                          operation_closure_compare,
+                                          NULL);
+      g_async_queue_unlock (self->queries);
+      return;
+    }
+
+  g_async_queue_unlock (self->queries);
+
+  /* Until the pool is ready, or if it's unavailable, use the writer */
+  atrebas_backend_operation_push (self, closure);
+}
+
+/*
+ * BackendQuery
+ */
+typedef struct
+{
+  char         *location;
+  double        latitude;
+  double        longitude;
+  unsigned int  limit;
+  int           priority;
+  gpointer      coalesce;
+  gint64        deadline;
+  GArray       *candidates;
+  unsigned int  bounded : 1;
+  struct
+    {
+      double left;
+      double top;
+      double right;
+      double bottom;
+    } viewbox;
+} BackendQuery;
+
+static BackendQuery *
+backend_query_new (GHashTable *parameters)
+{
+  BackendQuery *query = NULL;
+  GValue *value;
+
+  query = g_new0 (BackendQuery, 1);
+  query->limit = QUERY_DEFAULT_LIMIT;
+  query->priority = G_PRIORITY_DEFAULT;
+
+  if (g_hash_table_contains (parameters, "lat") &&
+      g_hash_table_contains (parameters, "lon"))
+    {
+      value = g_hash_table_lookup (parameters, "lat");
+      query->latitude = g_value_get_double (value);
+
+      value = g_hash_table_lookup (parameters, "lon");
+      query->longitude = g_value_get_double (value);
+
+      /* Positions past the antimeridian wrap, as the stored extents do */
+      if (query->longitude < -180.0 || query->longitude > 180.0)
+        query->longitude = remainder (query->longitude, 360.0);
+    }
+
+  /* A custom Geocode parameter; a free-form search string */
+  if ((value = g_hash_table_lookup (parameters, "location")) != NULL &&
+      G_VALUE_HOLDS_STRING (value))
+    query->location = g_value_dup_string (value);
+
+  /* A custom Geocode parameter; defines a limit on results. */
+  if ((value = g_hash_table_lookup (parameters, "limit")) != NULL &&
+      G_VALUE_HOLDS_UINT (value))
+    query->limit = g_value_get_uint (value);
+
+  /* A custom Geocode parameter; the I/O priority of the request. */
+  if ((value = g_hash_table_lookup (parameters, "priority")) != NULL &&
+      G_VALUE_HOLDS_INT (value))
+    query->priority = g_value_get_int (value);
+
+  /* A custom Geocode parameter; a timeout in milliseconds, after which any
+   * results found so far are returned. */
+  if ((value = g_hash_table_lookup (parameters, "timeout")) != NULL &&
+      G_VALUE_HOLDS_UINT (value) && g_value_get_uint (value) > 0)
+    query->deadline = g_get_monotonic_time () +
+                      g_value_get_uint (value) * G_TIME_SPAN_MILLISECOND;
+
+  /* A custom Geocode parameter; a newer request with the same pointer
+   * supersedes any older one that hasn't started. */
+  if ((value = g_hash_table_lookup (parameters, "coalesce")) != NULL &&
+      G_VALUE_HOLDS_POINTER (value))
+    query->coalesce = g_value_get_pointer (value);
+
+  /* A custom Geocode parameter; defines whether the search results are
+   * restricted to a specific area.
+   */
+  if ((value = g_hash_table_lookup (parameters, "bounded")) != NULL &&
+      G_VALUE_HOLDS_BOOLEAN (value))
+    {
+      query->bounded = g_value_get_boolean (value);
+
+      if ((value = g_hash_table_lookup (parameters, "viewbox")) != NULL &&
+          G_VALUE_HOLDS_STRING (value))
+        {
+          const char *viewbox;
+          g_auto (GStrv) bounds = NULL;
+
+          viewbox = g_value_get_string (value);
+          bounds = g_strsplit (viewbox, ",", -1);
+
+          if (g_strv_length (bounds) == 4)
+            {
+              double left = g_ascii_strtod (bounds[0], NULL);
+              double top = g_ascii_strtod (bounds[1], NULL);
+              double right = g_ascii_strtod (bounds[2], NULL);
+              double bottom = g_ascii_strtod (bounds[3], NULL);
+
+              /* Normalize the extents, so the viewbox can be passed
+               * directly to the spatial index */
+              query->viewbox.left = MIN (left, right);
+              query->viewbox.top = MAX (top, bottom);
+              query->viewbox.right = MAX (left, right);
+              query->viewbox.bottom = MIN (top, bottom);
+            }
+        }
+    }
+
+  return query;
+}
+
+static void
+backend_query_free (gpointer data)
 {
   BackendQuery *query = data;
 
   g_clear_pointer (&query->location, g_free);
+  g_clear_pointer (&query->candidates, g_array_unref);
   g_free (query);
 }
 
-
 /*
- * Step functions
+ * Build an FTS5 query from a free-form search string, matching each word as
+ * a prefix. Words are quoted, so the search string can't inject FTS5 syntax.
+ */
+static char *
+backend_query_match (const char *location)
+{
+  g_autoptr (GString) match = NULL;
+  g_auto (GStrv) words = NULL;
+
+  if (location == NULL)
+    return NULL;
+
+  match = g_string_new (NULL);
+  words = g_strsplit_set (location, " \t\n\r", -1);
+
+  for (unsigned int i = 0; words[i] != NULL; i++)
+    {
+      if (*words[i] == '\0')
+        continue;
+
+      if (match->len > 0)
+        g_string_append_c (match, ' ');
+
+      g_string_append_c (match, '"');
+
+      for (const char *c = words[i]; *c != '\0'; c++)
+        {
+          if (*c == '"')
+            g_string_append_c (match, '"');
+          g_string_append_c (match, *c);
+        }
+
+      g_string_append (match, "\"*");
+    }
+
+  if (match->len == 0)
+    return NULL;
+
+  return g_string_free (g_steal_pointer (&match), FALSE);
+}
+
+static gboolean
+backend_query_timed_out (BackendQuery  *query,
+                         GCancellable  *cancellable,
+                         GError       **error)
+{
+  /* An interrupted statement is either cancelled or past its deadline */
+  if (query->deadline == 0 ||
+      g_cancellable_is_cancelled (cancellable) ||
+      !g_error_matches (*error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return FALSE;
+
+  g_clear_error (error);
+  g_set_error_literal (error,
+                       G_IO_ERROR,
+                       G_IO_ERROR_TIMED_OUT,
+                       "Operation timed out");
+
+  return TRUE;
+}
+
+
+/*
+ * FeatureRecord
+ */
+typedef struct
+{
+  char   *id;
+  char   *name;
+  char   *name_fr;
+  char   *uri;
+  char   *uri_fr;
+  char   *color;
+  char   *slug;
+  GBytes *geometry;
+  gint64  hash;
+
+  /* Derived from the geometry by the writer; see feature_record_derive() */
+  double  min_x, max_x, min_y, max_y;
+  double  area;
+  guint32 n_vertices;
+  double  label_x, label_y;
+  gint64  key;
+} FeatureRecord;
+
+/* 64-bit FNV-1a, which is stable across runs and platforms */
+#define FNV_OFFSET_BASIS G_GUINT64_CONSTANT (0xcbf29ce484222325)
+#define FNV_PRIME        G_GUINT64_CONSTANT (0x100000001b3)
+
+static inline guint64
+fnv1a_update (guint64     hash,
+              const void *data,
+              size_t      size)
+{
+  const guint8 *bytes = data;
+
+  for (size_t i = 0; i < size; i++)
+    {
+      hash ^= bytes[i];
+      hash *= FNV_PRIME;
+    }
+
+  return hash;
+}
+
+static inline guint64
+fnv1a_update_string (guint64     hash,
+                     const char *str)
+{
+  /* Include the terminator, so adjacent fields can't run together */
+  if (str == NULL)
+    return fnv1a_update (hash, "", 1);
+
+  return fnv1a_update (hash, str, strlen (str) + 1);
+}
+
+static inline const char *
+property_with_default (AtrebasGeojsonReader *reader,
+                       const char           *name,
+                       const char           *default_value)
+{
+  const char *value = atrebas_geojson_reader_get_property (reader, name);
+
+  return value != NULL ? value : default_value;
+}
+
+static FeatureRecord *
+feature_record_new (AtrebasGeojsonReader *reader,
+                    AtrebasMapTheme       theme)
+{
+  FeatureRecord *record;
+  GBytes *geometry;
+  const guint8 *data;
+  size_t size;
+  guint64 hash = FNV_OFFSET_BASIS;
+  guint32 theme_le = GUINT32_TO_LE (theme);
+
+  if ((geometry = atrebas_geojson_reader_get_geometry (reader)) == NULL)
+    return NULL;
+
+  record = g_new0 (FeatureRecord, 1);
+  record->id = g_strdup (atrebas_geojson_reader_get_id (reader));
+  record->name = g_strdup (property_with_default (reader, "Name", "Unknown"));
+  record->name_fr = g_strdup (property_with_default (reader, "FrenchName", record->name));
+  record->uri = g_strdup (property_with_default (reader, "description", "https://native-land.ca"));
+  record->uri_fr = g_strdup (property_with_default (reader, "FrenchDescription", record->uri));
+  record->color = g_strdup (property_with_default (reader, "color", "#000000"));
+  record->slug = g_strdup (property_with_default (reader, "Slug", ""));
+  record->geometry = g_bytes_ref (geometry);
+
+  /* The content hash covers every stored field */
+  hash = fnv1a_update_string (hash, record->id);
+  hash = fnv1a_update_string (hash, record->name);
+  hash = fnv1a_update_string (hash, record->name_fr);
+  hash = fnv1a_update_string (hash, record->uri);
+  hash = fnv1a_update_string (hash, record->uri_fr);
+  hash = fnv1a_update_string (hash, record->color);
+  hash = fnv1a_update_string (hash, record->slug);
+  hash = fnv1a_update (hash, &theme_le, sizeof (theme_le));
+
+  data = g_bytes_get_data (geometry, &size);
+  record->hash = (gint64)fnv1a_update (hash, data, size);
+
+  return record;
+}
+
+static void
+feature_record_free (gpointer data)
+{
+  FeatureRecord *record = data;
+
+  g_clear_pointer (&record->id, g_free);
+  g_clear_pointer (&record->name, g_free);
+  g_clear_pointer (&record->name_fr, g_free);
+  g_clear_pointer (&record->uri, g_free);
+  g_clear_pointer (&record->uri_fr, g_free);
+  g_clear_pointer (&record->color, g_free);
+  g_clear_pointer (&record->slug, g_free);
+  g_clear_pointer (&record->geometry, g_bytes_unref);
+  g_free (record);
+}
+
+
+/*
+ * Feature Interning
+ *
+ * Every query that materializes a feature returns the instance that is already
+ * alive for that ID, if there is one, so that the map view, search model and
+ * bookmarks share a single object and its geometry.
+ *
+ * The table holds weak references, so it never keeps a feature alive. When an
+ * import changes a row the entry is forgotten and the epoch advanced; a reader
+ * that started before then may have read the old row, so it returns its
+ * feature without interning it.
+ */
+#define FEATURES_PRUNE_MIN 256
+
+static void
+feature_ref_free (gpointer data)
+{
+  GWeakRef *ref = data;
+
+  g_weak_ref_clear (ref);
+  g_free (ref);
+}
+
+static gboolean
+feature_ref_is_dead (gpointer key,
+                     gpointer value,
+                     gpointer user_data)
+{
+  g_autoptr (GObject) object = g_weak_ref_get ((GWeakRef *)value);
+
+  return object == NULL;
+}
+
+static inline unsigned int
+atrebas_backend_intern_epoch (AtrebasBackend *self)
+{
+  unsigned int epoch;
+
+  g_mutex_lock (&self->features_lock);
+  epoch = self->features_epoch;
+  g_mutex_unlock (&self->features_lock);
+
+  return epoch;
+}
+
+static AtrebasFeature *
+atrebas_backend_intern_lookup (AtrebasBackend *self,
+                               const char     *id)
+{
+  AtrebasFeature *feature = NULL;
+  GWeakRef *ref;
+
+  g_mutex_lock (&self->features_lock);
+  if ((ref = g_hash_table_lookup (self->features, id)) != NULL)
+    feature = g_weak_ref_get (ref);
+  g_mutex_unlock (&self->features_lock);
+
+  return feature;
+}
+
+static AtrebasFeature *
+atrebas_backend_intern (AtrebasBackend *self,
+                        AtrebasFeature *feature,
+                        unsigned int    epoch)
+{
+  const char *id = atrebas_feature_get_nld_id (feature);
+  AtrebasFeature *live = NULL;
+  GWeakRef *ref;
+
+  g_mutex_lock (&self->features_lock);
+
+  /* Another reader may have interned the same feature first */
+  if ((ref = g_hash_table_lookup (self->features, id)) != NULL &&
+      (live = g_weak_ref_get (ref)) != NULL)
+    {
+      g_mutex_unlock (&self->features_lock);
+      g_object_unref (feature);
+
+      return live;
+    }
+
+  if (epoch == self->features_epoch)
+    {
+      if (ref == NULL)
+        {
+          ref = g_new0 (GWeakRef, 1);
+          g_weak_ref_init (ref, NULL);
+          g_hash_table_insert (self->features, g_strdup (id), ref);
+        }
+
+      g_weak_ref_set (ref, feature);
+
+      /* Drop the entries of finalized features as the table grows */
+      if (g_hash_table_size (self->features) > self->features_prune)
+        {
+          g_hash_table_foreach_remove (self->features, feature_ref_is_dead, NULL);
+          self->features_prune = MAX (FEATURES_PRUNE_MIN,
+                                      2 * g_hash_table_size (self->features));
+        }
+    }
+
+  g_mutex_unlock (&self->features_lock);
+
+  return feature;
+}
+
+static void
+atrebas_backend_intern_forget (AtrebasBackend *self,
+                               GPtrArray      *ids)
+{
+  if (ids->len == 0)
+    return;
+
+  g_mutex_lock (&self->features_lock);
+  self->features_epoch++;
+
+  for (unsigned int i = 0; i < ids->len; i++)
+    g_hash_table_remove (self->features, g_ptr_array_index (ids, i));
+  g_mutex_unlock (&self->features_lock);
+}
+
+
+/*
+ * Step functions
+ */
+static inline void
+step_set_error (GError     **error,
+                const char  *func,
+                int          rc)
+{
+  /* Interrupted by the progress handler; see operation_context_progress() */
+  if (rc == SQLITE_INTERRUPT)
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_CANCELLED,
+                           "Operation interrupted");
+      return;
+    }
+
+  g_set_error (error,
+               G_IO_ERROR,
+               G_IO_ERROR_FAILED,
+               "%s: %s", func, sqlite3_errstr (rc));
+}
+
+static inline AtrebasFeature *
+atrebas_backend_feature_from_row (AtrebasBackend *self,
+                                  sqlite3_stmt   *stmt,
+                                  unsigned int    epoch)
+{
+  g_autoptr (GBytes) geometry = NULL;
+  g_autoptr (GeocodeLocation) location = NULL;
+  AtrebasFeature *feature;
+  const guint8 *data;
+  size_t size;
+
+  feature = atrebas_backend_intern_lookup (self, (const char *)sqlite3_column_text (stmt, 0));
+
+  if (feature != NULL && atrebas_feature_get_geometry (feature) != NULL)
+    return feature;
+
+  /* Copy the packed column as-is; coordinates are decoded on demand */
+  data = sqlite3_column_blob (stmt, 6);
+  size = sqlite3_column_bytes (stmt, 6);
+
+  if (atrebas_geometry_validate (data, size))
+    geometry = g_bytes_new (data, size);
+
+  /* A live summary takes the geometry, since it has already been read */
+  if (feature != NULL)
+    {
+      if (geometry != NULL)
+        atrebas_feature_take_geometry (feature, g_steal_pointer (&geometry));
+
+      return feature;
+    }
+
+  /* The derived attributes were computed when the feature was stored */
+  location = g_object_new (GEOCODE_TYPE_LOCATION,
+                           "description", sqlite3_column_text (stmt, 1),
+                           "latitude",    sqlite3_column_double (stmt, 16),
+                           "longitude",   sqlite3_column_double (stmt, 15),
+                           NULL);
+
+  feature = g_object_new (ATREBAS_TYPE_FEATURE,
+                          "nld-id",      sqlite3_column_text (stmt, 0),
+                          "name",        sqlite3_column_text (stmt, 1),
+                          "name_fr",     sqlite3_column_text (stmt, 2),
+                          "uri",         sqlite3_column_text (stmt, 3),
+                          "uri_fr",      sqlite3_column_text (stmt, 4),
+                          "color",       sqlite3_column_text (stmt, 5),
+                          "geometry",    geometry,
+                          "slug",        sqlite3_column_text (stmt, 7),
+                          "theme",       sqlite3_column_int (stmt, 8),
+                          "area",        sqlite3_column_double (stmt, 13),
+                          "n-vertices",  (unsigned int)sqlite3_column_int (stmt, 14),
+                          "location",    location,
+                          NULL);
+
+  return atrebas_backend_intern (self, feature, epoch);
+}
+
+static inline AtrebasFeature *
+atrebas_backend_summary_from_row (AtrebasBackend *self,
+                                  sqlite3_stmt   *stmt,
+                                  unsigned int    epoch)
+{
+  g_autoptr (GeocodeBoundingBox) bounds = NULL;
+  g_autoptr (GeocodeLocation) location = NULL;
+  AtrebasFeature *feature;
+  double min_x, max_x, min_y, max_y;
+
+  feature = atrebas_backend_intern_lookup (self, (const char *)sqlite3_column_text (stmt, 0));
+
+  if (feature != NULL)
+    return feature;
+
+  /* The geometry is left for atrebas_backend_load_geometry() */
+  min_x = sqlite3_column_double (stmt, 8);
+  max_x = sqlite3_column_double (stmt, 9);
+  min_y = sqlite3_column_double (stmt, 10);
+  max_y = sqlite3_column_double (stmt, 11);
+
+  /* The extents wrap across the antimeridian as stored, with the western
+   * edge greater than the eastern; see #AtrebasFeature. The location is the
+   * label point, which is inside the feature. */
+  bounds = geocode_bounding_box_new (max_y, min_y, min_x, max_x);
+  location = g_object_new (GEOCODE_TYPE_LOCATION,
+                           "description", sqlite3_column_text (stmt, 1),
+                           "latitude",    sqlite3_column_double (stmt, 15),
+                           "longitude",   sqlite3_column_double (stmt, 14),
+                           NULL);
+
+  feature = g_object_new (ATREBAS_TYPE_FEATURE,
+                          "nld-id",       sqlite3_column_text (stmt, 0),
+                          "name",         sqlite3_column_text (stmt, 1),
+                          "name_fr",      sqlite3_column_text (stmt, 2),
+                          "uri",          sqlite3_column_text (stmt, 3),
+                          "uri_fr",       sqlite3_column_text (stmt, 4),
+                          "color",        sqlite3_column_text (stmt, 5),
+                          "slug",         sqlite3_column_text (stmt, 6),
+                          "theme",        sqlite3_column_int (stmt, 7),
+                          "area",         sqlite3_column_double (stmt, 12),
+                          "n-vertices",   (unsigned int)sqlite3_column_int (stmt, 13),
+                          "bounding-box", bounds,
+                          "location",     location,
+                          NULL);
+
+  return atrebas_backend_intern (self, feature, epoch);
+}
+
+static inline AtrebasFeature *
+atrebas_backend_get_feature_step (AtrebasBackend  *self,
+                                  sqlite3_stmt    *stmt,
+                                  unsigned int     epoch,
+                                  GError         **error)
+{
+  int rc;
+
+  g_assert (stmt != NULL);
+  g_assert (error == NULL || *error == NULL);
+
+  if ((rc = sqlite3_step (stmt)) == SQLITE_DONE)
+    return NULL;
+
+  if (rc != SQLITE_ROW)
+    {
+      step_set_error (error, G_STRFUNC, rc);
+      return NULL;
+    }
+
+  return atrebas_backend_summary_from_row (self, stmt, epoch);
+}
+
+static inline GBytes *
+atrebas_backend_get_geometry_step (sqlite3_stmt  *stmt,
+                                   GError       **error)
+{
+  const guint8 *data;
+  size_t size;
+  int rc;
+
+  g_assert (stmt != NULL);
+  g_assert (error == NULL || *error == NULL);
+
+  if ((rc = sqlite3_step (stmt)) == SQLITE_DONE)
+    return NULL;
+
+  if (rc != SQLITE_ROW)
+    {
+      step_set_error (error, G_STRFUNC, rc);
+      return NULL;
+    }
+
+  data = sqlite3_column_blob (stmt, 0);
+  size = sqlite3_column_bytes (stmt, 0);
+
+  if (!atrebas_geometry_validate (data, size))
+    return NULL;
+
+  return g_bytes_new (data, size);
+}
+
+/*
+ * The Hilbert key of a position, over a 2^16 grid of longitude and latitude,
+ * shifted to leave room for features with the same key in the low bits.
+ */
+#define HILBERT_ORDER     16
+#define HILBERT_SLOT_BITS 16
+
+static inline gint64
+hilbert_key (double longitude,
+             double latitude)
+{
+  const guint32 n = 1 << HILBERT_ORDER;
+  double fx = (longitude + 180.0) / 360.0 * n;
+  double fy = (latitude + 90.0) / 180.0 * n;
+  guint32 x = (fx > 0) ? (guint32)MIN (fx, n - 1) : 0;
+  guint32 y = (fy > 0) ? (guint32)MIN (fy, n - 1) : 0;
+  guint64 d = 0;
+
+  for (guint32 s = n / 2; s > 0; s /= 2)
+    {
+      guint32 rx = (x & s) > 0;
+      guint32 ry = (y & s) > 0;
+
+      d += (guint64)s * s * ((3 * rx) ^ ry);
+
+      /* Rotate the quadrant, so the curve is continuous */
+      if (ry == 0)
+        {
+          guint32 t;
+
+          if (rx == 1)
+            {
+              x = n - 1 - x;
+              y = n - 1 - y;
+            }
+
+          t = x;
+          x = y;
+          y = t;
+        }
+    }
+
+  return (gint64)(d << HILBERT_SLOT_BITS);
+}
+
+static inline gboolean
+atrebas_backend_remove_feature_step (sqlite3_stmt   *stmt,
+                                     FeatureRecord  *record,
+                                     GError        **error)
+{
+  int rc;
+
+  sqlite3_bind_text (stmt, 1, record->id, -1, NULL);
+
+  if ((rc = sqlite3_step (stmt)) != SQLITE_DONE)
+    {
+      step_set_error (error, G_STRFUNC, rc);
+      sqlite3_reset (stmt);
+      return FALSE;
+    }
+
+  sqlite3_reset (stmt);
+  return TRUE;
+}
+
+/*
+ * Derive the attributes that take a pass over the vertices once, here, so
+ * that features can be constructed from a row without one.
+ */
+static inline void
+feature_record_derive (FeatureRecord *record)
+{
+  const guint8 *packed_data;
+  double center_x, center_y;
+
+  packed_data = g_bytes_get_data (record->geometry, NULL);
+  atrebas_geometry_get_bounds (packed_data,
+                               &record->min_x, &record->max_x,
+                               &record->min_y, &record->max_y);
+  atrebas_geometry_get_center (packed_data, &center_x, &center_y);
+  atrebas_geometry_get_label_point (packed_data,
+                                    &record->label_x, &record->label_y);
+  record->area = atrebas_geometry_get_area (packed_data);
+  record->n_vertices = atrebas_geometry_get_n_vertices (packed_data);
+  record->key = hilbert_key (center_x, center_y);
+}
+
+/*
+ * Bind @record to @stmt, which is either ADD_FEATURE_SQL with the new @rowid
+ * or UPDATE_FEATURE_SQL with the Hilbert key of @record, and execute it.
+ */
+static inline gboolean
+atrebas_backend_set_feature_step (sqlite3_stmt     *stmt,
+                                  FeatureRecord    *record,
+                                  AtrebasMapTheme   theme,
+                                  gint64            rowid,
+                                  GError          **error)
+{
+  int rc;
+  const guint8 *packed_data;
+  size_t packed_size;
+
+  packed_data = g_bytes_get_data (record->geometry, &packed_size);
+
+  /* Bind the message data */
+  sqlite3_bind_text (stmt, 1, record->id, -1, NULL);
+  sqlite3_bind_text (stmt, 2, record->name, -1, NULL);
+  sqlite3_bind_text (stmt, 3, record->name_fr, -1, NULL);
+  sqlite3_bind_text (stmt, 4, record->uri, -1, NULL);
+  sqlite3_bind_text (stmt, 5, record->uri_fr, -1, NULL);
+  sqlite3_bind_text (stmt, 6, record->color, -1, NULL);
+  sqlite3_bind_blob (stmt, 7, packed_data, packed_size, NULL);
+  sqlite3_bind_text (stmt, 8, record->slug, -1, NULL);
+  sqlite3_bind_int (stmt, 9, theme);
+  sqlite3_bind_double (stmt, 10, record->min_x);
+  sqlite3_bind_double (stmt, 11, record->max_x);
+  sqlite3_bind_double (stmt, 12, record->min_y);
+  sqlite3_bind_double (stmt, 13, record->max_y);
+  sqlite3_bind_double (stmt, 14, record->area);
+  sqlite3_bind_int (stmt, 15, record->n_vertices);
+  sqlite3_bind_double (stmt, 16, record->label_x);
+  sqlite3_bind_double (stmt, 17, record->label_y);
+  sqlite3_bind_int64 (stmt, 18, rowid);
+
+  /* Execute and auto-reset */
+  if ((rc = sqlite3_step (stmt)) != SQLITE_DONE)
+    {
+      step_set_error (error, G_STRFUNC, rc);
+      sqlite3_reset (stmt);
+      return FALSE;
+    }
+
+  sqlite3_reset (stmt);
+  return TRUE;
+}
+
+static inline gboolean
+atrebas_backend_get_feature_slot_step (sqlite3_stmt   *stmt,
+                                       FeatureRecord  *record,
+                                       gint64         *rowid,
+                                       GError        **error)
+{
+  int rc;
+
+  sqlite3_bind_int64 (stmt, 1, record->key);
+
+  if ((rc = sqlite3_step (stmt)) != SQLITE_ROW)
+    {
+      step_set_error (error, G_STRFUNC, rc);
+      sqlite3_reset (stmt);
+      return FALSE;
+    }
+
+  *rowid = sqlite3_column_int64 (stmt, 0);
+  sqlite3_reset (stmt);
+
+  /* Spilling into the range of the next key would break the order */
+  if (*rowid - record->key >= (1 << HILBERT_SLOT_BITS))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NO_SPACE,
+                   "%s: No free slot for feature %s",
+                   G_STRFUNC, record->id);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static inline gboolean
+atrebas_backend_feature_changed_step (sqlite3_stmt   *stmt,
+                                      FeatureRecord  *record,
+                                      gboolean       *changed,
+                                      GError        **error)
+{
+  int rc;
+
+  sqlite3_bind_text (stmt, 1, record->id, -1, NULL);
+
+  if ((rc = sqlite3_step (stmt)) == SQLITE_ROW)
+    *changed = (sqlite3_column_int64 (stmt, 0) != record->hash);
+  else if (rc == SQLITE_DONE)
+    *changed = TRUE;
+  else
+    {
+      step_set_error (error, G_STRFUNC, rc);
+      sqlite3_reset (stmt);
+      return FALSE;
+    }
+
+  sqlite3_reset (stmt);
+  return TRUE;
+}
+
+static inline gboolean
+atrebas_backend_set_feature_state_step (sqlite3_stmt     *stmt,
+                                        FeatureRecord    *record,
+                                        const char       *source,
+                                        gint64            generation,
+                                        GError          **error)
+{
+  int rc;
+
+  sqlite3_bind_text (stmt, 1, record->id, -1, NULL);
+  sqlite3_bind_text (stmt, 2, source, -1, NULL);
+  sqlite3_bind_int64 (stmt, 3, record->hash);
+  sqlite3_bind_int64 (stmt, 4, generation);
+
+  if ((rc = sqlite3_step (stmt)) != SQLITE_DONE)
+    {
+      step_set_error (error, G_STRFUNC, rc);
+      sqlite3_reset (stmt);
+      return FALSE;
+    }
+
+  sqlite3_reset (stmt);
+  return TRUE;
+}
+
+static inline gboolean
+atrebas_backend_set_feature_cover_step (sqlite3_stmt   *stmt,
+                                        FeatureRecord  *record,
+                                        GError        **error)
+{
+  g_autoptr (GBytes) cover = NULL;
+  const guint8 *cover_data;
+  size_t cover_size;
+  int rc;
+
+  cover = atrebas_geometry_cover (g_bytes_get_data (record->geometry, NULL));
+  cover_data = g_bytes_get_data (cover, &cover_size);
+
+  sqlite3_bind_text (stmt, 1, record->id, -1, NULL);
+  sqlite3_bind_blob (stmt, 2, cover_data, cover_size, NULL);
+
+  if ((rc = sqlite3_step (stmt)) != SQLITE_DONE)
+    {
+      step_set_error (error, G_STRFUNC, rc);
+      sqlite3_reset (stmt);
+      return FALSE;
+    }
+
+  sqlite3_reset (stmt);
+  return TRUE;
+}
+
+static inline gboolean
+atrebas_backend_locate_cover_step (sqlite3_stmt           *stmt,
+                                   gint64                  rowid,
+                                   BackendQuery           *query,
+                                   AtrebasGeometryRegion  *region,
+                                   GError                **error)
+{
+  int rc;
+
+  sqlite3_bind_int64 (stmt, 1, rowid);
+
+  /* Without a valid covering, the point is tested against the geometry */
+  *region = ATREBAS_GEOMETRY_REGION_BOUNDARY;
+
+  if ((rc = sqlite3_step (stmt)) == SQLITE_ROW)
+    {
+      const guint8 *cover = sqlite3_column_blob (stmt, 0);
+      size_t size = sqlite3_column_bytes (stmt, 0);
+
+      if (atrebas_geometry_cover_validate (cover, size))
+        *region = atrebas_geometry_cover_locate (cover,
+                                                 query->longitude,
+                                                 query->latitude);
+    }
+  else if (rc != SQLITE_DONE)
+    {
+      step_set_error (error, G_STRFUNC, rc);
+      sqlite3_reset (stmt);
+      return FALSE;
+    }
+
+  sqlite3_reset (stmt);
+  return TRUE;
+}
+
+static inline gboolean
+atrebas_backend_locate_feature_step (AtrebasBackend  *self,
+                                     sqlite3_stmt    *stmt,
+                                     BackendQuery    *query,
+                                     gboolean         inside,
+                                     unsigned int     epoch,
+                                     AtrebasFeature **feature,
+                                     GError         **error)
+{
+  int rc;
+  const guint8 *geometry;
+  size_t size;
+
+  g_assert (stmt != NULL);
+  g_assert (error == NULL || *error == NULL);
+
+  if ((rc = sqlite3_step (stmt)) == SQLITE_DONE)
+    return FALSE;
+
+  if (rc != SQLITE_ROW)
+    {
+      step_set_error (error, G_STRFUNC, rc);
+      return FALSE;
+    }
+
+  /* Test the point against the packed column in place, unless the covering
+   * already placed it inside */
+  geometry = sqlite3_column_blob (stmt, 6);
+  size = sqlite3_column_bytes (stmt, 6);
+
+  if (!atrebas_geometry_validate (geometry, size) ||
+      (!inside && !atrebas_geometry_contains_point (geometry,
+                                                    query->longitude,
+                                                    query->latitude)))
+    {
+      *feature = NULL;
+      return TRUE;
+    }
+
+  *feature = atrebas_backend_feature_from_row (self, stmt, epoch);
+
+  return TRUE;
+}
+
+
+/*
+ * Database GTaskFuncs
+ */
+static void
+atrebas_backend_lookup_task (GTask        *task,
+                         gpointer      source_object,
+                         gpointer      task_data,
+                         GCancellable *cancellable)
+{
+  AtrebasBackend *self = ATREBAS_BACKEND (source_object);
+  const char *id = task_data;
+  sqlite3_stmt *stmt = atrebas_backend_get_statement (self, STMT_GET_FEATURE);
+  g_autoptr (AtrebasFeature) ret = NULL;
+  unsigned int epoch;
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  /* Collect the results */
+  epoch = atrebas_backend_intern_epoch (self);
+  sqlite3_bind_text (stmt, 1, id, -1, NULL);
+  ret = atrebas_backend_get_feature_step (self, stmt, epoch, &error);
+  sqlite3_reset (stmt);
+
+  if (error != NULL)
+    return g_task_return_error (task, error);
+
+  g_task_return_pointer (task, g_steal_pointer (&ret), g_object_unref);
+}
+
+static void
+atrebas_backend_load_geometry_task (GTask        *task,
+                                    gpointer      source_object,
+                                    gpointer      task_data,
+                                    GCancellable *cancellable)
+{
+  AtrebasBackend *self = ATREBAS_BACKEND (source_object);
+  AtrebasFeature *feature = ATREBAS_FEATURE (task_data);
+  sqlite3_stmt *stmt = atrebas_backend_get_statement (self, STMT_GET_GEOMETRY);
+  GBytes *geometry = NULL;
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  sqlite3_bind_text (stmt, 1, atrebas_feature_get_nld_id (feature), -1, NULL);
+  geometry = atrebas_backend_get_geometry_step (stmt, &error);
+  sqlite3_reset (stmt);
+
+  if (error != NULL)
+    return g_task_return_error (task, error);
+
+  if (geometry == NULL)
+    {
+      return g_task_return_new_error (task,
+                                      GEOCODE_ERROR,
+                                      GEOCODE_ERROR_NO_MATCHES,
+                                      "No geometry for \"%s\"",
+                                      atrebas_feature_get_nld_id (feature));
+    }
+
+  /* Another caller may have loaded it first, so return whichever won */
+  atrebas_feature_take_geometry (feature, geometry);
+  g_task_return_pointer (task,
+                         g_bytes_ref (atrebas_feature_get_geometry (feature)),
+                         (GDestroyNotify)g_bytes_unref);
+}
+
+
+/*
+ * GeocodeBackend GTaskFuncs
+ */
+static inline void
+_place_list_free (gpointer data)
+{
+  g_list_free_full ((GList *)data, g_object_unref);
+}
+
+static void
+atrebas_backend_forward_search_task (GTask        *task,
+                                 gpointer      source_object,
+                                 gpointer      task_data,
+                                 GCancellable *cancellable)
+{
+  AtrebasBackend *self = ATREBAS_BACKEND (source_object);
+  BackendQuery *query = task_data;
+  sqlite3_stmt *stmt = NULL;
+  g_autolist (AtrebasFeature) ret = NULL;
+  g_autofree char *query_param = NULL;
+  AtrebasFeature *feature = NULL;
+  unsigned int epoch;
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  if ((query_param = backend_query_match (query->location)) == NULL)
+    {
+      g_task_return_new_error (task,
+                               GEOCODE_ERROR,
+                               GEOCODE_ERROR_NO_MATCHES,
+                               "No matches found for request");
+      return;
+    }
+
+  /* Collect the results, filtered and ranked by SQLite */
+  if (query->bounded)
+    {
+      stmt = atrebas_backend_get_statement (self, STMT_BOUNDED_SEARCH_FEATURES);
+      sqlite3_bind_double (stmt, 4, query->viewbox.right);
+      sqlite3_bind_double (stmt, 5, query->viewbox.left);
+      sqlite3_bind_double (stmt, 6, query->viewbox.top);
+      sqlite3_bind_double (stmt, 7, query->viewbox.bottom);
+    }
+  else
+    {
+      stmt = atrebas_backend_get_statement (self, STMT_SEARCH_FEATURES);
+    }
+
+  sqlite3_bind_text (stmt, 1, query_param, -1, NULL);
+  sqlite3_bind_int (stmt, 2, query->limit);
+  sqlite3_bind_text (stmt, 3, query->location, -1, NULL);
+
+  epoch = atrebas_backend_intern_epoch (self);
+  while ((feature = atrebas_backend_get_feature_step (self, stmt, epoch, &error)) != NULL)
+    ret = g_list_prepend (ret, feature);
+  sqlite3_reset (stmt);
+
+  /* If the deadline expired, return any results found so far */
+  if (error != NULL)
+    {
+      if (!backend_query_timed_out (query, cancellable, &error) || ret == NULL)
+        return g_task_return_error (task, error);
+
+      g_clear_error (&error);
+    }
+
+  if (ret == NULL)
+    {
+      g_task_return_new_error (task,
+                               GEOCODE_ERROR,
+                               GEOCODE_ERROR_NO_MATCHES,
+                               "No matches found for request");
+      return;
+    }
+
+  ret = g_list_reverse (ret);
+  g_task_return_pointer (task, g_steal_pointer (&ret), _place_list_free);
+}
+
+static void
+atrebas_backend_reverse_resolve_task (GTask        *task,
+                                  gpointer      source_object,
+                                  gpointer      task_data,
+                                  GCancellable *cancellable)
+{
+  AtrebasBackend *self = ATREBAS_BACKEND (source_object);
+  BackendQuery *query = task_data;
+  sqlite3_stmt *stmt = NULL;
+  g_autolist (AtrebasFeature) ret = NULL;
+  AtrebasFeature *feature = NULL;
+  unsigned int epoch;
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  /* Collect the results, from the candidates if the index was available */
+  epoch = atrebas_backend_intern_epoch (self);
+
+  if (query->candidates != NULL)
+    {
+      sqlite3_stmt *cover_stmt;
+
+      stmt = atrebas_backend_get_statement (self, STMT_GET_FEATURE_ROW);
+      cover_stmt = atrebas_backend_get_statement (self, STMT_GET_FEATURE_COVER);
+
+      for (unsigned int i = 0; i < query->candidates->len && error == NULL; i++)
+        {
+          gint64 rowid = g_array_index (query->candidates, gint64, i);
+          AtrebasGeometryRegion region;
+
+          /* Candidates the covering places outside are never read */
+          if (!atrebas_backend_locate_cover_step (cover_stmt, rowid, query,
+                                                  &region, &error) ||
+              region == ATREBAS_GEOMETRY_REGION_OUTSIDE)
+            continue;
+
+          sqlite3_bind_int64 (stmt, 1, rowid);
+
+          if (atrebas_backend_locate_feature_step (self, stmt, query,
+                                                   region == ATREBAS_GEOMETRY_REGION_INSIDE,
+                                                   epoch, &feature, &error) &&
+              feature != NULL)
+            ret = g_list_prepend (ret, feature);
+          sqlite3_reset (stmt);
+        }
+    }
+  else
+    {
+      stmt = atrebas_backend_get_statement (self, STMT_LOCATE_FEATURES);
+      sqlite3_bind_double (stmt, 1, query->longitude);
+      sqlite3_bind_double (stmt, 2, query->latitude);
+
+      while (atrebas_backend_locate_feature_step (self, stmt, query, FALSE, epoch, &feature, &error))
+        {
+          if (feature != NULL)
+            ret = g_list_prepend (ret, feature);
+        }
+      sqlite3_reset (stmt);
+    }
+
+  /* If the deadline expired, return any results found so far */
+  if (error != NULL)
+    {
+      if (!backend_query_timed_out (query, cancellable, &error) || ret == NULL)
+        return g_task_return_error (task, error);
+
+      g_clear_error (&error);
+    }
+
+  if (ret == NULL)
+    {
+      g_task_return_new_error (task,
+                               GEOCODE_ERROR,
+                               GEOCODE_ERROR_NO_MATCHES,
+                               "No matches found for request");
+      return;
+    }
+
+  ret = g_list_reverse (ret);
+  g_task_return_pointer (task, g_steal_pointer (&ret), _place_list_free);
+}
+
+
+/*
+ * Spatial Index
+ *
+ * The extents of every feature are kept in a packed R-tree in memory, so
+ * reverse resolving a point outside every feature doesn't need a database
+ * query, and a point inside only needs the candidates by rowid.
+ *
+ * The index is rebuilt by the writer after the database is opened and after
+ * each source is committed, then swapped in under a lock. An index is
+ * immutable and replaced whole, so a search takes a reference under the lock
+ * and uses it without locking, and an index is freed when the last search
+ * using it is done.
+ *
+ * Each commit advances a serial, and each index records the serial it was
+ * built for. Until the index for the latest commit is published, a point
+ * outside every indexed feature may still be inside a new one, and a point
+ * inside may be in a feature that has moved or been removed, so searches fall
+ * back to the database query.
+ */
+static void
+atrebas_backend_publish_index (AtrebasBackend      *self,
+                               AtrebasSpatialIndex *index,
+                               unsigned int         serial)
+{
+  AtrebasSpatialIndex *old_index;
+
+  g_mutex_lock (&self->index_lock);
+  old_index = self->index;
+  self->index = index;
+  self->index_published = serial;
+  g_mutex_unlock (&self->index_lock);
+
+  g_clear_pointer (&old_index, atrebas_spatial_index_unref);
+}
+
+static void
+atrebas_backend_refresh_index (AtrebasBackend *self)
+{
+  g_autoptr (AtrebasSpatialIndexBuilder) builder = NULL;
+  sqlite3_stmt *stmt = self->stmts[STMT_GET_EXTENTS];
+  unsigned int serial;
+  int rc;
+
+  g_assert (ATREBAS_IS_BACKEND (self));
+
+  serial = (unsigned int)g_atomic_int_get (&self->index_serial);
+  builder = atrebas_spatial_index_builder_new ();
+
+  while ((rc = sqlite3_step (stmt)) == SQLITE_ROW)
+    {
+      gint64 rowid = sqlite3_column_int64 (stmt, 0);
+      double min_x = sqlite3_column_double (stmt, 1);
+      double max_x = sqlite3_column_double (stmt, 2);
+      double min_y = sqlite3_column_double (stmt, 3);
+      double max_y = sqlite3_column_double (stmt, 4);
+
+      /* Extents across the antimeridian are indexed as one box on each side,
+       * rather than one box spanning the globe */
+      if (min_x > max_x)
+        {
+          atrebas_spatial_index_builder_add (builder, rowid,
+                                             -180.0, max_x, min_y, max_y);
+          max_x = 180.0;
+        }
+
+      atrebas_spatial_index_builder_add (builder, rowid,
+                                         min_x, max_x, min_y, max_y);
+    }
+  sqlite3_reset (stmt);
+
+  /* Keep the current index, rather than publish an incomplete one */
+  if (rc != SQLITE_DONE)
+    {
+      g_debug ("%s: [%i] %s", G_STRFUNC, rc, sqlite3_errstr (rc));
+      return;
+    }
+
+  atrebas_backend_publish_index (self,
+                                 atrebas_spatial_index_builder_end (builder),
+                                 serial);
+}
+
+static int
+rowid_compare (gconstpointer a,
+               gconstpointer b)
+{
+  gint64 rowid1 = *(const gint64 *)a;
+  gint64 rowid2 = *(const gint64 *)b;
+
+  return (rowid1 > rowid2) - (rowid1 < rowid2);
+}
+
+/*
+ * Collect the candidates for @query from the resident index. Returns %FALSE
+ * if there are none, or %TRUE if there may be matches. If the index is missing
+ * or stale, the candidates are left unset so the database is queried instead.
+ */
+static gboolean
+atrebas_backend_index_search (AtrebasBackend *self,
+                              BackendQuery   *query)
+{
+  g_autoptr (AtrebasSpatialIndex) index = NULL;
+  unsigned int published = 0;
+  unsigned int n_found = 0;
+  unsigned int n_unique = 0;
+
+  /* Hold a reference, in case a new index is published during the search */
+  g_mutex_lock (&self->index_lock);
+  if (self->index != NULL)
+    index = atrebas_spatial_index_ref (self->index);
+  published = self->index_published;
+  g_mutex_unlock (&self->index_lock);
+
+  /* A commit since the index was built may have added or moved a match, so
+   * the candidates can't be trusted either way */
+  if (index == NULL ||
+      published != (unsigned int)g_atomic_int_get (&self->index_serial))
+    return TRUE;
+
+  query->candidates = g_array_new (FALSE, FALSE, sizeof (gint64));
+  n_found = atrebas_spatial_index_search (index,
+                                          query->longitude,
+                                          query->latitude,
+                                          query->longitude,
+                                          query->latitude,
+                                          query->candidates);
+
+  if (n_found == 0)
+    return FALSE;
+
+  /* Rows are stored in Hilbert order, so read neighbouring pages together */
+  g_array_sort (query->candidates, rowid_compare);
+
+  /* A feature across the antimeridian has an entry on each side */
+  for (unsigned int i = 0; i < query->candidates->len; i++)
+    {
+      gint64 rowid = g_array_index (query->candidates, gint64, i);
+
+      if (n_unique == 0 ||
+          g_array_index (query->candidates, gint64, n_unique - 1) != rowid)
+        g_array_index (query->candidates, gint64, n_unique++) = rowid;
+    }
+  g_array_set_size (query->candidates, n_unique);
+
+  return TRUE;
+}
+
+
+/*
+ * Database Update GTaskFuncs
+ */
+typedef struct
+{
+  AtrebasBackend  *backend;
+  AtrebasMapTheme  theme;
+  unsigned int     n_features;
+} ProgressClosure;
+
+static gboolean
+atrebas_backend_progress_idle (gpointer data)
+{
+  ProgressClosure *closure = data;
+
+  g_signal_emit (G_OBJECT (closure->backend),
+                 signals [PROGRESS], 0,
+                 closure->theme,
+                 closure->n_features);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+progress_closure_free (gpointer data)
+{
+  ProgressClosure *closure = data;
+
+  g_clear_object (&closure->backend);
+  g_free (closure);
+}
+
+static void
+atrebas_backend_progress (AtrebasBackend  *self,
+                          GTask           *task,
+                          AtrebasMapTheme  theme,
+                          unsigned int     n_features)
+{
+  ProgressClosure *closure;
+
+  g_assert (ATREBAS_IS_BACKEND (self));
+  g_assert (G_IS_TASK (task));
+
+  closure = g_new0 (ProgressClosure, 1);
+  closure->backend = g_object_ref (self);
+  closure->theme = theme;
+  closure->n_features = n_features;
+
+  g_main_context_invoke_full (g_task_get_context (task),
+                              G_PRIORITY_DEFAULT,
+                              atrebas_backend_progress_idle,
+                              closure,
+                              progress_closure_free);
+}
+
+static inline gboolean
+atrebas_backend_exec (AtrebasBackend  *self,
+                      const char      *sql,
+                      GError         **error)
+{
+  int rc;
+
+  if ((rc = sqlite3_exec (self->connection, sql, NULL, NULL, NULL)) != SQLITE_OK)
+    {
+      g_set_error (error,
+                   GEOCODE_ERROR,
+                   GEOCODE_ERROR_INTERNAL_SERVER,
+                   "sqlite3_exec(): \"%s\": [%i] %s",
+                   sql, rc, sqlite3_errmsg (self->connection));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/*
+ * Import Pipeline
+ *
+ * Each source is downloaded and parsed in its own thread, which pushes a
+ * FeatureRecord for each valid feature onto a queue, followed by a sentinel.
+ * The database thread is the only writer; it takes the sources in the order
+ * they start delivering features, committing each in a single transaction
+ * while the others continue to download into their queues.
+ *
+ * A queue holds at most IMPORT_HIGH_WATER records, after which the parser
+ * waits for the writer, so memory use doesn't grow with the size of a source.
+ *
+ * Remote sources are requested conditionally, using the validators from the
+ * last successful import. Features whose content hash is unchanged are only
+ * marked as seen in the current generation of their source; when a source is
+ * complete, any feature last imported from it and not seen in the current
+ * generation is removed.
  */
-static inline AtrebasFeature *
-atrebas_backend_get_feature_step (sqlite3_stmt  *stmt,
-                              GError       **error)
+static FeatureRecord end_of_source;
+
+typedef struct
 {
-  int rc;
-  g_autoptr (JsonNode) coordinates_node = NULL;
-  const char *coordinates;
+  char            *uri;
+  char            *source;
+  AtrebasMapTheme  theme;
+  GCancellable    *cancellable;
+  GAsyncQueue     *ready;
+  GAsyncQueue     *records;
+  GThread         *thread;
+  GError          *error;
+
+  /* Records queued and not yet taken by the writer */
+  GMutex           lock;
+  GCond            cond;
+  unsigned int     n_pending;
+
+  /* Conditional requests */
+  char            *etag;
+  char            *last_modified;
+  char            *new_etag;
+  char            *new_last_modified;
+
+  /* The IDs of features changed or removed by the import */
+  GPtrArray       *changed;
+
+  unsigned int     replace : 1;
+  unsigned int     not_modified : 1;
+  unsigned int     started : 1;
+} SourceImport;
 
-  g_assert (stmt != NULL);
-  g_assert (error == NULL || *error == NULL);
+static void
+source_import_free (gpointer data)
+{
+  SourceImport *import = data;
+  FeatureRecord *record;
 
-  if ((rc = sqlite3_step (stmt)) == SQLITE_DONE)
-    return NULL;
+  g_clear_pointer (&import->thread, g_thread_join);
 
-  if (rc != SQLITE_ROW)
+  while ((record = g_async_queue_try_pop (import->records)) != NULL)
     {
-      g_set_error (error,
-                   G_IO_ERROR,
-                   G_IO_ERROR_FAILED,
-                   "%s: %s", G_STRFUNC, sqlite3_errstr (rc));
-      return NULL;
+      if (record != &end_of_source)
+        feature_record_free (record);
     }
 
-  coordinates = (const char *)sqlite3_column_text (stmt, 6);
-  coordinates_node = json_from_string (coordinates, NULL);
+  g_clear_pointer (&import->uri, g_free);
+  g_clear_pointer (&import->source, g_free);
+  g_clear_object (&import->cancellable);
+  g_clear_pointer (&import->ready, g_async_queue_unref);
+  g_clear_pointer (&import->records, g_async_queue_unref);
+  g_clear_error (&import->error);
+  g_clear_pointer (&import->etag, g_free);
+  g_clear_pointer (&import->last_modified, g_free);
+  g_clear_pointer (&import->new_etag, g_free);
+  g_clear_pointer (&import->changed, g_ptr_array_unref);
+  g_clear_pointer (&import->new_last_modified, g_free);
+  g_mutex_clear (&import->lock);
+  g_cond_clear (&import->cond);
+  g_free (import);
+}
 
-  return g_object_new (ATREBAS_TYPE_FEATURE,
-                       "nld-id",      sqlite3_column_text (stmt, 0),
-                       "name",        sqlite3_column_text (stmt, 1),
-                       "name_fr",     sqlite3_column_text (stmt, 2),
-                       "uri",         sqlite3_column_text (stmt, 3),
-                       "uri_fr",      sqlite3_column_text (stmt, 4),
-                       "color",       sqlite3_column_text (stmt, 5),
-                       "coordinates", json_node_get_array (coordinates_node),
-                       "slug",        sqlite3_column_text (stmt, 7),
-                       "theme",       sqlite3_column_int (stmt, 8),
-                       NULL);
+static void
+source_import_cancelled_wake_cb (GCancellable *cancellable,
+                                 SourceImport *import)
+{
+  g_mutex_lock (&import->lock);
+  g_cond_broadcast (&import->cond);
+  g_mutex_unlock (&import->lock);
 }
 
-static inline gboolean
-atrebas_backend_set_feature_step (sqlite3_stmt  *stmt,
-                                  JsonObject    *feature,
-                                  GError       **error)
+static inline void
+source_import_push (SourceImport  *import,
+                    FeatureRecord *record)
 {
-  int rc;
-  JsonObject *props;
-  JsonObject *geometry;
-  JsonNode *coordinates_node;
-  const char *id;
-  const char *name;
-  const char *name_fr;
-  const char *uri;
-  const char *uri_fr;
-  const char *color;
-  const char *slug;
-  AtrebasMapTheme theme;
-  g_autofree char *coordinates = NULL;
-
-  /* Extract the map data */
-  id = json_object_get_string_member (feature, "id");
-
-  props = json_object_get_object_member (feature, "properties");
-  name = json_object_get_string_member_with_default (props,
-                                                     "Name",
-                                                     "Unknown");
-  name_fr = json_object_get_string_member_with_default (props,
-                                                        "FrenchName",
-                                                        name);
-  uri = json_object_get_string_member_with_default (props,
-                                                    "description",
-                                                    "https://native-land.ca");
-  uri_fr = json_object_get_string_member_with_default (props,
-                                                       "FrenchDescription",
-                                                       uri);
-  color = json_object_get_string_member_with_default (props,
-                                                      "color",
-                                                      "#000000");
-  slug = json_object_get_string_member_with_default (props,
-                                                     "Slug",
-                                                     "");
-  theme = json_object_get_int_member_with_default (props,
-                                                   "theme",
-                                                   ATREBAS_MAP_THEME_TERRITORY);
-
-  geometry = json_object_get_object_member (feature, "geometry");
-  coordinates_node = json_object_get_member (geometry, "coordinates");
-  coordinates = json_to_string (coordinates_node, FALSE);
+  /* Wait for the writer to catch up, unless the import was abandoned; the
+   * sentinel is never held back */
+  if (record != &end_of_source)
+    {
+      g_mutex_lock (&import->lock);
+      while (import->n_pending >= IMPORT_HIGH_WATER &&
+             !g_cancellable_is_cancelled (import->cancellable))
+        g_cond_wait (&import->cond, &import->lock);
+      import->n_pending++;
+      g_mutex_unlock (&import->lock);
+    }
 
-  /* Bind the message data */
-  sqlite3_bind_text (stmt, 1, id, -1, NULL);
-  sqlite3_bind_text (stmt, 2, name, -1, NULL);
-  sqlite3_bind_text (stmt, 3, name_fr, -1, NULL);
-  sqlite3_bind_text (stmt, 4, uri, -1, NULL);
-  sqlite3_bind_text (stmt, 5, uri_fr, -1, NULL);
-  sqlite3_bind_text (stmt, 6, color, -1, NULL);
-  sqlite3_bind_text (stmt, 7, coordinates, -1, NULL);
-  sqlite3_bind_text (stmt, 8, slug, -1, NULL);
-  sqlite3_bind_int (stmt, 9, theme);
+  g_async_queue_push (import->records, record);
 
-  /* Execute and auto-reset */
-  if ((rc = sqlite3_step (stmt)) != SQLITE_DONE)
+  /* Let the writer know this source is ready to be consumed */
+  if (!import->started)
     {
-      g_set_error (error,
-                   G_IO_ERROR,
-                   G_IO_ERROR_FAILED,
-                   "%s: %s", G_STRFUNC, sqlite3_errstr (rc));
-      sqlite3_reset (stmt);
-      return FALSE;
+      import->started = TRUE;
+      g_async_queue_push (import->ready, import);
     }
+}
 
-  sqlite3_reset (stmt);
-  return TRUE;
+static inline FeatureRecord *
+source_import_pop (SourceImport *import)
+{
+  FeatureRecord *record = g_async_queue_pop (import->records);
+
+  if (record != &end_of_source)
+    {
+      g_mutex_lock (&import->lock);
+      import->n_pending--;
+      g_cond_signal (&import->cond);
+      g_mutex_unlock (&import->lock);
+    }
+
+  return record;
 }
 
-static inline gboolean
-atrebas_backend_bounded_feature_step (sqlite3_stmt    *stmt,
-                                      BackendQuery    *query,
-                                      AtrebasFeature **feature,
-                                      GError         **error)
+static GInputStream *
+source_import_open (SourceImport  *import,
+                    SoupSession  **session,
+                    GError       **error)
 {
-  int rc;
-  const char *coordinates_text;
-  g_autoptr (JsonNode) coordinates_node = NULL;
-  JsonArray *coordinates_list = NULL;
+  g_autofree char *scheme = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (SoupMessage) message = NULL;
+  g_autoptr (GInputStream) stream = NULL;
+  SoupMessageHeaders *headers;
+  unsigned int status;
 
-  g_assert (stmt != NULL);
-  g_assert (error == NULL || *error == NULL);
+  scheme = g_uri_parse_scheme (import->uri);
 
-  if ((rc = sqlite3_step (stmt)) == SQLITE_DONE)
-    return FALSE;
+  if (g_strcmp0 (scheme, "http") != 0 && g_strcmp0 (scheme, "https") != 0)
+    {
+      if (scheme != NULL)
+        file = g_file_new_for_uri (import->uri);
+      else
+        file = g_file_new_for_path (import->uri);
 
-  if (rc != SQLITE_ROW)
+      return G_INPUT_STREAM (g_file_read (file, import->cancellable, error));
+    }
+
+  if ((message = soup_message_new ("GET", import->uri)) == NULL)
     {
       g_set_error (error,
                    G_IO_ERROR,
-                   G_IO_ERROR_FAILED,
-                   "%s: %s", G_STRFUNC, sqlite3_errstr (rc));
-      return FALSE;
+                   G_IO_ERROR_INVALID_ARGUMENT,
+                   "Invalid URI \"%s\"", import->uri);
+      return NULL;
     }
 
-  coordinates_text = (const char *)sqlite3_column_text (stmt, 6);
-  coordinates_node = json_from_string (coordinates_text, NULL);
-  coordinates_list = json_node_get_array (coordinates_node);
+  headers = soup_message_get_request_headers (message);
+
+  if (import->etag != NULL)
+    soup_message_headers_replace (headers, "If-None-Match", import->etag);
+
+  if (import->last_modified != NULL)
+    soup_message_headers_replace (headers, "If-Modified-Since", import->last_modified);
+
+  /* The session is private to this thread, and outlives the response */
+  *session = soup_session_new ();
+  stream = soup_session_send (*session, message, import->cancellable, error);
+
+  if (stream == NULL)
+    return NULL;
+
+  status = soup_message_get_status (message);
 
-  if (!geojson_intersect (coordinates_list,
-                          query->viewbox.left,
-                          query->viewbox.top,
-                          query->viewbox.right,
-                          query->viewbox.bottom))
+  if (status == SOUP_STATUS_NOT_MODIFIED)
     {
-      *feature = NULL;
-      return TRUE;
+      import->not_modified = TRUE;
+      return NULL;
     }
 
-  *feature = g_object_new (ATREBAS_TYPE_FEATURE,
-                           "nld-id",      sqlite3_column_text (stmt, 0),
-                           "name",        sqlite3_column_text (stmt, 1),
-                           "name_fr",     sqlite3_column_text (stmt, 2),
-                           "uri",         sqlite3_column_text (stmt, 3),
-                           "uri_fr",      sqlite3_column_text (stmt, 4),
-                           "color",       sqlite3_column_text (stmt, 5),
-                           "coordinates", json_node_get_array (coordinates_node),
-                           "slug",        sqlite3_column_text (stmt, 7),
-                           "theme",       sqlite3_column_int (stmt, 8),
-                           NULL);
+  if (!SOUP_STATUS_IS_SUCCESSFUL (status))
+    {
+      g_set_error (error,
+                   GEOCODE_ERROR,
+                   GEOCODE_ERROR_INTERNAL_SERVER,
+                   "%s: [%u] %s",
+                   import->uri, status, soup_message_get_reason_phrase (message));
+      return NULL;
+    }
 
-  return TRUE;
+  headers = soup_message_get_response_headers (message);
+  import->new_etag = g_strdup (soup_message_headers_get_one (headers, "ETag"));
+  import->new_last_modified = g_strdup (soup_message_headers_get_one (headers, "Last-Modified"));
+
+  return g_steal_pointer (&stream);
 }
 
-static inline gboolean
-atrebas_backend_locate_feature_step (sqlite3_stmt    *stmt,
-                                     BackendQuery    *query,
-                                     AtrebasFeature **feature,
-                                     GError         **error)
+static gpointer
+source_import_thread (gpointer data)
 {
-  int rc;
-  const char *coordinates_text;
-  g_autoptr (JsonNode) coordinates_node = NULL;
-  JsonArray *coordinates_list = NULL;
+  SourceImport *import = data;
+  g_autoptr (SoupSession) session = NULL;
+  g_autoptr (GInputStream) stream = NULL;
+  g_autoptr (AtrebasGeojsonReader) reader = NULL;
+  unsigned long handler_id;
 
-  g_assert (stmt != NULL);
-  g_assert (error == NULL || *error == NULL);
+  /* A full queue is abandoned by cancelling the import */
+  handler_id = g_cancellable_connect (import->cancellable,
+                                      G_CALLBACK (source_import_cancelled_wake_cb),
+                                      import,
+                                      NULL);
 
-  if ((rc = sqlite3_step (stmt)) == SQLITE_DONE)
-    return FALSE;
+  stream = source_import_open (import, &session, &import->error);
 
-  if (rc != SQLITE_ROW)
+  if (stream != NULL)
     {
-      g_set_error (error,
-                   G_IO_ERROR,
-                   G_IO_ERROR_FAILED,
-                   "%s: %s", G_STRFUNC, sqlite3_errstr (rc));
-      return FALSE;
-    }
+      reader = atrebas_geojson_reader_new (stream);
 
-  coordinates_text = (const char *)sqlite3_column_text (stmt, 6);
-  coordinates_node = json_from_string (coordinates_text, NULL);
-  coordinates_list = json_node_get_array (coordinates_node);
+      while (atrebas_geojson_reader_next (reader, import->cancellable, &import->error))
+        {
+          const char *type = atrebas_geojson_reader_get_geometry_type (reader);
+          FeatureRecord *record;
 
-  if (!geojson_pnpoly (coordinates_list, query->longitude, query->latitude))
-    {
-      *feature = NULL;
-      return TRUE;
+          // FIXME: support Point, LineString, ...
+          if (g_strcmp0 (type, "Polygon") != 0 && g_strcmp0 (type, "MultiPolygon") != 0)
+            continue;
+
+          /* Invalid features are skipped */
+          if ((record = feature_record_new (reader, import->theme)) == NULL)
+            {
+              g_warning ("Parsing feature at index %u: invalid coordinates for \"%s\"",
+                         atrebas_geojson_reader_get_index (reader),
+                         atrebas_geojson_reader_get_id (reader));
+              continue;
+            }
+
+          source_import_push (import, record);
+        }
     }
 
-  *feature = g_object_new (ATREBAS_TYPE_FEATURE,
-                           "nld-id",      sqlite3_column_text (stmt, 0),
-                           "name",        sqlite3_column_text (stmt, 1),
-                           "name_fr",     sqlite3_column_text (stmt, 2),
-                           "uri",         sqlite3_column_text (stmt, 3),
-                           "uri_fr",      sqlite3_column_text (stmt, 4),
-                           "color",       sqlite3_column_text (stmt, 5),
-                           "coordinates", json_node_get_array (coordinates_node),
-                           "slug",        sqlite3_column_text (stmt, 7),
-                           "theme",       sqlite3_column_int (stmt, 8),
-                           NULL);
+  g_cancellable_disconnect (import->cancellable, handler_id);
+  source_import_push (import, &end_of_source);
 
-  return TRUE;
+  return NULL;
 }
 
-
-/*
- * Database GTaskFuncs
- */
 static void
-atrebas_backend_lookup_task (GTask        *task,
-                         gpointer      source_object,
-                         gpointer      task_data,
-                         GCancellable *cancellable)
+source_import_cancelled_cb (GCancellable *task_cancellable,
+                            GCancellable *cancellable)
 {
-  AtrebasBackend *self = ATREBAS_BACKEND (source_object);
-  const char *id = task_data;
-  sqlite3_stmt *stmt = self->stmts[STMT_GET_FEATURE];
-  g_autoptr (AtrebasFeature) ret = NULL;
-  GError *error = NULL;
-
-  if (g_task_return_error_if_cancelled (task))
-    return;
+  g_cancellable_cancel (cancellable);
+}
 
-  /* Collect the results */
-  sqlite3_bind_text (stmt, 1, id, -1, NULL);
-  ret = atrebas_backend_get_feature_step (stmt, &error);
-  sqlite3_reset (stmt);
+static gboolean
+atrebas_backend_get_generation (AtrebasBackend   *self,
+                                const char       *source,
+                                gint64           *generation,
+                                GError          **error)
+{
+  sqlite3_stmt *stmt = self->stmts[STMT_NEXT_GENERATION];
+  int rc;
 
-  if (error != NULL)
-    return g_task_return_error (task, error);
+  sqlite3_bind_text (stmt, 1, source, -1, NULL);
 
-  g_task_return_pointer (task, g_steal_pointer (&ret), g_object_unref);
-}
+  if ((rc = sqlite3_step (stmt)) != SQLITE_ROW)
+    {
+      step_set_error (error, G_STRFUNC, rc);
+      sqlite3_reset (stmt);
+      return FALSE;
+    }
 
+  *generation = sqlite3_column_int64 (stmt, 0);
+  sqlite3_reset (stmt);
 
-/*
- * GeocodeBackend GTaskFuncs
- */
-static inline void
-_place_list_free (gpointer data)
-{
-  g_list_free_full ((GList *)data, g_object_unref);
+  return TRUE;
 }
 
-static void
-atrebas_backend_forward_search_task (GTask        *task,
-                                 gpointer      source_object,
-                                 gpointer      task_data,
-                                 GCancellable *cancellable)
+static gboolean
+atrebas_backend_remove_stale (AtrebasBackend   *self,
+                              const char       *source,
+                              gint64            generation,
+                              GPtrArray        *removed,
+                              GError          **error)
 {
-  AtrebasBackend *self = ATREBAS_BACKEND (source_object);
-  BackendQuery *query = task_data;
-  sqlite3_stmt *stmt = self->stmts[STMT_SEARCH_FEATURES];
-  g_autolist (AtrebasFeature) ret = NULL;
-  g_autofree char *query_param = NULL;
-  AtrebasFeature *feature = NULL;
-  GError *error = NULL;
+  sqlite3_stmt *stmt = self->stmts[STMT_GET_STALE_FEATURES];
+  int rc;
 
-  if (g_task_return_error_if_cancelled (task))
-    return;
+  /* Collect the IDs first, so their live features can be forgotten */
+  sqlite3_bind_text (stmt, 1, source, -1, NULL);
+  sqlite3_bind_int64 (stmt, 2, generation);
 
-  // NOTE: escaped percent signs (%%) are query wildcards (%)
-  query_param = g_strdup_printf ("%%%s%%", query->location);
-  sqlite3_bind_text (stmt, 1, query_param, -1, NULL);
-  sqlite3_bind_int (stmt, 2, query->limit);
+  while ((rc = sqlite3_step (stmt)) == SQLITE_ROW)
+    g_ptr_array_add (removed, g_strdup ((const char *)sqlite3_column_text (stmt, 0)));
 
-  /* Collect the results */
-  if (query->bounded)
+  if (rc != SQLITE_DONE)
     {
-      while (atrebas_backend_bounded_feature_step (stmt, query, &feature, &error))
-        {
-          if (feature != NULL)
-            ret = g_list_prepend (ret, feature);
-        }
+      step_set_error (error, G_STRFUNC, rc);
       sqlite3_reset (stmt);
+      return FALSE;
     }
-  else
+
+  sqlite3_reset (stmt);
+
+  stmt = self->stmts[STMT_REMOVE_STALE_FEATURES];
+  sqlite3_bind_text (stmt, 1, source, -1, NULL);
+  sqlite3_bind_int64 (stmt, 2, generation);
+
+  if ((rc = sqlite3_step (stmt)) != SQLITE_DONE)
     {
-      while ((feature = atrebas_backend_get_feature_step (stmt, &error)) != NULL)
-        ret = g_list_prepend (ret, feature);
+      step_set_error (error, G_STRFUNC, rc);
       sqlite3_reset (stmt);
+      return FALSE;
     }
 
-  if (error != NULL)
-    return g_task_return_error (task, error);
+  sqlite3_reset (stmt);
+  return TRUE;
+}
 
-  if (ret == NULL)
+static void
+atrebas_backend_get_source (AtrebasBackend *self,
+                            SourceImport   *import)
+{
+  sqlite3_stmt *stmt = self->stmts[STMT_GET_SOURCE];
+
+  sqlite3_bind_text (stmt, 1, import->uri, -1, NULL);
+
+  /* Without validators the source is simply downloaded again */
+  if (sqlite3_step (stmt) == SQLITE_ROW)
     {
-      g_task_return_new_error (task,
-                               GEOCODE_ERROR,
-                               GEOCODE_ERROR_NO_MATCHES,
-                               "No matches found for request");
-      return;
+      import->etag = g_strdup ((const char *)sqlite3_column_text (stmt, 0));
+      import->last_modified = g_strdup ((const char *)sqlite3_column_text (stmt, 1));
     }
 
-  ret = g_list_sort_with_data (ret, levenshtein_sort, (char *)query);
-  g_task_return_pointer (task, g_steal_pointer (&ret), _place_list_free);
+  sqlite3_reset (stmt);
 }
 
-static void
-atrebas_backend_reverse_resolve_task (GTask        *task,
-                                  gpointer      source_object,
-                                  gpointer      task_data,
-                                  GCancellable *cancellable)
+static gboolean
+atrebas_backend_set_source (AtrebasBackend  *self,
+                            SourceImport    *import,
+                            GError         **error)
 {
-  AtrebasBackend *self = ATREBAS_BACKEND (source_object);
-  BackendQuery *query = task_data;
-  sqlite3_stmt *stmt = self->stmts[STMT_GET_FEATURES];
-  g_autolist (AtrebasFeature) ret = NULL;
-  AtrebasFeature *feature = NULL;
-  GError *error = NULL;
+  sqlite3_stmt *stmt = self->stmts[STMT_SET_SOURCE];
+  int rc;
 
-  if (g_task_return_error_if_cancelled (task))
-    return;
+  sqlite3_bind_text (stmt, 1, import->uri, -1, NULL);
+  sqlite3_bind_text (stmt, 2, import->new_etag, -1, NULL);
+  sqlite3_bind_text (stmt, 3, import->new_last_modified, -1, NULL);
 
-  /* Collect the results */
-  while (atrebas_backend_locate_feature_step (stmt, query, &feature, &error))
+  if ((rc = sqlite3_step (stmt)) != SQLITE_DONE)
     {
-      if (feature != NULL)
-        ret = g_list_prepend (ret, feature);
+      step_set_error (error, G_STRFUNC, rc);
+      sqlite3_reset (stmt);
+      return FALSE;
     }
+
   sqlite3_reset (stmt);
+  return TRUE;
+}
 
-  if (error != NULL)
-    return g_task_return_error (task, error);
+static gboolean
+atrebas_backend_import_step (AtrebasBackend  *self,
+                             GTask           *task,
+                             SourceImport    *import,
+                             unsigned int    *n_loaded,
+                             GError         **error)
+{
+  FeatureRecord *record;
+  gint64 generation;
 
-  if (ret == NULL)
+  if (!atrebas_backend_get_generation (self, import->source, &generation, error))
+    return FALSE;
+
+  while ((record = source_import_pop (import)) != &end_of_source)
     {
-      g_task_return_new_error (task,
-                               GEOCODE_ERROR,
-                               GEOCODE_ERROR_NO_MATCHES,
-                               "No matches found for request");
-      return;
+      gboolean changed = TRUE;
+      gboolean ret;
+
+      /* Stop promptly, rather than draining the queue */
+      if (g_cancellable_set_error_if_cancelled (import->cancellable, error))
+        {
+          g_clear_pointer (&record, feature_record_free);
+          return FALSE;
+        }
+
+      /* Unchanged features are only marked as seen in this generation */
+      ret = atrebas_backend_feature_changed_step (self->stmts[STMT_GET_FEATURE_HASH],
+                                                  record,
+                                                  &changed,
+                                                  error);
+
+      /* A changed feature is updated in place if its Hilbert key is the same,
+       * so its rowid is stable; otherwise it's removed and inserted again, to
+       * move its row to the position of its geometry on the curve */
+      if (ret && changed)
+        {
+          gint64 rowid = 0;
+
+          feature_record_derive (record);
+          ret = atrebas_backend_set_feature_step (self->stmts[STMT_UPDATE_FEATURE],
+                                                  record,
+                                                  import->theme,
+                                                  record->key,
+                                                  error);
+
+          if (ret && sqlite3_changes (self->connection) == 0)
+            {
+              ret = atrebas_backend_remove_feature_step (self->stmts[STMT_REMOVE_FEATURE],
+                                                         record,
+                                                         error);
+
+              if (ret)
+                ret = atrebas_backend_get_feature_slot_step (self->stmts[STMT_GET_FEATURE_SLOT],
+                                                             record,
+                                                             &rowid,
+                                                             error);
+
+              if (ret)
+                ret = atrebas_backend_set_feature_step (self->stmts[STMT_ADD_FEATURE],
+                                                        record,
+                                                        import->theme,
+                                                        rowid,
+                                                        error);
+            }
+
+          /* The covering is only rebuilt for features that changed */
+          if (ret)
+            ret = atrebas_backend_set_feature_cover_step (self->stmts[STMT_SET_FEATURE_COVER],
+                                                          record,
+                                                          error);
+
+          if (ret)
+            g_ptr_array_add (import->changed, g_strdup (record->id));
+        }
+
+      if (ret)
+        ret = atrebas_backend_set_feature_state_step (self->stmts[STMT_SET_FEATURE_STATE],
+                                                      record,
+                                                      import->source,
+                                                      generation,
+                                                      error);
+
+      g_clear_pointer (&record, feature_record_free);
+
+      if (!ret)
+        return FALSE;
+
+      if (++(*n_loaded) % PROGRESS_INTERVAL == 0)
+        atrebas_backend_progress (self, task, import->theme, *n_loaded);
     }
 
-  ret = g_list_reverse (ret);
-  g_task_return_pointer (task, g_steal_pointer (&ret), _place_list_free);
-}
+  /* Errors from the download or parser are set before the sentinel */
+  if (import->error != NULL)
+    {
+      g_propagate_error (error, g_steal_pointer (&import->error));
+      return FALSE;
+    }
 
+  /* Features missing from a complete source were removed upstream */
+  if (import->replace &&
+      !atrebas_backend_remove_stale (self,
+                                     import->source,
+                                     generation,
+                                     import->changed,
+                                     error))
+    return FALSE;
+
+  if ((import->new_etag != NULL || import->new_last_modified != NULL) &&
+      !atrebas_backend_set_source (self, import, error))
+    return FALSE;
+
+  return TRUE;
+}
 
-/*
- * Database Update GTaskFuncs
- */
 static gboolean
-atrebas_backend_load_features (AtrebasBackend   *self,
-                           JsonNode     *node,
-                           AtrebasMapTheme   theme,
-                           GError      **error)
+atrebas_backend_import (AtrebasBackend  *self,
+                        GTask           *task,
+                        SourceImport    *import,
+                        GError         **error)
 {
-  sqlite3_stmt *stmt = self->stmts[STMT_ADD_FEATURE];
-  JsonArray *features;
-  unsigned int n_features = 0;
+  g_autoptr (GError) rollback_error = NULL;
+  unsigned int n_loaded = 0;
 
   g_assert (ATREBAS_IS_BACKEND (self));
+  g_assert (G_IS_TASK (task));
   g_assert (error == NULL || *error == NULL);
 
-
-  if (node == NULL || json_node_get_value_type (node) != JSON_TYPE_ARRAY)
+  /* The source is unchanged since the last import */
+  if (import->not_modified)
     {
-      g_set_error_literal (error,
-                           GEOCODE_ERROR,
-                           GEOCODE_ERROR_PARSE,
-                           "Unsupported GeoJSON fragment");
-      return FALSE;
+      g_debug ("%s: not modified", import->uri);
+      return TRUE;
     }
 
-  features = json_node_get_array (node);
-  n_features = json_array_get_length (features);
+  /* Load the whole source in a single transaction, so that a failure
+   * partway through leaves the database as it was */
+  if (!atrebas_backend_exec (self, "BEGIN IMMEDIATE;", error))
+    return FALSE;
 
-  for (unsigned int i = 0; i < n_features; i++)
+  if (atrebas_backend_import_step (self, task, import, &n_loaded, error) &&
+      atrebas_backend_exec (self, "COMMIT;", error))
     {
-      JsonObject *feature = json_array_get_object_element (features, i);
-      JsonObject *props, *geometry;
-      const char *geo_type = NULL;
-      g_autoptr (GError) warn = NULL;
-
-      // FIXME: support Polygon, MultiPolygon, Point, ...
-      geometry = json_object_get_object_member (feature, "geometry");
-      geo_type = json_object_get_string_member (geometry, "type");
-
-      if (geo_type == NULL || strcmp (geo_type, "Polygon") != 0)
-        continue;
-
-      props = json_object_get_object_member (feature, "properties");
-      json_object_set_int_member (props, "theme", theme);
-
-      if (!atrebas_backend_set_feature_step (stmt, feature, &warn))
-        g_warning ("Parsing feature: %s", warn->message);
+      /* Live features for changed and removed rows are now stale, and so is
+       * the index */
+      atrebas_backend_intern_forget (self, import->changed);
+      g_atomic_int_inc (&self->index_serial);
+      atrebas_backend_refresh_index (self);
+      atrebas_backend_progress (self, task, import->theme, n_loaded);
+      return TRUE;
     }
 
-  return TRUE;
+  /* An interrupted statement may have rolled back the transaction already */
+  if (!sqlite3_get_autocommit (self->connection) &&
+      !atrebas_backend_exec (self, "ROLLBACK;", &rollback_error))
+    g_warning ("%s: %s", G_STRFUNC, rollback_error->message);
+
+  return FALSE;
 }
 
 static gboolean
-atrebas_backend_load_geojson (AtrebasBackend   *self,
-                          JsonNode     *collection,
-                          AtrebasMapTheme   theme,
-                          GError      **error)
+atrebas_backend_import_sources (AtrebasBackend  *self,
+                                GTask           *task,
+                                MapSource      **sources,
+                                unsigned int     n_sources,
+                                gboolean         replace,
+                                GError         **error)
 {
-  JsonObject *object;
-  JsonNode *node;
+  GCancellable *task_cancellable = g_task_get_cancellable (task);
+  g_autoptr (GCancellable) cancellable = NULL;
+  g_autoptr (GAsyncQueue) ready = NULL;
+  g_autoptr (GPtrArray) imports = NULL;
+  unsigned long handler_id = 0;
+  gboolean ret = TRUE;
 
   g_assert (ATREBAS_IS_BACKEND (self));
-  g_assert (JSON_NODE_HOLDS_OBJECT (collection));
+  g_assert (G_IS_TASK (task));
   g_assert (error == NULL || *error == NULL);
 
-  object = json_node_get_object (collection);
+  cancellable = g_cancellable_new ();
+  ready = g_async_queue_new ();
+  imports = g_ptr_array_new_with_free_func (source_import_free);
+
+  if (task_cancellable != NULL)
+    handler_id = g_cancellable_connect (task_cancellable,
+                                        G_CALLBACK (source_import_cancelled_cb),
+                                        g_object_ref (cancellable),
+                                        g_object_unref);
 
-  if ((node = json_object_get_member (object, "type")) == NULL ||
-      json_node_get_value_type (node) != G_TYPE_STRING ||
-      g_strcmp0 (json_node_get_string (node), "FeatureCollection") != 0)
+  /* Start all the downloads at once */
+  for (unsigned int i = 0; i < n_sources; i++)
     {
-      g_set_error_literal (error,
-                           GEOCODE_ERROR,
-                           GEOCODE_ERROR_PARSE,
-                           "Unsupported GeoJSON file");
-      return FALSE;
+      SourceImport *import;
+
+      import = g_new0 (SourceImport, 1);
+      import->uri = g_strdup (sources[i]->uri);
+      import->source = g_strdup (sources[i]->source);
+      import->theme = sources[i]->theme;
+      import->cancellable = g_object_ref (cancellable);
+      import->ready = g_async_queue_ref (ready);
+      import->records = g_async_queue_new ();
+      g_mutex_init (&import->lock);
+      g_cond_init (&import->cond);
+      import->changed = g_ptr_array_new_with_free_func (g_free);
+      import->replace = !!replace;
+      g_ptr_array_add (imports, import);
+
+      if (replace)
+        atrebas_backend_get_source (self, import);
+
+      import->thread = g_thread_try_new ("atrebas-import",
+                                         source_import_thread,
+                                         import,
+                                         &import->error);
+
+      if G_UNLIKELY (import->thread == NULL)
+        source_import_push (import, &end_of_source);
     }
 
-  if ((node = json_object_get_member (object, "features")) == NULL ||
-      json_node_get_value_type (node) != JSON_TYPE_ARRAY)
+  /* Commit each source as it arrives, aborting the rest on failure */
+  for (unsigned int i = 0; i < n_sources && ret; i++)
     {
-      g_set_error_literal (error,
-                           GEOCODE_ERROR,
-                           GEOCODE_ERROR_PARSE,
-                           "Unsupported GeoJSON file");
-      return FALSE;
+      SourceImport *import = g_async_queue_pop (ready);
+
+      ret = atrebas_backend_import (self, task, import, error);
     }
 
-  return atrebas_backend_load_features (self, node, theme, error);
+  if (!ret)
+    g_cancellable_cancel (cancellable);
+
+  if (task_cancellable != NULL)
+    g_cancellable_disconnect (task_cancellable, handler_id);
+
+  return ret;
 }
 
 static void
@@ -985,39 +2957,32 @@ atrebas_backend_update_task (GTask        *task,
                          GCancellable *cancellable)
 {
   AtrebasBackend *self = ATREBAS_BACKEND (source_object);
-  g_autoptr (JsonParser) parser = NULL;
+  g_autoptr (GPtrArray) sources = NULL;
   GError *error = NULL;
 
   if (g_task_return_error_if_cancelled (task))
     return;
 
-  parser = json_parser_new ();
+  sources = g_ptr_array_new_with_free_func (map_source_free);
 
   for (unsigned int i = 0; i < G_N_ELEMENTS (remote_sources); i++)
     {
-      MapSource *source = remote_sources[i];
-      g_autoptr (SoupMessage) message = NULL;
-      g_autoptr (GInputStream) response = NULL;
-      g_autoptr (JsonNode) root = NULL;
-
-      if (g_task_return_error_if_cancelled (task))
-        return;
-
-      message = soup_message_new ("GET", source->uri);
-      response = soup_session_send (self->session, message, cancellable, &error);
-
-      if (error != NULL)
-        return g_task_return_error (task, error);
-
-      if (!json_parser_load_from_stream (parser, response, cancellable, &error))
-        return g_task_return_error (task, error);
+      MapSource *source = g_new0 (MapSource, 1);
 
-      root = json_parser_steal_root (parser);
-
-      if (!atrebas_backend_load_features (self, root, source->theme, &error))
-        return g_task_return_error (task, error);
+      source->uri = g_strconcat (self->api_uri, remote_sources[i]->uri, NULL);
+      source->source = g_strdup (remote_sources[i]->source);
+      source->theme = remote_sources[i]->theme;
+      g_ptr_array_add (sources, source);
     }
 
+  if (!atrebas_backend_import_sources (self,
+                                       task,
+                                       (MapSource **)sources->pdata,
+                                       sources->len,
+                                       TRUE,
+                                       &error))
+    return g_task_return_error (task, error);
+
   g_task_return_boolean (task, TRUE);
 }
 
@@ -1028,37 +2993,18 @@ atrebas_backend_update_local_task (GTask        *task,
                                GCancellable *cancellable)
 {
   AtrebasBackend *self = ATREBAS_BACKEND (source_object);
-  g_autoptr (JsonParser) parser = NULL;
   GError *error = NULL;
 
   if (g_task_return_error_if_cancelled (task))
     return;
 
-  parser = json_parser_new ();
-
-  for (unsigned int i = 0; i < G_N_ELEMENTS (local_sources); i++)
-    {
-      MapSource *source = local_sources[i];
-      g_autoptr (GFile) file = NULL;
-      g_autoptr (GFileInputStream) stream = NULL;
-      g_autoptr (JsonNode) root = NULL;
-
-      if (g_task_return_error_if_cancelled (task))
-        return;
-
-      file = g_file_new_for_uri (source->uri);
-
-      if ((stream = g_file_read (file, cancellable, &error)) == NULL)
-        return g_task_return_error (task, error);
-      
-      if (!json_parser_load_from_stream (parser, G_INPUT_STREAM (stream), cancellable, &error))
-        return g_task_return_error (task, error);
-
-      root = json_parser_steal_root (parser);
-
-      if (!atrebas_backend_load_geojson (self, root, source->theme, &error))
-        return g_task_return_error (task, error);
-    }
+  if (!atrebas_backend_import_sources (self,
+                                       task,
+                                       local_sources,
+                                       G_N_ELEMENTS (local_sources),
+                                       TRUE,
+                                       &error))
+    return g_task_return_error (task, error);
 
   g_task_return_boolean (task, TRUE);
 }
@@ -1071,21 +3017,31 @@ atrebas_backend_load_task (GTask        *task,
 {
   AtrebasBackend *self = ATREBAS_BACKEND (source_object);
   MapSource *source = task_data;
-  g_autoptr (JsonParser) parser = NULL;
-  g_autoptr (JsonNode) root = NULL;
   GError *error = NULL;
 
   if (g_task_return_error_if_cancelled (task))
     return;
 
-  parser = json_parser_new ();
-
-  if (!json_parser_load_from_file (parser, source->uri, &error))
+  if (!atrebas_backend_import_sources (self, task, &source, 1, FALSE, &error))
     return g_task_return_error (task, error);
 
-  root = json_parser_steal_root (parser);
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+atrebas_backend_load_bundled_task (GTask        *task,
+                                   gpointer      source_object,
+                                   gpointer      task_data,
+                                   GCancellable *cancellable)
+{
+  AtrebasBackend *self = ATREBAS_BACKEND (source_object);
+  MapSource *source = task_data;
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
 
-  if (!atrebas_backend_load_geojson (self, root, source->theme, &error))
+  if (!atrebas_backend_import_sources (self, task, &source, 1, TRUE, &error))
     return g_task_return_error (task, error);
 
   g_task_return_boolean (task, TRUE);
@@ -1095,6 +3051,49 @@ atrebas_backend_load_task (GTask        *task,
 /*
  * Core Database GTaskFuncs
  */
+static gboolean
+atrebas_backend_seed (AtrebasBackend *self,
+                      GCancellable   *cancellable)
+{
+  g_autoptr (GFile) source = NULL;
+  g_autoptr (GFile) target = NULL;
+  g_autoptr (GFile) partial = NULL;
+  g_autofree char *partial_path = NULL;
+  g_autoptr (GError) error = NULL;
+
+  if (!g_file_test (BUNDLED_DATABASE, G_FILE_TEST_IS_REGULAR))
+    return FALSE;
+
+  /* Copy to a temporary file first, so an interrupted copy is never
+   * mistaken for a database */
+  partial_path = g_strconcat (self->path, ".partial", NULL);
+  source = g_file_new_for_path (BUNDLED_DATABASE);
+  target = g_file_new_for_path (self->path);
+  partial = g_file_new_for_path (partial_path);
+
+  if (!g_file_copy (source,
+                    partial,
+                    G_FILE_COPY_OVERWRITE,
+                    cancellable,
+                    NULL,
+                    NULL,
+                    &error) ||
+      !g_file_move (partial,
+                    target,
+                    G_FILE_COPY_NONE,
+                    cancellable,
+                    NULL,
+                    NULL,
+                    &error))
+    {
+      g_warning ("%s: %s", G_STRFUNC, error->message);
+      g_file_delete (partial, NULL, NULL);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
 static void
 atrebas_backend_open_task (GTask        *task,
                            gpointer      source_object,
@@ -1102,6 +3101,9 @@ atrebas_backend_open_task (GTask        *task,
                            GCancellable *cancellable)
 {
   AtrebasBackend *self = ATREBAS_BACKEND (source_object);
+  sqlite3_stmt *stmt = NULL;
+  gboolean needs_update = FALSE;
+  int version = 0;
   int rc;
 
   if (g_task_return_error_if_cancelled (task))
@@ -1110,17 +3112,10 @@ atrebas_backend_open_task (GTask        *task,
   if (self->connection != NULL)
     return g_task_return_boolean (task, TRUE);
 
-  /* If the database hasn't been created, update from bundled JSON */
+  /* If the database hasn't been created, start from the prebuilt database,
+   * falling back to an update from bundled JSON */
   if (!g_file_test (self->path, G_FILE_TEST_IS_REGULAR))
-    {
-      g_autoptr (GTask) db_task = NULL;
-
-      db_task = g_task_new (self, cancellable, NULL, NULL);
-      atrebas_backend_thread_push (self,
-                                   db_task,
-                                   atrebas_backend_update_local_task,
-                                   OPERATION_DEFAULT);
-    }
+    needs_update = !self->bundled || !atrebas_backend_seed (self, cancellable);
 
   /* Pass NOMUTEX since tasks are executed sequentially */
   rc = sqlite3_open_v2 (self->path,
@@ -1141,6 +3136,60 @@ atrebas_backend_open_task (GTask        *task,
       return;
     }
 
+  /* If the schema is outdated, drop the tables and update from bundled JSON */
+  rc = sqlite3_prepare_v2 (self->connection,
+                           "PRAGMA user_version;",
+                           -1,
+                           &stmt,
+                           NULL);
+
+  if (rc == SQLITE_OK && sqlite3_step (stmt) == SQLITE_ROW)
+    version = sqlite3_column_int (stmt, 0);
+  g_clear_pointer (&stmt, sqlite3_finalize);
+
+  if (version != ATREBAS_BACKEND_SCHEMA_VERSION)
+    {
+      g_autofree char *sql = NULL;
+
+      sql = g_strdup_printf ("%s PRAGMA user_version = %i;",
+                             ATREBAS_BACKEND_DROP_TABLES_SQL,
+                             ATREBAS_BACKEND_SCHEMA_VERSION);
+      rc = sqlite3_exec (self->connection, sql, NULL, NULL, NULL);
+
+      if (rc != SQLITE_OK)
+        {
+          g_task_return_new_error (task,
+                                   GEOCODE_ERROR,
+                                   GEOCODE_ERROR_INTERNAL_SERVER,
+                                   "sqlite3_exec(): [%i] %s",
+                                   rc, sqlite3_errstr (rc));
+          g_clear_pointer (&self->connection, sqlite3_close);
+          return;
+        }
+
+      needs_update = TRUE;
+    }
+
+  /* Use write-ahead logging, so bulk loads can be committed without an
+   * fsync() for every transaction */
+  rc = sqlite3_exec (self->connection,
+                     "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;",
+                     NULL,
+                     NULL,
+                     NULL);
+
+  if (rc != SQLITE_OK)
+    {
+      g_debug ("sqlite3_exec(): \"%s\": [%i] %s",
+               "PRAGMA journal_mode=WAL;", rc, sqlite3_errstr (rc));
+    }
+
+  /* Interrupt long-running statements when cancelled */
+  sqlite3_progress_handler (self->connection,
+                            PROGRESS_HANDLER_N,
+                            operation_context_progress,
+                            &self->context);
+
   /* Prepare the tables */
   rc = sqlite3_exec (self->connection,
                      ATREBAS_BACKEND_FEATURE_TABLE_SQL,
@@ -1148,6 +3197,10 @@ atrebas_backend_open_task (GTask        *task,
                      NULL,
                      NULL);
 
+  /* Register the ranking function used by the search statements */
+  if (rc == SQLITE_OK)
+    rc = rank_register_functions (self->connection);
+
   if (rc != SQLITE_OK)
     {
       g_task_return_new_error (task,
@@ -1163,7 +3216,6 @@ atrebas_backend_open_task (GTask        *task,
   for (unsigned int i = 0; i < N_STATEMENTS; i++)
     {
       const char *sql = statements[i];
-      sqlite3_stmt *stmt = NULL;
 
       rc = sqlite3_prepare_v2 (self->connection, sql, -1, &stmt, NULL);
 
@@ -1181,6 +3233,21 @@ atrebas_backend_open_task (GTask        *task,
       self->stmts[i] = g_steal_pointer (&stmt);
     }
 
+  if (needs_update && self->bundled)
+    {
+      g_autoptr (GTask) db_task = NULL;
+
+      db_task = g_task_new (self, cancellable, NULL, NULL);
+      g_task_set_priority (db_task, G_PRIORITY_LOW);
+      atrebas_backend_thread_push (self,
+                                   db_task,
+                                   atrebas_backend_update_local_task,
+                                   OPERATION_DEFAULT);
+    }
+
+  atrebas_backend_refresh_index (self);
+  atrebas_backend_start_readers (self);
+
   g_task_return_boolean (task, TRUE);
 }
 
@@ -1198,6 +3265,10 @@ atrebas_backend_close_task (GTask        *task,
 
   g_assert (self->connection != NULL);
 
+  /* Close the read-only connections first, so the last connection to close
+   * can checkpoint and remove the write-ahead log */
+  atrebas_backend_stop_readers (self);
+
   /* Cleanup cached statements */
   for (unsigned int i = 0; i < N_STATEMENTS; i++)
     g_clear_pointer (&self->stmts[i], sqlite3_finalize);
@@ -1326,11 +3397,13 @@ atrebas_backend_forward_search (GeocodeBackend  *backend,
   query = backend_query_new (params);
   task = g_task_new (backend, cancellable, NULL, NULL);
   g_task_set_source_tag (task, atrebas_backend_forward_search);
-  g_task_set_task_data (task, g_steal_pointer (&query), backend_query_free);
-  atrebas_backend_thread_push (self,
-                           task,
-                           atrebas_backend_forward_search_task,
-                           OPERATION_DEFAULT);
+  g_task_set_priority (task, query->priority);
+  g_task_set_task_data (task, query, backend_query_free);
+  atrebas_backend_query_push (self,
+                              task,
+                              atrebas_backend_forward_search_task,
+                              query->coalesce,
+                              query->deadline);
 
   /* Iterate the main context until the task completes */
   while (!g_task_get_completed (task))
@@ -1365,11 +3438,13 @@ atrebas_backend_forward_search_async (GeocodeBackend      *backend,
   query = backend_query_new (params);
   task = g_task_new (backend, cancellable, callback, user_data);
   g_task_set_source_tag (task, atrebas_backend_forward_search_async);
-  g_task_set_task_data (task, g_steal_pointer (&query), backend_query_free);
-  atrebas_backend_thread_push (self,
-                           task,
-                           atrebas_backend_forward_search_task,
-                           OPERATION_DEFAULT);
+  g_task_set_priority (task, query->priority);
+  g_task_set_task_data (task, query, backend_query_free);
+  atrebas_backend_query_push (self,
+                              task,
+                              atrebas_backend_forward_search_task,
+                              query->coalesce,
+                              query->deadline);
 }
 
 static GList *
@@ -1395,13 +3470,27 @@ atrebas_backend_reverse_resolve (GeocodeBackend  *backend,
     }
 
   query = backend_query_new (params);
+
+  /* Points outside every feature are resolved without a database query */
+  if (!atrebas_backend_index_search (self, query))
+    {
+      g_set_error (error,
+                   GEOCODE_ERROR,
+                   GEOCODE_ERROR_NO_MATCHES,
+                   "No matches found for request");
+      g_clear_pointer (&query, backend_query_free);
+      return NULL;
+    }
+
   task = g_task_new (backend, cancellable, NULL, NULL);
   g_task_set_source_tag (task, atrebas_backend_reverse_resolve);
-  g_task_set_task_data (task, g_steal_pointer (&query), backend_query_free);
-  atrebas_backend_thread_push (self,
-                           task,
-                           atrebas_backend_reverse_resolve_task,
-                           OPERATION_DEFAULT);
+  g_task_set_priority (task, query->priority);
+  g_task_set_task_data (task, query, backend_query_free);
+  atrebas_backend_query_push (self,
+                              task,
+                              atrebas_backend_reverse_resolve_task,
+                              query->coalesce,
+                              query->deadline);
 
   /* Iterate the main context until the task completes */
   while (!g_task_get_completed (task))
@@ -1431,16 +3520,30 @@ atrebas_backend_reverse_resolve_async (GeocodeBackend      *backend,
                                GEOCODE_ERROR,
                                GEOCODE_ERROR_INVALID_ARGUMENTS,
                                "Missing `lat` and `lon` parameters");
+      return;
     }
 
   query = backend_query_new (params);
   task = g_task_new (backend, cancellable, callback, user_data);
   g_task_set_source_tag (task, atrebas_backend_reverse_resolve_async);
-  g_task_set_task_data (task, g_steal_pointer (&query), backend_query_free);
-  atrebas_backend_thread_push (self,
-                           task,
-                           atrebas_backend_reverse_resolve_task,
-                           OPERATION_DEFAULT);
+  g_task_set_priority (task, query->priority);
+  g_task_set_task_data (task, query, backend_query_free);
+
+  /* Points outside every feature are resolved without a database query */
+  if (!atrebas_backend_index_search (self, query))
+    {
+      g_task_return_new_error (task,
+                               GEOCODE_ERROR,
+                               GEOCODE_ERROR_NO_MATCHES,
+                               "No matches found for request");
+      return;
+    }
+
+  atrebas_backend_query_push (self,
+                              task,
+                              atrebas_backend_reverse_resolve_task,
+                              query->coalesce,
+                              query->deadline);
 }
 
 static void
@@ -1462,6 +3565,9 @@ atrebas_backend_constructed (GObject *object)
   AtrebasBackend *self = ATREBAS_BACKEND (object);
   g_autofree char *dirname = NULL;
 
+  if (self->api_uri == NULL)
+    self->api_uri = g_strdup (NATIVE_LAND_API);
+
   /* Ensure we have a database path in an existing */
   if (self->path == NULL)
     self->path = g_build_filename (g_get_user_cache_dir (),
@@ -1496,9 +3602,17 @@ atrebas_backend_finalize (GObject *object)
 
   atrebas_backend_close (self);
 
+  g_clear_pointer (&self->api_uri, g_free);
   g_clear_pointer (&self->path, g_free);
   g_clear_pointer (&self->operations, g_async_queue_unref);
-  g_clear_object (&self->session);
+  g_clear_pointer (&self->coalesce, g_hash_table_unref);
+  g_mutex_clear (&self->coalesce_lock);
+  g_clear_pointer (&self->queries, g_async_queue_unref);
+  g_clear_pointer (&self->readers, g_ptr_array_unref);
+  g_clear_pointer (&self->index, atrebas_spatial_index_unref);
+  g_mutex_clear (&self->index_lock);
+  g_clear_pointer (&self->features, g_hash_table_unref);
+  g_mutex_clear (&self->features_lock);
 
   G_OBJECT_CLASS (atrebas_backend_parent_class)->finalize (object);
 }
@@ -1513,6 +3627,14 @@ atrebas_backend_get_property (GObject    *object,
 
   switch (prop_id)
     {
+    case PROP_API_URI:
+      g_value_set_string (value, self->api_uri);
+      break;
+
+    case PROP_BUNDLED:
+      g_value_set_boolean (value, self->bundled);
+      break;
+
     case PROP_PATH:
       g_value_set_string (value, atrebas_backend_get_path (self));
       break;
@@ -1532,6 +3654,14 @@ atrebas_backend_set_property (GObject      *object,
 
   switch (prop_id)
     {
+    case PROP_API_URI:
+      self->api_uri = g_value_dup_string (value);
+      break;
+
+    case PROP_BUNDLED:
+      self->bundled = g_value_get_boolean (value);
+      break;
+
     case PROP_PATH:
       self->path = g_value_dup_string (value);
       break;
@@ -1552,6 +3682,39 @@ atrebas_backend_class_init (AtrebasBackendClass *klass)
   object_class->get_property = atrebas_backend_get_property;
   object_class->set_property = atrebas_backend_set_property;
 
+  /**
+   * AtrebasBackend:api-uri:
+   *
+   * The URI of the <native-land.ca> API endpoint, used by
+   * atrebas_backend_update().
+   */
+  properties [PROP_API_URI] =
+    g_param_spec_string ("api-uri",
+                         "API URI",
+                         "The URI of the API endpoint",
+                         NATIVE_LAND_API,
+                         (G_PARAM_READWRITE |
+                          G_PARAM_CONSTRUCT_ONLY |
+                          G_PARAM_EXPLICIT_NOTIFY |
+                          G_PARAM_STATIC_STRINGS));
+
+  /**
+   * AtrebasBackend:bundled:
+   *
+   * Whether a new database is seeded from the bundled maps. The prebuilt
+   * database installed with the application is used if available, otherwise
+   * the bundled GeoJSON is imported.
+   */
+  properties [PROP_BUNDLED] =
+    g_param_spec_boolean ("bundled",
+                          "Bundled",
+                          "Seed a new database from the bundled maps",
+                          TRUE,
+                          (G_PARAM_READWRITE |
+                           G_PARAM_CONSTRUCT_ONLY |
+                           G_PARAM_EXPLICIT_NOTIFY |
+                           G_PARAM_STATIC_STRINGS));
+
   /**
    * AtrebasBackend:path:
    *
@@ -1569,21 +3732,67 @@ atrebas_backend_class_init (AtrebasBackendClass *klass)
 
   g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 
+  /**
+   * AtrebasBackend::progress:
+   * @backend: a #AtrebasBackend
+   * @theme: a #AtrebasMapTheme
+   * @n_features: the number of features loaded
+   *
+   * The #AtrebasBackend::progress signal is emitted periodically while a
+   * GeoJSON source is loaded into the database, and once more when the
+   * source has been committed.
+   *
+   * The signal is emitted in the thread-default main context of the operation
+   * that is loading the source.
+   */
+  signals [PROGRESS] =
+    g_signal_new ("progress",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL, NULL,
+                  G_TYPE_NONE,
+                  2,
+                  ATREBAS_TYPE_MAP_THEME,
+                  G_TYPE_UINT);
+
   /*
    * SQL Statements
    */
   statements[STMT_ADD_FEATURE] = ADD_FEATURE_SQL;
+  statements[STMT_BOUNDED_SEARCH_FEATURES] = BOUNDED_SEARCH_FEATURES_SQL;
+  statements[STMT_GET_EXTENTS] = GET_EXTENTS_SQL;
   statements[STMT_GET_FEATURE] = GET_FEATURE_SQL;
-  statements[STMT_GET_FEATURES] = GET_FEATURES_SQL;
+  statements[STMT_GET_FEATURE_COVER] = GET_FEATURE_COVER_SQL;
+  statements[STMT_GET_FEATURE_HASH] = GET_FEATURE_HASH_SQL;
+  statements[STMT_GET_FEATURE_ROW] = GET_FEATURE_ROW_SQL;
+  statements[STMT_GET_FEATURE_SLOT] = GET_FEATURE_SLOT_SQL;
+  statements[STMT_GET_GEOMETRY] = GET_GEOMETRY_SQL;
+  statements[STMT_GET_SOURCE] = GET_SOURCE_SQL;
+  statements[STMT_GET_STALE_FEATURES] = GET_STALE_FEATURES_SQL;
+  statements[STMT_LOCATE_FEATURES] = LOCATE_FEATURES_SQL;
+  statements[STMT_NEXT_GENERATION] = NEXT_GENERATION_SQL;
   statements[STMT_REMOVE_FEATURE] = REMOVE_FEATURE_SQL;
+  statements[STMT_REMOVE_STALE_FEATURES] = REMOVE_STALE_FEATURES_SQL;
   statements[STMT_SEARCH_FEATURES] = SEARCH_FEATURES_SQL;
+  statements[STMT_SET_FEATURE_COVER] = SET_FEATURE_COVER_SQL;
+  statements[STMT_SET_FEATURE_STATE] = SET_FEATURE_STATE_SQL;
+  statements[STMT_SET_SOURCE] = SET_SOURCE_SQL;
+  statements[STMT_UPDATE_FEATURE] = UPDATE_FEATURE_SQL;
 }
 
 static void
 atrebas_backend_init (AtrebasBackend *self)
 {
   self->operations = g_async_queue_new_full (operation_closure_cancel);
-  self->session = soup_session_new ();
+  self->coalesce = g_hash_table_new (NULL, NULL);
+  g_mutex_init (&self->coalesce_lock);
+  self->queries = g_async_queue_new_full (operation_closure_cancel);
+  self->readers = g_ptr_array_new_with_free_func ((GDestroyNotify)g_thread_join);
+  self->features = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, feature_ref_free);
+  self->features_prune = FEATURES_PRUNE_MIN;
+  g_mutex_init (&self->index_lock);
+  g_mutex_init (&self->features_lock);
 }
 
 /**
@@ -1650,6 +3859,12 @@ atrebas_backend_get_path (AtrebasBackend *backend)
  *
  * Update the backend from <native-land.ca>. Call
  * atrebas_backend_update_finish() to get the result.
+ *
+ * Each map theme is downloaded concurrently and committed separately, so if
+ * the operation fails, themes that were already committed are kept.
+ *
+ * Themes that have not changed since the last update are not downloaded
+ * again, and features that are no longer published are removed.
  */
 void
 atrebas_backend_update (AtrebasBackend      *backend,
@@ -1664,6 +3879,7 @@ atrebas_backend_update (AtrebasBackend      *backend,
 
   task = g_task_new (backend, cancellable, callback, user_data);
   g_task_set_source_tag (task, atrebas_backend_update);
+  g_task_set_priority (task, G_PRIORITY_LOW);
   atrebas_backend_thread_push (backend,
                            task,
                            atrebas_backend_update_task,
@@ -1718,12 +3934,15 @@ atrebas_backend_load (AtrebasBackend      *backend,
   g_return_if_fail (!atrebas_str_empty0 (filename));
   g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
 
+  /* A loaded file is its own source, so updates leave its features alone */
   source = g_new0 (MapSource, 1);
   source->uri = g_strdup (filename);
+  source->source = g_strdup (filename);
   source->theme = theme;
 
   task = g_task_new (backend, cancellable, callback, user_data);
   g_task_set_source_tag (task, atrebas_backend_load);
+  g_task_set_priority (task, G_PRIORITY_LOW);
   g_task_set_task_data (task, source, map_source_free);
   atrebas_backend_thread_push (backend,
                            task,
@@ -1737,7 +3956,8 @@ atrebas_backend_load (AtrebasBackend      *backend,
  * @result: a #GAsyncResult
  * @error: (nullable): a #GError
  *
- * Finish an operation started by atrebas_backend_load().
+ * Finish an operation started by atrebas_backend_load() or
+ * atrebas_backend_load_bundled().
  *
  * Returns: %TRUE or %FALSE with @error set
  */
@@ -1753,6 +3973,60 @@ atrebas_backend_load_finish (AtrebasBackend  *backend,
   return g_task_propagate_boolean (G_TASK (result), error);
 }
 
+/**
+ * atrebas_backend_load_bundled: (skip)
+ * @backend: a #AtrebasBackend
+ * @filename: (type filename): a file path
+ * @theme: a #AtrebasMapTheme
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: (scope async): a #GAsyncReadyCallback
+ * @user_data: (closure): user supplied data
+ *
+ * Load the GeoJSON feature collection at @filename as the bundled map for
+ * @theme, so that an update removes the features missing from it. This is how
+ * the prebuilt database is built, before the maps are installed.
+ *
+ * Call atrebas_backend_load_finish() to get the result.
+ */
+void
+atrebas_backend_load_bundled (AtrebasBackend      *backend,
+                              const char          *filename,
+                              AtrebasMapTheme      theme,
+                              GCancellable        *cancellable,
+                              GAsyncReadyCallback  callback,
+                              gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+  MapSource *source;
+  const char *key = NULL;
+
+  g_return_if_fail (ATREBAS_IS_BACKEND (backend));
+  g_return_if_fail (!atrebas_str_empty0 (filename));
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  for (unsigned int i = 0; i < G_N_ELEMENTS (local_sources); i++)
+    {
+      if (local_sources[i]->theme == theme)
+        key = local_sources[i]->source;
+    }
+
+  g_return_if_fail (key != NULL);
+
+  source = g_new0 (MapSource, 1);
+  source->uri = g_strdup (filename);
+  source->source = g_strdup (key);
+  source->theme = theme;
+
+  task = g_task_new (backend, cancellable, callback, user_data);
+  g_task_set_source_tag (task, atrebas_backend_load_bundled);
+  g_task_set_priority (task, G_PRIORITY_LOW);
+  g_task_set_task_data (task, source, map_source_free);
+  atrebas_backend_thread_push (backend,
+                           task,
+                           atrebas_backend_load_bundled_task,
+                           OPERATION_DEFAULT);
+}
+
 /**
  * atrebas_backend_load:
  * @backend: a #AtrebasBackend
@@ -1780,10 +4054,7 @@ atrebas_backend_lookup (AtrebasBackend      *backend,
   task = g_task_new (backend, cancellable, callback, user_data);
   g_task_set_source_tag (task, atrebas_backend_load);
   g_task_set_task_data (task, g_strdup (id), g_free);
-  atrebas_backend_thread_push (backend,
-                           task,
-                           atrebas_backend_lookup_task,
-                           OPERATION_DEFAULT);
+  atrebas_backend_query_push (backend, task, atrebas_backend_lookup_task, NULL, 0);
 }
 
 /**
@@ -1808,3 +4079,68 @@ atrebas_backend_lookup_finish (AtrebasBackend    *backend,
   return g_task_propagate_pointer (G_TASK (result), error);
 }
 
+/**
+ * atrebas_backend_load_geometry:
+ * @backend: a #AtrebasBackend
+ * @feature: a #AtrebasFeature
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: (scope async): a #GAsyncReadyCallback
+ * @user_data: (closure): user supplied data
+ *
+ * Load the packed geometry for @feature, if it was returned without one by a
+ * search or lookup. The geometry is cached on @feature, so later calls and
+ * atrebas_feature_get_geometry() return it immediately.
+ *
+ * Call atrebas_backend_load_geometry_finish() to get the result.
+ */
+void
+atrebas_backend_load_geometry (AtrebasBackend      *backend,
+                               AtrebasFeature      *feature,
+                               GCancellable        *cancellable,
+                               GAsyncReadyCallback  callback,
+                               gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+  GBytes *geometry;
+
+  g_return_if_fail (ATREBAS_IS_BACKEND (backend));
+  g_return_if_fail (ATREBAS_IS_FEATURE (feature));
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (backend, cancellable, callback, user_data);
+  g_task_set_source_tag (task, atrebas_backend_load_geometry);
+
+  if ((geometry = atrebas_feature_get_geometry (feature)) != NULL)
+    {
+      g_task_return_pointer (task,
+                             g_bytes_ref (geometry),
+                             (GDestroyNotify)g_bytes_unref);
+      return;
+    }
+
+  g_task_set_task_data (task, g_object_ref (feature), g_object_unref);
+  atrebas_backend_query_push (backend, task, atrebas_backend_load_geometry_task, NULL, 0);
+}
+
+/**
+ * atrebas_backend_load_geometry_finish:
+ * @backend: a #AtrebasBackend
+ * @result: a #GAsyncResult
+ * @error: (nullable): a #GError
+ *
+ * Finish an operation started by atrebas_backend_load_geometry().
+ *
+ * Returns: (transfer full): a #GBytes
+ */
+GBytes *
+atrebas_backend_load_geometry_finish (AtrebasBackend  *backend,
+                                      GAsyncResult    *result,
+                                      GError         **error)
+{
+  g_return_val_if_fail (ATREBAS_IS_BACKEND (backend), NULL);
+  g_return_val_if_fail (g_task_is_valid (result, backend), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
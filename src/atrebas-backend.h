@@ -13,37 +13,60 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (AtrebasBackend, atrebas_backend, ATREBAS, BACKEND, GObject)
 
-GeocodeBackend * atrebas_backend_new           (const char           *path);
-GeocodeBackend * atrebas_backend_get_default   (void);
-const char     * atrebas_backend_get_path      (AtrebasBackend       *backend);
-void             atrebas_backend_load          (AtrebasBackend       *backend,
-                                                const char           *filename,
-                                                AtrebasMapTheme       theme,
-                                                GCancellable         *cancellable,
-                                                GAsyncReadyCallback   callback,
-                                                gpointer              user_data);
-gboolean         atrebas_backend_load_finish   (AtrebasBackend       *backend,
-                                                GAsyncResult         *result,
-                                                GError              **error);
-void             atrebas_backend_lookup        (AtrebasBackend       *backend,
-                                                const char           *id,
-                                                GCancellable         *cancellable,
-                                                GAsyncReadyCallback   callback,
-                                                gpointer              user_data);
-AtrebasFeature * atrebas_backend_lookup_finish (AtrebasBackend       *backend,
-                                                GAsyncResult         *result,
-                                                GError              **error);
-void             atrebas_backend_update        (AtrebasBackend       *backend,
-                                                GCancellable         *cancellable,
-                                                GAsyncReadyCallback   callback,
-                                                gpointer              user_data);
-gboolean         atrebas_backend_update_finish (AtrebasBackend       *backend,
-                                                GAsyncResult         *result,
-                                                GError              **error);
+GeocodeBackend * atrebas_backend_new                  (const char           *path);
+GeocodeBackend * atrebas_backend_get_default          (void);
+const char     * atrebas_backend_get_path             (AtrebasBackend       *backend);
+void             atrebas_backend_load                 (AtrebasBackend       *backend,
+                                                       const char           *filename,
+                                                       AtrebasMapTheme       theme,
+                                                       GCancellable         *cancellable,
+                                                       GAsyncReadyCallback   callback,
+                                                       gpointer              user_data);
+gboolean         atrebas_backend_load_finish          (AtrebasBackend       *backend,
+                                                       GAsyncResult         *result,
+                                                       GError              **error);
+void             atrebas_backend_load_geometry        (AtrebasBackend       *backend,
+                                                       AtrebasFeature       *feature,
+                                                       GCancellable         *cancellable,
+                                                       GAsyncReadyCallback   callback,
+                                                       gpointer              user_data);
+GBytes         * atrebas_backend_load_geometry_finish (AtrebasBackend       *backend,
+                                                       GAsyncResult         *result,
+                                                       GError              **error);
+void             atrebas_backend_lookup               (AtrebasBackend       *backend,
+                                                       const char           *id,
+                                                       GCancellable         *cancellable,
+                                                       GAsyncReadyCallback   callback,
+                                                       gpointer              user_data);
+AtrebasFeature * atrebas_backend_lookup_finish        (AtrebasBackend       *backend,
+                                                       GAsyncResult         *result,
+                                                       GError              **error);
+void             atrebas_backend_update               (AtrebasBackend       *backend,
+                                                       GCancellable         *cancellable,
+                                                       GAsyncReadyCallback   callback,
+                                                       gpointer              user_data);
+gboolean         atrebas_backend_update_finish        (AtrebasBackend       *backend,
+                                                       GAsyncResult         *result,
+                                                       GError              **error);
 
 /* Utilities */
 GHashTable *     atrebas_geocode_parameters_for_coordinates (double        latitude,
                                                              double        longitude);
 GHashTable *     atrebas_geocode_parameters_for_location    (const char   *location);
+void             atrebas_geocode_parameters_add_double      (GHashTable   *parameters,
+                                                             const char   *key,
+                                                             double        value);
+void             atrebas_geocode_parameters_add_int         (GHashTable   *parameters,
+                                                             const char   *key,
+                                                             int           value);
+void             atrebas_geocode_parameters_add_uint        (GHashTable   *parameters,
+                                                             const char   *key,
+                                                             unsigned int  value);
+void             atrebas_geocode_parameters_add_pointer     (GHashTable   *parameters,
+                                                             const char   *key,
+                                                             gpointer      value);
+void             atrebas_geocode_parameters_add_string      (GHashTable   *parameters,
+                                                             const char   *key,
+                                                             const char   *value);
 
 G_END_DECLS
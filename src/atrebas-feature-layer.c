@@ -4,10 +4,13 @@
 #include <cairo/cairo-gobject.h>
 #include <gdk/gdk.h>
 #include <gtk/gtk.h>
+#include <math.h>
 #include <shumate/shumate.h>
 
+#include "atrebas-backend.h"
 #include "atrebas-feature.h"
 #include "atrebas-feature-layer.h"
+#include "atrebas-geometry.h"
 
 #define BORDER_ON      0
 #define BORDER_OFF     1
@@ -21,6 +24,11 @@
  * [class@Atrebas.Feature] objects as bordered overlays.
  *
  * #AtrebasFeatureLayer is loosely based on [class@Shumate.PathLayer].
+ *
+ * The vertices of the feature are projected into normalized Web Mercator
+ * coordinates once, when the geometry is set. Each frame only applies the
+ * scale, rotation and translation of the viewport, as a single affine
+ * transform over the projected vertices.
  */
 
 struct _AtrebasFeatureLayer
@@ -28,8 +36,10 @@ struct _AtrebasFeatureLayer
   ShumateLayer    parent_instance;
 
   AtrebasFeature *feature;
-  AtrebasPoint   *coordinates;
-  unsigned int    n_points;
+  GBytes         *geometry;
+  double         *projected;
+  double         *points;
+  GCancellable   *cancellable;
 
   double          border[BORDER_NUM];
   GdkRGBA         fill_color;
@@ -49,16 +59,167 @@ enum {
 static GParamSpec *properties[N_PROPERTIES] = { NULL, };
 
 
+/*
+ * Projection
+ */
+#define PROBE_DELTA (1.0 / 256.0)
+
+/* Normalized Web Mercator, with the world from (0, 0) in the north-west to
+ * (1, 1) in the south-east */
+static inline void
+mercator_project (double  latitude,
+                  double  longitude,
+                  double *u,
+                  double *v)
+{
+  double sin_lat;
+
+  latitude = CLAMP (latitude, SHUMATE_MIN_LATITUDE, SHUMATE_MAX_LATITUDE);
+  sin_lat = sin (latitude * G_PI / 180.0);
+
+  *u = (longitude + 180.0) / 360.0;
+  *v = 0.5 - log ((1.0 + sin_lat) / (1.0 - sin_lat)) / (4.0 * G_PI);
+}
+
+static inline void
+mercator_unproject (double  u,
+                    double  v,
+                    double *latitude,
+                    double *longitude)
+{
+  *latitude = atan (sinh (G_PI * (1.0 - 2.0 * v))) * 180.0 / G_PI;
+  *longitude = u * 360.0 - 180.0;
+}
+
+/* Get the affine transform from normalized Web Mercator to the coordinates of
+ * @widget. Rather than repeat the arithmetic of the viewport, it is solved
+ * from three points near the center of the viewport, so the overlay always
+ * agrees with the map. */
+static void
+viewport_get_transform (ShumateViewport *viewport,
+                        GtkWidget       *widget,
+                        cairo_matrix_t  *matrix)
+{
+  double latitude, longitude;
+  double u0, v0, du, dv;
+  double x0, y0, x1, y1, x2, y2;
+
+  latitude = shumate_location_get_latitude (SHUMATE_LOCATION (viewport));
+  longitude = shumate_location_get_longitude (SHUMATE_LOCATION (viewport));
+  mercator_project (latitude, longitude, &u0, &v0);
+
+  /* Step towards the middle of the world, so no point is clamped */
+  du = (u0 < 0.5) ? PROBE_DELTA : -PROBE_DELTA;
+  dv = (v0 < 0.5) ? PROBE_DELTA : -PROBE_DELTA;
+
+  mercator_unproject (u0, v0, &latitude, &longitude);
+  shumate_viewport_location_to_widget_coords (viewport, widget,
+                                              latitude, longitude,
+                                              &x0, &y0);
+  mercator_unproject (u0 + du, v0, &latitude, &longitude);
+  shumate_viewport_location_to_widget_coords (viewport, widget,
+                                              latitude, longitude,
+                                              &x1, &y1);
+  mercator_unproject (u0, v0 + dv, &latitude, &longitude);
+  shumate_viewport_location_to_widget_coords (viewport, widget,
+                                              latitude, longitude,
+                                              &x2, &y2);
+
+  cairo_matrix_init (matrix,
+                     (x1 - x0) / du, (y1 - y0) / du,
+                     (x2 - x0) / dv, (y2 - y0) / dv,
+                     0.0, 0.0);
+  matrix->x0 = x0 - (matrix->xx * u0 + matrix->xy * v0);
+  matrix->y0 = y0 - (matrix->yx * u0 + matrix->yy * v0);
+}
+
+/* Apply @matrix to @n_points interleaved points. The loop has no branches or
+ * dependencies between iterations, so the compiler can vectorize it. */
+static void
+transform_points (const cairo_matrix_t *matrix,
+                  const double         *in,
+                  double               *out,
+                  unsigned int          n_points)
+{
+  const double xx = matrix->xx, xy = matrix->xy, x0 = matrix->x0;
+  const double yx = matrix->yx, yy = matrix->yy, y0 = matrix->y0;
+
+  for (unsigned int i = 0; i < 2 * n_points; i += 2)
+    {
+      double u = in[i];
+      double v = in[i + 1];
+
+      out[i] = xx * u + xy * v + x0;
+      out[i + 1] = yx * u + yy * v + y0;
+    }
+}
+
+
 /*
  * AtrebasFeatureLayer
  */
+static void
+atrebas_feature_layer_take_geometry (AtrebasFeatureLayer *self,
+                                     GBytes              *geometry)
+{
+  const guint8 *data;
+  unsigned int n_vertices;
+
+  g_assert (ATREBAS_IS_FEATURE_LAYER (self));
+  g_assert (self->geometry == NULL);
+
+  if (geometry == NULL)
+    return;
+
+  self->geometry = geometry;
+
+  /* Project the vertices once; the viewport only scales, rotates and
+   * translates them */
+  data = g_bytes_get_data (geometry, NULL);
+  n_vertices = atrebas_geometry_get_n_vertices (data);
+  self->projected = g_new (double, 2 * n_vertices);
+  self->points = g_new (double, 2 * n_vertices);
+
+  for (unsigned int i = 0; i < n_vertices; i++)
+    {
+      double latitude, longitude;
+
+      atrebas_geometry_get_vertex (data, i, &longitude, &latitude);
+      mercator_project (latitude,
+                        longitude,
+                        &self->projected[2 * i],
+                        &self->projected[2 * i + 1]);
+    }
+}
+
+static void
+atrebas_feature_layer_load_geometry_cb (AtrebasBackend      *backend,
+                                        GAsyncResult        *result,
+                                        AtrebasFeatureLayer *self)
+{
+  g_autoptr (GError) error = NULL;
+  GBytes *geometry;
+
+  geometry = atrebas_backend_load_geometry_finish (backend, result, &error);
+
+  if (error != NULL)
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("%s: %s", G_STRFUNC, error->message);
+
+      return;
+    }
+
+  atrebas_feature_layer_take_geometry (self, geometry);
+  gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
 static void
 atrebas_feature_layer_set_feature (AtrebasFeatureLayer *self,
                                AtrebasFeature      *feature)
 {
   AtrebasMapTheme theme;
-  JsonArray *coordinates;
-  JsonArray *polygon;
+  GBytes *geometry;
 
   g_assert (ATREBAS_IS_FEATURE_LAYER (self));
   g_return_if_fail (ATREBAS_IS_FEATURE (feature));
@@ -96,21 +257,20 @@ atrebas_feature_layer_set_feature (AtrebasFeatureLayer *self,
       self->stroke_width = 2.0;
     }
 
-  /* Preload the coordinates into a plain array */
-  coordinates = atrebas_feature_get_coordinates (self->feature);
-  polygon = json_array_get_array_element (coordinates, 0);
-
-  self->n_points = json_array_get_length (polygon);
-  self->coordinates = g_new (AtrebasPoint, self->n_points);
-
-  for (unsigned int i = 0; i < self->n_points; i++)
+  /* Share the packed geometry of the feature, or load it if the feature only
+   * has a bounding box */
+  if ((geometry = atrebas_feature_get_geometry (feature)) != NULL)
     {
-      JsonArray *point = json_array_get_array_element (polygon, i);
-      double longitude = json_array_get_double_element (point, 0);
-      double latitude = json_array_get_double_element (point, 1);
-
-      self->coordinates[i].longitude = longitude;
-      self->coordinates[i].latitude = latitude;
+      atrebas_feature_layer_take_geometry (self, g_bytes_ref (geometry));
+    }
+  else
+    {
+      self->cancellable = g_cancellable_new ();
+      atrebas_backend_load_geometry (ATREBAS_BACKEND (atrebas_backend_get_default ()),
+                                     feature,
+                                     self->cancellable,
+                                     (GAsyncReadyCallback)atrebas_feature_layer_load_geometry_cb,
+                                     self);
     }
 }
 
@@ -123,10 +283,15 @@ atrebas_feature_layer_snapshot (GtkWidget   *widget,
 {
   AtrebasFeatureLayer *self = (AtrebasFeatureLayer *)widget;
   ShumateViewport *viewport;
+  cairo_matrix_t matrix;
+  const guint8 *data;
+  unsigned int n_rings;
+  unsigned int start, end;
   cairo_t *cr;
   int width, height;
 
-  if (!gtk_widget_get_visible (widget) ||
+  if (self->geometry == NULL ||
+      !gtk_widget_get_visible (widget) ||
       (width = gtk_widget_get_allocated_width (widget)) <= 0 ||
       (height = gtk_widget_get_allocated_height (widget)) <= 0)
     return;
@@ -135,23 +300,30 @@ atrebas_feature_layer_snapshot (GtkWidget   *widget,
                                   &GRAPHENE_RECT_INIT (0, 0, width, height));
   viewport = shumate_layer_get_viewport (SHUMATE_LAYER (self));
 
-  /* Mark out the boundaries of the feature */
-  for (unsigned int i = 0; i < self->n_points; i++)
+  /* Move the projected vertices into place for this frame */
+  data = g_bytes_get_data (self->geometry, NULL);
+  viewport_get_transform (viewport, widget, &matrix);
+  transform_points (&matrix,
+                    self->projected,
+                    self->points,
+                    atrebas_geometry_get_n_vertices (data));
+
+  /* Mark out the boundaries of each part of the feature, and its holes */
+  n_rings = atrebas_geometry_get_n_rings (data);
+
+  for (unsigned int ring = 0; ring < n_rings; ring++)
     {
-      AtrebasPoint point = self->coordinates[i];
-      double x, y;
-
-      shumate_viewport_location_to_widget_coords (viewport,
-                                                  widget,
-                                                  point.latitude,
-                                                  point.longitude,
-                                                  &x,
-                                                  &y);
-      cairo_line_to (cr, x, y);
+      atrebas_geometry_get_ring (data, ring, &start, &end);
+      cairo_new_sub_path (cr);
+
+      for (unsigned int i = start; i < end; i++)
+        cairo_line_to (cr, self->points[2 * i], self->points[2 * i + 1]);
+
+      cairo_close_path (cr);
     }
-  cairo_close_path (cr);
 
-  /* Paint the fill and border */
+  /* Paint the fill and border, leaving the holes empty */
+  cairo_set_fill_rule (cr, CAIRO_FILL_RULE_EVEN_ODD);
   gdk_cairo_set_source_rgba (cr, &self->fill_color);
   cairo_fill_preserve (cr);
 
@@ -205,6 +377,7 @@ atrebas_feature_layer_dispose (GObject *object)
   AtrebasFeatureLayer *self = ATREBAS_FEATURE_LAYER (object);
   ShumateViewport *viewport = shumate_layer_get_viewport (SHUMATE_LAYER (self));
 
+  g_cancellable_cancel (self->cancellable);
   g_signal_handlers_disconnect_by_data (viewport, self);
 
   G_OBJECT_CLASS (atrebas_feature_layer_parent_class)->dispose (object);
@@ -215,7 +388,10 @@ atrebas_feature_layer_finalize (GObject *object)
 {
   AtrebasFeatureLayer *self = ATREBAS_FEATURE_LAYER (object);
 
-  g_clear_pointer (&self->coordinates, g_free);
+  g_clear_pointer (&self->geometry, g_bytes_unref);
+  g_clear_pointer (&self->projected, g_free);
+  g_clear_pointer (&self->points, g_free);
+  g_clear_object (&self->cancellable);
   g_clear_object (&self->feature);
 
   G_OBJECT_CLASS (atrebas_feature_layer_parent_class)->finalize (object);
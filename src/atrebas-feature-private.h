@@ -0,0 +1,14 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// SPDX-FileCopyrightText: 2022 Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include "atrebas-feature.h"
+
+G_BEGIN_DECLS
+
+void   atrebas_feature_take_geometry (AtrebasFeature *feature,
+                                      GBytes         *geometry);
+
+G_END_DECLS
+
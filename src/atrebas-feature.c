@@ -10,6 +10,8 @@
 
 #include "atrebas-enums.h"
 #include "atrebas-feature.h"
+#include "atrebas-feature-private.h"
+#include "atrebas-geometry.h"
 #include "atrebas-macros.h"
 
 
@@ -29,17 +31,37 @@
  *
  * The source of these maps is in GeoJSON format, with each them of map (eg.
  * language) is a GeoJSON `FeatureCollection` and each map is a `Feature` with a
- * `Polygon` geometry. Thus #AtrebasFeature represents a single GeoJSON structure
- * with some additional properties useful for display.
+ * `Polygon` or `MultiPolygon` geometry, which may have holes. A `Polygon` that
+ * crosses the antimeridian is split into a `MultiPolygon`. Thus
+ * #AtrebasFeature represents a single GeoJSON structure with some additional
+ * properties useful for display.
+ *
+ * The #GeocodePlace:bounding-box of a feature that crosses the antimeridian
+ * wraps, with #GeocodeBoundingBox:left greater than #GeocodeBoundingBox:right;
+ * the box runs east from the left edge, across 180°, to the right edge.
+ *
+ * The geometry is held in the packed encoding described in atrebas-geometry.h,
+ * which is immutable and may be shared by reference. The GeoJSON coordinates
+ * are only decoded if requested.
+ *
+ * Features returned by a search only carry the bounding box, and the geometry
+ * may be loaded later with atrebas_backend_load_geometry().
+ *
+ * The area, vertex count and label point are computed once by #AtrebasBackend
+ * and passed to the constructor, with the label point as the location of the
+ * feature, so constructing a feature does not take a pass over its vertices.
  */
 
 struct _AtrebasFeature
 {
   GeocodePlace     parent_instance;
 
+  double           area;
   char            *color;
+  GBytes          *geometry;
   JsonArray       *coordinates;
   char            *name_fr;
+  unsigned int     n_vertices;
   char            *nld_id;
   char            *slug;
   AtrebasMapTheme  theme;
@@ -52,9 +74,12 @@ G_DEFINE_TYPE (AtrebasFeature, atrebas_feature, GEOCODE_TYPE_PLACE);
 
 enum {
   PROP_0,
+  PROP_AREA,
   PROP_COLOR,
   PROP_COORDINATES,
+  PROP_GEOMETRY,
   PROP_NAME_FR,
+  PROP_N_VERTICES,
   PROP_NLD_ID,
   PROP_SLUG,
   PROP_THEME,
@@ -70,71 +95,47 @@ static GParamSpec *properties[N_PROPERTIES] = { NULL, };
  * AtrebasFeature
  */
 static void
-atrebas_feature_set_coordinates (AtrebasFeature *self,
-                             JsonArray  *coordinates)
+atrebas_feature_set_geometry (AtrebasFeature *self,
+                              GBytes         *geometry)
 {
   g_autoptr (GeocodeBoundingBox) bounds = NULL;
   g_autoptr (GeocodeLocation) location = NULL;
-  JsonArray *polygon;
-  unsigned int n_points;
-  double max_x = 0.0;
-  double min_x = 0.0;
-  double max_y = 0.0;
-  double min_y = 0.0;
+  const guint8 *data;
+  size_t size;
+  double max_x, min_x, max_y, min_y;
   double latitude;
   double longitude;
 
   g_assert (ATREBAS_IS_FEATURE (self));
 
-  if (self->coordinates == coordinates)
+  if (self->geometry == geometry)
     return;
 
+  g_clear_pointer (&self->geometry, g_bytes_unref);
   g_clear_pointer (&self->coordinates, json_array_unref);
 
-  if (coordinates == NULL)
+  if (geometry == NULL)
     return;
 
-  self->coordinates = json_array_ref (coordinates);
-
-  /* Find the bounding box of the outermost ring */
-  polygon = json_array_get_array_element (self->coordinates, 0);
-  n_points = json_array_get_length (polygon);
+  data = g_bytes_get_data (geometry, &size);
 
-  for (unsigned int i = 0; i < n_points; i++)
+  if (!atrebas_geometry_validate (data, size))
     {
-      JsonArray *point = json_array_get_array_element (polygon, i);
-      double x = json_array_get_double_element (point, 0);
-      double y = json_array_get_double_element (point, 1);
-
-      if G_UNLIKELY (i == 0)
-        {
-          min_x = x;
-          min_y = y;
-          max_x = x;
-          max_y = y;
-        }
-      else
-        {
-          if (min_x > x)
-            min_x = x;
-
-          if (min_y > y)
-            min_y = y;
-
-          if (max_x < x)
-            max_x = x;
-
-          if (max_y < y)
-            max_y = y;
-        }
+      g_warning ("%s: invalid geometry", G_STRFUNC);
+      return;
     }
 
-  /* TODO: Take a reasonable center point */
-  latitude = min_y + (max_y - min_y) / 2;
-  longitude = min_x + (max_x - min_x) / 2;
+  self->geometry = g_bytes_ref (geometry);
+  self->n_vertices = atrebas_geometry_get_n_vertices (data);
+
+  /* The extents of the outermost rings are in the header */
+  atrebas_geometry_get_bounds (data, &min_x, &max_x, &min_y, &max_y);
+
+  /* The center of the extents stands in, until the label point is set */
+  atrebas_geometry_get_center (data, &longitude, &latitude);
 
   /* Transpose to GeocodeBoundingBox and GeocodeLocation */
-  bounds = geocode_bounding_box_new (min_y, max_y, min_x, max_x);
+  bounds = geocode_bounding_box_new (max_y, min_y, min_x, max_x);
   geocode_place_set_bounding_box (GEOCODE_PLACE (self), bounds);
 
   location = g_object_new (GEOCODE_TYPE_LOCATION,
@@ -145,6 +146,40 @@ atrebas_feature_set_coordinates (AtrebasFeature *self,
   geocode_place_set_location (GEOCODE_PLACE (self), location);
 }
 
+static void
+atrebas_feature_set_coordinates (AtrebasFeature *self,
+                                 JsonArray      *coordinates)
+{
+  g_autoptr (GBytes) geometry = NULL;
+  g_autoptr (GeocodeLocation) location = NULL;
+  const guint8 *data;
+  double latitude;
+  double longitude;
+
+  g_assert (ATREBAS_IS_FEATURE (self));
+
+  if (coordinates != NULL)
+    geometry = atrebas_geometry_encode (coordinates);
+
+  atrebas_feature_set_geometry (self, geometry);
+
+  if (self->geometry == NULL)
+    return;
+
+  /* Without a backend to store them, the derived attributes are computed here
+   * from the coordinates, which have already taken a pass to encode */
+  data = g_bytes_get_data (self->geometry, NULL);
+  self->area = atrebas_geometry_get_area (data);
+  atrebas_geometry_get_label_point (data, &longitude, &latitude);
+
+  location = g_object_new (GEOCODE_TYPE_LOCATION,
+                           "description", geocode_place_get_name (GEOCODE_PLACE (self)),
+                           "latitude",    latitude,
+                           "longitude",   longitude,
+                           NULL);
+  geocode_place_set_location (GEOCODE_PLACE (self), location);
+}
+
 /*
  * GObject
  */
@@ -154,6 +189,7 @@ atrebas_feature_finalize (GObject *object)
   AtrebasFeature *self = ATREBAS_FEATURE (object);
 
   g_clear_pointer (&self->color, g_free);
+  g_clear_pointer (&self->geometry, g_bytes_unref);
   g_clear_pointer (&self->coordinates, json_array_unref);
   g_clear_pointer (&self->name_fr, g_free);
   g_clear_pointer (&self->nld_id, g_free);
@@ -174,18 +210,30 @@ atrebas_feature_get_property (GObject    *object,
 
   switch (prop_id)
     {
+    case PROP_AREA:
+      g_value_set_double (value, self->area);
+      break;
+
     case PROP_COLOR:
       g_value_set_string (value, self->color);
       break;
 
     case PROP_COORDINATES:
-      g_value_set_boxed (value, self->coordinates);
+      g_value_set_boxed (value, atrebas_feature_get_coordinates (self));
+      break;
+
+    case PROP_GEOMETRY:
+      g_value_set_boxed (value, self->geometry);
       break;
 
     case PROP_NAME_FR:
       g_value_set_string (value, self->name_fr);
       break;
 
+    case PROP_N_VERTICES:
+      g_value_set_uint (value, self->n_vertices);
+      break;
+
     case PROP_NLD_ID:
       g_value_set_string (value, self->nld_id);
       break;
@@ -221,6 +269,12 @@ atrebas_feature_set_property (GObject      *object,
 
   switch (prop_id)
     {
+    case PROP_AREA:
+      /* Computed from the coordinates, if they are set instead */
+      if (self->area == 0.0)
+        self->area = g_value_get_double (value);
+      break;
+
     case PROP_COLOR:
       self->color = g_value_dup_string (value);
       break;
@@ -229,10 +283,19 @@ atrebas_feature_set_property (GObject      *object,
       atrebas_feature_set_coordinates (self, g_value_get_boxed (value));
       break;
 
+    case PROP_GEOMETRY:
+      atrebas_feature_set_geometry (self, g_value_get_boxed (value));
+      break;
+
     case PROP_NAME_FR:
       self->name_fr = g_value_dup_string (value);
       break;
 
+    case PROP_N_VERTICES:
+      if (self->n_vertices == 0)
+        self->n_vertices = g_value_get_uint (value);
+      break;
+
     case PROP_NLD_ID:
       self->nld_id = g_value_dup_string (value);
       break;
@@ -267,6 +330,22 @@ atrebas_feature_class_init (AtrebasFeatureClass *klass)
   object_class->get_property = atrebas_feature_get_property;
   object_class->set_property = atrebas_feature_set_property;
 
+  /**
+   * AtrebasFeature:area:
+   *
+   * The area of the feature, in square kilometres.
+   */
+  properties [PROP_AREA] =
+    g_param_spec_double ("area",
+                         "Area",
+                         "The area of the feature, in square kilometres.",
+                         0.0, G_MAXDOUBLE,
+                         0.0,
+                         (G_PARAM_READWRITE |
+                          G_PARAM_CONSTRUCT_ONLY |
+                          G_PARAM_EXPLICIT_NOTIFY |
+                          G_PARAM_STATIC_STRINGS));
+
   /**
    * AtrebasFeature:color:
    *
@@ -297,6 +376,21 @@ atrebas_feature_class_init (AtrebasFeatureClass *klass)
                          G_PARAM_EXPLICIT_NOTIFY |
                          G_PARAM_STATIC_STRINGS));
 
+  /**
+   * AtrebasFeature:geometry:
+   *
+   * The packed geometry, as encoded by atrebas_geometry_encode().
+   */
+  properties [PROP_GEOMETRY] =
+    g_param_spec_boxed ("geometry",
+                        "Geometry",
+                        "The packed geometry.",
+                        G_TYPE_BYTES,
+                        (G_PARAM_READWRITE |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_EXPLICIT_NOTIFY |
+                         G_PARAM_STATIC_STRINGS));
+
   /**
    * AtrebasFeature:name-fr:
    *
@@ -312,6 +406,22 @@ atrebas_feature_class_init (AtrebasFeatureClass *klass)
                           G_PARAM_EXPLICIT_NOTIFY |
                           G_PARAM_STATIC_STRINGS));
 
+  /**
+   * AtrebasFeature:n-vertices:
+   *
+   * The number of vertices in the geometry of the feature.
+   */
+  properties [PROP_N_VERTICES] =
+    g_param_spec_uint ("n-vertices",
+                       "Vertices",
+                       "The number of vertices in the geometry.",
+                       0, G_MAXUINT,
+                       0,
+                       (G_PARAM_READWRITE |
+                        G_PARAM_CONSTRUCT_ONLY |
+                        G_PARAM_EXPLICIT_NOTIFY |
+                        G_PARAM_STATIC_STRINGS));
+
   /**
    * AtrebasFeature:nld-id:
    *
@@ -430,6 +540,22 @@ atrebas_feature_new (const char *name,
                        NULL);
 }
 
+/**
+ * atrebas_feature_get_area:
+ * @feature: a #AtrebasFeature
+ *
+ * Get the area of @feature, less any holes. See atrebas_geometry_get_area().
+ *
+ * Returns: an area in square kilometres
+ */
+double
+atrebas_feature_get_area (AtrebasFeature *feature)
+{
+  g_return_val_if_fail (ATREBAS_IS_FEATURE (feature), 0.0);
+
+  return feature->area;
+}
+
 /**
  * atrebas_feature_get_color:
  * @feature: a #AtrebasFeature
@@ -455,14 +581,77 @@ atrebas_feature_get_color (AtrebasFeature *feature)
  *
  * Get the bounding coordinates of @feature.
  *
- * Returns: (transfer none): a #JsonArray
+ * The coordinates are decoded from the packed geometry on the first call, so
+ * prefer atrebas_feature_get_geometry() where possible.
+ *
+ * Returns: (transfer none) (nullable): a #JsonArray
  */
 JsonArray *
 atrebas_feature_get_coordinates (AtrebasFeature *feature)
+{
+  JsonArray *coordinates;
+  GBytes *geometry;
+  const guint8 *data;
+  size_t size;
+
+  g_return_val_if_fail (ATREBAS_IS_FEATURE (feature), NULL);
+
+  if ((coordinates = g_atomic_pointer_get (&feature->coordinates)) != NULL ||
+      (geometry = g_atomic_pointer_get (&feature->geometry)) == NULL)
+    return coordinates;
+
+  /* Features are shared between threads, so another caller may win */
+  data = g_bytes_get_data (geometry, &size);
+  coordinates = atrebas_geometry_to_json (data, size);
+
+  if (!g_atomic_pointer_compare_and_exchange (&feature->coordinates, NULL, coordinates))
+    {
+      g_clear_pointer (&coordinates, json_array_unref);
+      coordinates = g_atomic_pointer_get (&feature->coordinates);
+    }
+
+  return coordinates;
+}
+
+/**
+ * atrebas_feature_get_geometry:
+ * @feature: a #AtrebasFeature
+ *
+ * Get the packed geometry of @feature, as encoded by atrebas_geometry_encode().
+ *
+ * This is %NULL for features that only carry a bounding box, until the
+ * geometry is loaded with atrebas_backend_load_geometry().
+ *
+ * Returns: (transfer none) (nullable): a #GBytes
+ */
+GBytes *
+atrebas_feature_get_geometry (AtrebasFeature *feature)
 {
   g_return_val_if_fail (ATREBAS_IS_FEATURE (feature), NULL);
 
-  return feature->coordinates;
+  return g_atomic_pointer_get (&feature->geometry);
+}
+
+/*< private >
+ * atrebas_feature_take_geometry:
+ * @feature: a #AtrebasFeature
+ * @geometry: (transfer full): a #GBytes
+ *
+ * Set the packed geometry of @feature, if it does not already have one. The
+ * bounding box and location are not changed.
+ *
+ * Features are shared between threads, so if another caller wins @geometry is
+ * released and the existing geometry kept.
+ */
+void
+atrebas_feature_take_geometry (AtrebasFeature *feature,
+                               GBytes         *geometry)
+{
+  g_return_if_fail (ATREBAS_IS_FEATURE (feature));
+  g_return_if_fail (geometry != NULL);
+
+  if (!g_atomic_pointer_compare_and_exchange (&feature->geometry, NULL, geometry))
+    g_bytes_unref (geometry);
 }
 
 /**
@@ -487,6 +676,23 @@ atrebas_feature_get_name_fr (AtrebasFeature *feature)
   return feature->name_fr;
 }
 
+/**
+ * atrebas_feature_get_n_vertices:
+ * @feature: a #AtrebasFeature
+ *
+ * Get the number of vertices in the geometry of @feature. This is known even if
+ * the geometry has not been loaded.
+ *
+ * Returns: a vertex count
+ */
+unsigned int
+atrebas_feature_get_n_vertices (AtrebasFeature *feature)
+{
+  g_return_val_if_fail (ATREBAS_IS_FEATURE (feature), 0);
+
+  return feature->n_vertices;
+}
+
 /**
  * atrebas_feature_get_nld_id:
  * @feature: a #AtrebasFeature
@@ -580,6 +786,9 @@ atrebas_feature_get_uri_fr (AtrebasFeature *feature)
  *
  * Check whether @feature1 and @feature2 represent the same feature.
  *
+ * Features returned by #AtrebasBackend are interned by ID, so this is usually
+ * a pointer comparison.
+ *
  * Returns: %TRUE if equal, %FALSE otherwise
  */
 gboolean
@@ -621,11 +830,10 @@ atrebas_feature_hash (gconstpointer feature)
  * @longitude: an east-west position
  *
  * Check if the point at @latitude and @longitude is inside the boundaries of
- * @feature.
+ * @feature. See atrebas_geometry_contains_point().
  *
- * Based on "pnpoly":
- *     Copyright 1994-2006 W Randolph Franklin (WRF)
- *     https://wrf.ecse.rpi.edu/Research/Short_Notes/pnpoly.html
+ * The geometry of @feature must be loaded; a summary from a search has none
+ * until atrebas_backend_load_geometry() completes.
  *
  * Returns: %TRUE if inside, %FALSE if not
  */
@@ -634,32 +842,16 @@ atrebas_feature_contains_point (AtrebasFeature *feature,
                             double      latitude,
                             double      longitude)
 {
-  gboolean ret = FALSE;
-  JsonArray *polygon;
-  unsigned int n_vertices = 0;
+  GBytes *geometry;
 
   g_return_val_if_fail (ATREBAS_IS_FEATURE (feature), FALSE);
-  g_return_val_if_fail (feature->coordinates != NULL, FALSE);
 
-  polygon = json_array_get_array_element (feature->coordinates, 0);
-  n_vertices = json_array_get_length (polygon);
+  geometry = g_atomic_pointer_get (&feature->geometry);
+  g_return_val_if_fail (geometry != NULL, FALSE);
 
-  for (unsigned int i = 0, j = n_vertices - 1; i < n_vertices; j = i++)
-    {
-      JsonArray *next = json_array_get_array_element (polygon, i);
-      double nextx = json_array_get_double_element (next, 0);
-      double nexty = json_array_get_double_element (next, 1);
-
-      JsonArray *prev = json_array_get_array_element (polygon, j);
-      double prevx = json_array_get_double_element (prev, 0);
-      double prevy = json_array_get_double_element (prev, 1);
-
-      if ((nexty > latitude) != (prevy > latitude) &&
-          (longitude < (prevx - nextx) * (latitude - nexty) / (prevy - nexty) + nextx))
-       ret = !ret;
-    }
-
-  return ret;
+  return atrebas_geometry_contains_point (g_bytes_get_data (geometry, NULL),
+                                          longitude,
+                                          latitude);
 }
 
 /**
@@ -668,19 +860,34 @@ atrebas_feature_contains_point (AtrebasFeature *feature,
  *
  * Serialize @feature into a GeoJSON `Feature` node.
  *
- * Returns: (transfer full): a #JsonNode
+ * The geometry of @feature must be loaded; a summary from a search can't be
+ * serialized until atrebas_backend_load_geometry() completes.
+ *
+ * Returns: (transfer full) (nullable): a #JsonNode, or %NULL if the geometry
+ *   is not loaded
  */
 JsonNode *
 atrebas_feature_serialize (AtrebasFeature *feature)
 {
   GeocodePlace *place = GEOCODE_PLACE (feature);
   g_autoptr (JsonBuilder) builder = NULL;
+  JsonArray *array;
   JsonNode *coordinates;
+  GBytes *geometry;
+  const char *type = "Polygon";
 
   g_return_val_if_fail (ATREBAS_IS_FEATURE (feature), NULL);
 
+  if ((array = atrebas_feature_get_coordinates (feature)) == NULL)
+    return NULL;
+
+  /* A geometry with more than one part is a multipolygon */
+  if ((geometry = g_atomic_pointer_get (&feature->geometry)) != NULL &&
+      atrebas_geometry_get_n_parts (g_bytes_get_data (geometry, NULL)) > 1)
+    type = "MultiPolygon";
+
   builder = json_builder_new ();
-  coordinates = json_node_init_array (json_node_alloc (), feature->coordinates);
+  coordinates = json_node_init_array (json_node_alloc (), array);
 
   /* BEGIN / FeatureCollection / features / [Feature] */
   json_builder_begin_object (builder);
@@ -716,7 +923,7 @@ atrebas_feature_serialize (AtrebasFeature *feature)
   json_builder_begin_object (builder);
 
   json_builder_set_member_name (builder, "type");
-  json_builder_add_string_value (builder, "Polygon");
+  json_builder_add_string_value (builder, type);
   json_builder_set_member_name (builder, "coordinates");
   json_builder_add_value (builder, coordinates);
 
@@ -45,12 +45,15 @@ G_DECLARE_FINAL_TYPE (AtrebasFeature, atrebas_feature, ATREBAS, FEATURE, Geocode
 AtrebasFeature  * atrebas_feature_new             (const char      *name,
                                                    const char      *uri,
                                                    JsonArray       *coordinates);
+double            atrebas_feature_get_area        (AtrebasFeature  *feature);
 const char      * atrebas_feature_get_name_fr     (AtrebasFeature  *feature);
+unsigned int      atrebas_feature_get_n_vertices  (AtrebasFeature  *feature);
 const char      * atrebas_feature_get_nld_id      (AtrebasFeature  *feature);
 const char      * atrebas_feature_get_uri         (AtrebasFeature  *feature);
 const char      * atrebas_feature_get_uri_fr      (AtrebasFeature  *feature);
 const char      * atrebas_feature_get_color       (AtrebasFeature  *feature);
 JsonArray       * atrebas_feature_get_coordinates (AtrebasFeature  *feature);
+GBytes          * atrebas_feature_get_geometry    (AtrebasFeature  *feature);
 const char      * atrebas_feature_get_slug        (AtrebasFeature  *feature);
 AtrebasMapTheme   atrebas_feature_get_theme       (AtrebasFeature  *feature);
 
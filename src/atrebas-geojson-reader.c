@@ -0,0 +1,1188 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// SPDX-FileCopyrightText: 2022 Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#define G_LOG_DOMAIN "atrebas-geojson-reader"
+
+#include "config.h"
+
+#include <math.h>
+
+#include <geocode-glib/geocode-glib.h>
+#include <gio/gio.h>
+
+#include "atrebas-geojson-reader.h"
+#include "atrebas-geometry.h"
+
+
+/**
+ * SECTION:atrebasgeojsonreader
+ * @short_description: A streaming GeoJSON reader
+ * @title: AtrebasGeojsonReader
+ * @stability: Unstable
+ * @include: atrebas.h
+ *
+ * #AtrebasGeojsonReader reads the features of a GeoJSON `FeatureCollection`
+ * from a #GInputStream one at a time, without building a document tree. A
+ * bare array of features, as returned by the <native-land.ca> API, is also
+ * accepted.
+ *
+ * The `coordinates` of each `Polygon` or `MultiPolygon` are read directly into a packed
+ * geometry (see atrebas_geometry_encode()), and the string members of the
+ * `properties` are kept until the next feature is read, so memory use is
+ * bounded by the largest feature rather than the size of the document.
+ */
+
+#define READER_BUFFER_SIZE  8192
+#define READER_MAX_DEPTH    64
+#define NUMBER_MAX_LENGTH   64
+
+typedef enum
+{
+  READER_STATE_START,
+  READER_STATE_FEATURES,
+  READER_STATE_END,
+} ReaderState;
+
+struct _AtrebasGeojsonReader
+{
+  GInputStream           *stream;
+  GCancellable           *cancellable;
+  guint8                  buffer[READER_BUFFER_SIZE];
+  size_t                  position;
+  size_t                  length;
+  unsigned int            line;
+
+  ReaderState             state;
+  unsigned int            n_members;
+  unsigned int            n_features;
+  unsigned int            collection : 1;
+  unsigned int            collection_type : 1;
+
+  /* Scratch buffers */
+  GString                *key;
+  GString                *value;
+
+  /* The current feature */
+  char                   *id;
+  char                   *geometry_type;
+  unsigned int            position_depth;
+  GHashTable             *properties;
+  AtrebasGeometryBuilder *builder;
+  GBytes                 *geometry;
+};
+
+
+/*
+ * Tokenizer
+ */
+static gboolean
+reader_error (AtrebasGeojsonReader  *self,
+              GError               **error,
+              const char            *message)
+{
+  g_set_error (error,
+               GEOCODE_ERROR,
+               GEOCODE_ERROR_PARSE,
+               "%u: %s", self->line, message);
+  return FALSE;
+}
+
+static inline gboolean
+reader_fill (AtrebasGeojsonReader  *self,
+             GError               **error)
+{
+  gssize n_read;
+
+  if G_LIKELY (self->position < self->length)
+    return TRUE;
+
+  n_read = g_input_stream_read (self->stream,
+                                self->buffer,
+                                sizeof (self->buffer),
+                                self->cancellable,
+                                error);
+
+  if (n_read < 0)
+    return FALSE;
+
+  self->position = 0;
+  self->length = n_read;
+
+  return TRUE;
+}
+
+static inline gboolean
+reader_getc (AtrebasGeojsonReader  *self,
+             char                  *c,
+             GError               **error)
+{
+  if (!reader_fill (self, error))
+    return FALSE;
+
+  if G_UNLIKELY (self->position >= self->length)
+    return reader_error (self, error, "Unexpected end of data");
+
+  *c = self->buffer[self->position++];
+
+  return TRUE;
+}
+
+/* Skip whitespace and return the next character, without consuming it. At the
+ * end of the stream, @c is set to `\0`. */
+static inline gboolean
+reader_peek (AtrebasGeojsonReader  *self,
+             char                  *c,
+             GError               **error)
+{
+  while (reader_fill (self, error))
+    {
+      if (self->position >= self->length)
+        {
+          *c = '\0';
+          return TRUE;
+        }
+
+      switch (self->buffer[self->position])
+        {
+        case '\n':
+          self->line++;
+          /* fall through */
+        case ' ':
+        case '\t':
+        case '\r':
+          self->position++;
+          break;
+
+        default:
+          *c = self->buffer[self->position];
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+static inline gboolean
+reader_expect (AtrebasGeojsonReader  *self,
+               char                   expected,
+               GError               **error)
+{
+  char c;
+
+  if (!reader_peek (self, &c, error))
+    return FALSE;
+
+  if (c != expected)
+    {
+      g_set_error (error,
+                   GEOCODE_ERROR,
+                   GEOCODE_ERROR_PARSE,
+                   "%u: Expected '%c'", self->line, expected);
+      return FALSE;
+    }
+
+  self->position++;
+
+  return TRUE;
+}
+
+static gboolean
+reader_read_literal (AtrebasGeojsonReader  *self,
+                     const char            *literal,
+                     GError               **error)
+{
+  char c;
+
+  for (const char *p = literal; *p != '\0'; p++)
+    {
+      if (!reader_getc (self, &c, error))
+        return FALSE;
+
+      if (c != *p)
+        return reader_error (self, error, "Unexpected literal");
+    }
+
+  return TRUE;
+}
+
+static gboolean
+reader_read_number (AtrebasGeojsonReader  *self,
+                    double                *value,
+                    GError               **error)
+{
+  char buf[NUMBER_MAX_LENGTH + 1];
+  size_t len = 0;
+  char *end = NULL;
+
+  while (TRUE)
+    {
+      char c;
+
+      if (!reader_fill (self, error))
+        return FALSE;
+
+      if (self->position >= self->length)
+        break;
+
+      c = self->buffer[self->position];
+
+      if (!g_ascii_isdigit (c) && c != '-' && c != '+' && c != '.' &&
+          c != 'e' && c != 'E')
+        break;
+
+      if (len == NUMBER_MAX_LENGTH)
+        return reader_error (self, error, "Invalid number");
+
+      buf[len++] = c;
+      self->position++;
+    }
+
+  buf[len] = '\0';
+  *value = g_ascii_strtod (buf, &end);
+
+  if (len == 0 || *end != '\0')
+    return reader_error (self, error, "Invalid number");
+
+  g_string_assign (self->value, buf);
+
+  return TRUE;
+}
+
+static gboolean
+reader_read_hex4 (AtrebasGeojsonReader  *self,
+                  gunichar              *value,
+                  GError               **error)
+{
+  *value = 0;
+
+  for (unsigned int i = 0; i < 4; i++)
+    {
+      char c;
+      int digit;
+
+      if (!reader_getc (self, &c, error))
+        return FALSE;
+
+      if ((digit = g_ascii_xdigit_value (c)) == -1)
+        return reader_error (self, error, "Invalid unicode escape");
+
+      *value = (*value << 4) | digit;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+reader_read_escape (AtrebasGeojsonReader  *self,
+                    GString               *out,
+                    GError               **error)
+{
+  gunichar unit, low;
+  char c;
+
+  if (!reader_getc (self, &c, error))
+    return FALSE;
+
+  switch (c)
+    {
+    case '"':
+    case '\\':
+    case '/':
+      break;
+
+    case 'b':
+      c = '\b';
+      break;
+
+    case 'f':
+      c = '\f';
+      break;
+
+    case 'n':
+      c = '\n';
+      break;
+
+    case 'r':
+      c = '\r';
+      break;
+
+    case 't':
+      c = '\t';
+      break;
+
+    case 'u':
+      if (!reader_read_hex4 (self, &unit, error))
+        return FALSE;
+
+      /* Combine a surrogate pair, or replace a lone surrogate */
+      if (unit >= 0xD800 && unit <= 0xDBFF)
+        {
+          if (!reader_expect (self, '\\', error) ||
+              !reader_expect (self, 'u', error) ||
+              !reader_read_hex4 (self, &low, error))
+            return FALSE;
+
+          if (low >= 0xDC00 && low <= 0xDFFF)
+            unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+          else
+            unit = 0xFFFD;
+        }
+      else if (unit >= 0xDC00 && unit <= 0xDFFF)
+        {
+          unit = 0xFFFD;
+        }
+
+      if (out != NULL)
+        g_string_append_unichar (out, unit);
+      return TRUE;
+
+    default:
+      return reader_error (self, error, "Invalid escape sequence");
+    }
+
+  if (out != NULL)
+    g_string_append_c (out, c);
+
+  return TRUE;
+}
+
+/* Read a string into @out, or discard it if @out is %NULL */
+static gboolean
+reader_read_string (AtrebasGeojsonReader  *self,
+                    GString               *out,
+                    GError               **error)
+{
+  if (!reader_expect (self, '"', error))
+    return FALSE;
+
+  if (out != NULL)
+    g_string_truncate (out, 0);
+
+  while (reader_fill (self, error))
+    {
+      const guint8 *start = self->buffer + self->position;
+      const guint8 *end = self->buffer + self->length;
+      const guint8 *p = start;
+      char c;
+
+      if (start == end)
+        return reader_error (self, error, "Unexpected end of data");
+
+      /* Copy unescaped runs directly from the buffer */
+      while (p < end && *p != '"' && *p != '\\' && *p >= 0x20)
+        p++;
+
+      if (out != NULL)
+        g_string_append_len (out, (const char *)start, p - start);
+      self->position += p - start;
+
+      if (p == end)
+        continue;
+
+      c = self->buffer[self->position++];
+
+      if (c == '"')
+        {
+          if (out != NULL && !g_utf8_validate_len (out->str, out->len, NULL))
+            return reader_error (self, error, "Invalid UTF-8 in string");
+
+          return TRUE;
+        }
+
+      if (c != '\\')
+        return reader_error (self, error, "Control character in string");
+
+      if (!reader_read_escape (self, out, error))
+        return FALSE;
+    }
+
+  return FALSE;
+}
+
+/* Advance to the next member of an object, after the opening brace has been
+ * consumed, reading its name into the key buffer. */
+static gboolean
+reader_next_member (AtrebasGeojsonReader  *self,
+                    unsigned int          *n_members,
+                    gboolean              *has_member,
+                    GError               **error)
+{
+  char c;
+
+  if (!reader_peek (self, &c, error))
+    return FALSE;
+
+  if (c == '}')
+    {
+      self->position++;
+      *has_member = FALSE;
+      return TRUE;
+    }
+
+  if (*n_members > 0)
+    {
+      if (c != ',')
+        return reader_error (self, error, "Expected ',' or '}'");
+
+      self->position++;
+    }
+
+  if (!reader_read_string (self, self->key, error) ||
+      !reader_expect (self, ':', error))
+    return FALSE;
+
+  *n_members += 1;
+  *has_member = TRUE;
+
+  return TRUE;
+}
+
+/* Advance to the next element of an array, after the opening bracket has been
+ * consumed. */
+static gboolean
+reader_next_element (AtrebasGeojsonReader  *self,
+                     unsigned int          *n_elements,
+                     gboolean              *has_element,
+                     GError               **error)
+{
+  char c;
+
+  if (!reader_peek (self, &c, error))
+    return FALSE;
+
+  if (c == ']')
+    {
+      self->position++;
+      *has_element = FALSE;
+      return TRUE;
+    }
+
+  if (*n_elements > 0)
+    {
+      if (c != ',')
+        return reader_error (self, error, "Expected ',' or ']'");
+
+      self->position++;
+    }
+
+  *n_elements += 1;
+  *has_element = TRUE;
+
+  return TRUE;
+}
+
+static gboolean
+reader_skip_value (AtrebasGeojsonReader  *self,
+                   unsigned int           depth,
+                   GError               **error)
+{
+  unsigned int n = 0;
+  gboolean has_next = FALSE;
+  double number;
+  char c;
+
+  if (depth > READER_MAX_DEPTH)
+    return reader_error (self, error, "Maximum nesting depth exceeded");
+
+  if (!reader_peek (self, &c, error))
+    return FALSE;
+
+  switch (c)
+    {
+    case '{':
+      self->position++;
+
+      while (TRUE)
+        {
+          if (!reader_next_member (self, &n, &has_next, error))
+            return FALSE;
+
+          if (!has_next)
+            break;
+
+          if (!reader_skip_value (self, depth + 1, error))
+            return FALSE;
+        }
+
+      return TRUE;
+
+    case '[':
+      self->position++;
+
+      while (TRUE)
+        {
+          if (!reader_next_element (self, &n, &has_next, error))
+            return FALSE;
+
+          if (!has_next)
+            break;
+
+          if (!reader_skip_value (self, depth + 1, error))
+            return FALSE;
+        }
+
+      return TRUE;
+
+    case '"':
+      return reader_read_string (self, NULL, error);
+
+    case 't':
+      return reader_read_literal (self, "true", error);
+
+    case 'f':
+      return reader_read_literal (self, "false", error);
+
+    case 'n':
+      return reader_read_literal (self, "null", error);
+
+    case '\0':
+      return reader_error (self, error, "Unexpected end of data");
+
+    default:
+      if (c == '-' || g_ascii_isdigit (c))
+        return reader_read_number (self, &number, error);
+
+      return reader_error (self, error, "Unexpected character");
+    }
+}
+
+
+/*
+ * GeoJSON
+ */
+/*
+ * Read an array of the `coordinates` of a `Polygon` or `MultiPolygon` into the
+ * geometry builder, @depth arrays below the `coordinates` member.
+ *
+ * The `type` member may follow the `coordinates`, so the depth of the positions
+ * is taken from the first one: two for a `Polygon`, or three for the rings in
+ * the polygons of a `MultiPolygon`. The part and ring holding the first
+ * position are started when it is read, and any later ones when they open.
+ */
+static gboolean
+reader_read_coordinates_array (AtrebasGeojsonReader  *self,
+                               unsigned int           depth,
+                               gboolean              *valid,
+                               GError               **error)
+{
+  double xy[2] = { 0.0, 0.0 };
+  unsigned int n = 0;
+  gboolean has_next = FALSE;
+  gboolean is_position = FALSE;
+  char c;
+
+  if (!reader_expect (self, '[', error))
+    return FALSE;
+
+  if (self->position_depth > 0 && depth + 1 == self->position_depth)
+    atrebas_geometry_builder_add_ring (self->builder);
+  else if (self->position_depth == 3 && depth == 1)
+    atrebas_geometry_builder_add_part (self->builder);
+
+  while (TRUE)
+    {
+      if (!reader_next_element (self, &n, &has_next, error))
+        return FALSE;
+
+      if (!has_next)
+        break;
+
+      if (!reader_peek (self, &c, error))
+        return FALSE;
+
+      /* An array of numbers is a position */
+      if (n == 1)
+        is_position = (c == '-' || g_ascii_isdigit (c));
+
+      /* Any coordinates beyond the longitude and latitude are discarded */
+      if (is_position && (c == '-' || g_ascii_isdigit (c)))
+        {
+          double value;
+
+          if (!reader_read_number (self, &value, error))
+            return FALSE;
+
+          if (n <= 2)
+            xy[n - 1] = value;
+
+          if (!isfinite (value))
+            *valid = FALSE;
+        }
+      else if (!is_position && c == '[' && depth < 3)
+        {
+          if (!reader_read_coordinates_array (self, depth + 1, valid, error))
+            return FALSE;
+        }
+      else
+        {
+          if (!reader_skip_value (self, depth + 2, error))
+            return FALSE;
+
+          *valid = FALSE;
+        }
+    }
+
+  if (!is_position)
+    return TRUE;
+
+  if (self->position_depth == 0 && (depth == 2 || depth == 3))
+    {
+      self->position_depth = depth;
+
+      if (depth == 3)
+        atrebas_geometry_builder_add_part (self->builder);
+
+      atrebas_geometry_builder_add_ring (self->builder);
+    }
+
+  if (depth != self->position_depth || n < 2)
+    *valid = FALSE;
+
+  if (*valid)
+    atrebas_geometry_builder_add_vertex (self->builder, xy[0], xy[1]);
+
+  return TRUE;
+}
+
+/* Read the `coordinates` of a `Polygon` or `MultiPolygon` straight into the
+ * geometry builder */
+static gboolean
+reader_read_coordinates (AtrebasGeojsonReader  *self,
+                         GError               **error)
+{
+  gboolean valid = TRUE;
+  char c;
+
+  g_clear_pointer (&self->geometry, g_bytes_unref);
+  atrebas_geometry_builder_reset (self->builder);
+  self->position_depth = 0;
+
+  if (!reader_peek (self, &c, error))
+    return FALSE;
+
+  if (c != '[')
+    return reader_skip_value (self, 2, error);
+
+  if (!reader_read_coordinates_array (self, 0, &valid, error))
+    return FALSE;
+
+  if (valid)
+    self->geometry = atrebas_geometry_builder_end (self->builder);
+  else
+    atrebas_geometry_builder_reset (self->builder);
+
+  return TRUE;
+}
+
+static gboolean
+reader_read_nullable_string (AtrebasGeojsonReader  *self,
+                             char                 **out,
+                             GError               **error)
+{
+  char c;
+
+  g_clear_pointer (out, g_free);
+
+  if (!reader_peek (self, &c, error))
+    return FALSE;
+
+  if (c != '"')
+    return reader_skip_value (self, 1, error);
+
+  if (!reader_read_string (self, self->value, error))
+    return FALSE;
+
+  *out = g_strndup (self->value->str, self->value->len);
+
+  return TRUE;
+}
+
+static gboolean
+reader_read_id (AtrebasGeojsonReader  *self,
+                GError               **error)
+{
+  double number;
+  char c;
+
+  if (!reader_peek (self, &c, error))
+    return FALSE;
+
+  /* Numeric identifiers are kept as written */
+  if (c == '-' || g_ascii_isdigit (c))
+    {
+      if (!reader_read_number (self, &number, error))
+        return FALSE;
+
+      g_clear_pointer (&self->id, g_free);
+      self->id = g_strndup (self->value->str, self->value->len);
+
+      return TRUE;
+    }
+
+  return reader_read_nullable_string (self, &self->id, error);
+}
+
+static gboolean
+reader_read_properties (AtrebasGeojsonReader  *self,
+                        GError               **error)
+{
+  unsigned int n = 0;
+  gboolean has_next = FALSE;
+  char c;
+
+  if (!reader_peek (self, &c, error))
+    return FALSE;
+
+  if (c != '{')
+    return reader_skip_value (self, 1, error);
+
+  self->position++;
+
+  while (TRUE)
+    {
+      if (!reader_next_member (self, &n, &has_next, error))
+        return FALSE;
+
+      if (!has_next)
+        break;
+
+      if (!reader_peek (self, &c, error))
+        return FALSE;
+
+      /* Only string members are kept */
+      if (c != '"')
+        {
+          if (!reader_skip_value (self, 2, error))
+            return FALSE;
+
+          continue;
+        }
+
+      if (!reader_read_string (self, self->value, error))
+        return FALSE;
+
+      g_hash_table_replace (self->properties,
+                            g_strndup (self->key->str, self->key->len),
+                            g_strndup (self->value->str, self->value->len));
+    }
+
+  return TRUE;
+}
+
+static gboolean
+reader_read_geometry (AtrebasGeojsonReader  *self,
+                      GError               **error)
+{
+  unsigned int n = 0;
+  gboolean has_next = FALSE;
+  char c;
+
+  if (!reader_peek (self, &c, error))
+    return FALSE;
+
+  if (c != '{')
+    return reader_skip_value (self, 1, error);
+
+  self->position++;
+
+  while (TRUE)
+    {
+      gboolean ret;
+
+      if (!reader_next_member (self, &n, &has_next, error))
+        return FALSE;
+
+      if (!has_next)
+        break;
+
+      if (g_str_equal (self->key->str, "type"))
+        ret = reader_read_nullable_string (self, &self->geometry_type, error);
+      else if (g_str_equal (self->key->str, "coordinates"))
+        ret = reader_read_coordinates (self, error);
+      else
+        ret = reader_skip_value (self, 2, error);
+
+      if (!ret)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+reader_read_feature (AtrebasGeojsonReader  *self,
+                     GError               **error)
+{
+  unsigned int n = 0;
+  gboolean has_next = FALSE;
+
+  g_clear_pointer (&self->id, g_free);
+  g_clear_pointer (&self->geometry_type, g_free);
+  g_clear_pointer (&self->geometry, g_bytes_unref);
+  g_hash_table_remove_all (self->properties);
+  self->position_depth = 0;
+
+  if (!reader_expect (self, '{', error))
+    return FALSE;
+
+  while (TRUE)
+    {
+      gboolean ret;
+
+      if (!reader_next_member (self, &n, &has_next, error))
+        return FALSE;
+
+      if (!has_next)
+        break;
+
+      if (g_str_equal (self->key->str, "id"))
+        ret = reader_read_id (self, error);
+      else if (g_str_equal (self->key->str, "properties"))
+        ret = reader_read_properties (self, error);
+      else if (g_str_equal (self->key->str, "geometry"))
+        ret = reader_read_geometry (self, error);
+      else
+        ret = reader_skip_value (self, 1, error);
+
+      if (!ret)
+        return FALSE;
+    }
+
+  /* Only polygons are currently supported, with positions nested to match */
+  if (!(g_strcmp0 (self->geometry_type, "Polygon") == 0 && self->position_depth == 2) &&
+      !(g_strcmp0 (self->geometry_type, "MultiPolygon") == 0 && self->position_depth == 3))
+    g_clear_pointer (&self->geometry, g_bytes_unref);
+
+  return TRUE;
+}
+
+static gboolean
+reader_read_collection_type (AtrebasGeojsonReader  *self,
+                             GError               **error)
+{
+  char c;
+
+  if (!reader_peek (self, &c, error))
+    return FALSE;
+
+  if (c != '"' ||
+      !reader_read_string (self, self->value, error) ||
+      !g_str_equal (self->value->str, "FeatureCollection"))
+    return reader_error (self, error, "Unsupported GeoJSON file");
+
+  self->collection_type = TRUE;
+
+  return TRUE;
+}
+
+/* Read up to the first element of the `features` array */
+static gboolean
+reader_read_start (AtrebasGeojsonReader  *self,
+                   GError               **error)
+{
+  gboolean has_next = FALSE;
+  char c;
+
+  if (!reader_peek (self, &c, error))
+    return FALSE;
+
+  /* A bare array of features */
+  if (c == '[')
+    {
+      self->position++;
+      self->state = READER_STATE_FEATURES;
+      return TRUE;
+    }
+
+  if (c != '{')
+    return reader_error (self, error, "Unsupported GeoJSON file");
+
+  self->position++;
+  self->collection = TRUE;
+
+  while (TRUE)
+    {
+      if (!reader_next_member (self, &self->n_members, &has_next, error))
+        return FALSE;
+
+      if (!has_next)
+        break;
+
+      if (g_str_equal (self->key->str, "type"))
+        {
+          if (!reader_read_collection_type (self, error))
+            return FALSE;
+        }
+      else if (g_str_equal (self->key->str, "features"))
+        {
+          if (!reader_expect (self, '[', error))
+            return FALSE;
+
+          self->state = READER_STATE_FEATURES;
+          return TRUE;
+        }
+      else if (!reader_skip_value (self, 1, error))
+        {
+          return FALSE;
+        }
+    }
+
+  return reader_error (self, error, "Unsupported GeoJSON file");
+}
+
+/* Read the remainder of the document, after the `features` array */
+static gboolean
+reader_read_end (AtrebasGeojsonReader  *self,
+                 GError               **error)
+{
+  gboolean has_next = FALSE;
+  char c;
+
+  self->state = READER_STATE_END;
+
+  if (self->collection)
+    {
+      while (TRUE)
+        {
+          gboolean ret;
+
+          if (!reader_next_member (self, &self->n_members, &has_next, error))
+            return FALSE;
+
+          if (!has_next)
+            break;
+
+          if (g_str_equal (self->key->str, "type"))
+            ret = reader_read_collection_type (self, error);
+          else
+            ret = reader_skip_value (self, 1, error);
+
+          if (!ret)
+            return FALSE;
+        }
+
+      if (!self->collection_type)
+        return reader_error (self, error, "Unsupported GeoJSON file");
+    }
+
+  if (!reader_peek (self, &c, error))
+    return FALSE;
+
+  if (c != '\0')
+    return reader_error (self, error, "Unexpected data after document");
+
+  return TRUE;
+}
+
+static gboolean
+reader_read_next (AtrebasGeojsonReader  *self,
+                  GError               **error)
+{
+  gboolean has_next = FALSE;
+  char c;
+
+  if (self->state == READER_STATE_START && !reader_read_start (self, error))
+    return FALSE;
+
+  if (self->state == READER_STATE_END)
+    return FALSE;
+
+  if (!reader_next_element (self, &self->n_features, &has_next, error))
+    return FALSE;
+
+  if (!has_next)
+    {
+      reader_read_end (self, error);
+      return FALSE;
+    }
+
+  if (!reader_peek (self, &c, error))
+    return FALSE;
+
+  if (c != '{')
+    {
+      g_set_error (error,
+                   GEOCODE_ERROR,
+                   GEOCODE_ERROR_PARSE,
+                   "Unsupported GeoJSON feature at index %u",
+                   self->n_features - 1);
+      return FALSE;
+    }
+
+  return reader_read_feature (self, error);
+}
+
+
+/**
+ * atrebas_geojson_reader_new:
+ * @stream: a #GInputStream
+ *
+ * Create a new reader for the GeoJSON document in @stream.
+ *
+ * Returns: (transfer full): a new #AtrebasGeojsonReader
+ */
+AtrebasGeojsonReader *
+atrebas_geojson_reader_new (GInputStream *stream)
+{
+  AtrebasGeojsonReader *reader;
+
+  g_return_val_if_fail (G_IS_INPUT_STREAM (stream), NULL);
+
+  reader = g_new0 (AtrebasGeojsonReader, 1);
+  reader->stream = g_object_ref (stream);
+  reader->line = 1;
+  reader->state = READER_STATE_START;
+  reader->key = g_string_new (NULL);
+  reader->value = g_string_new (NULL);
+  reader->properties = g_hash_table_new_full (g_str_hash,
+                                              g_str_equal,
+                                              g_free,
+                                              g_free);
+  reader->builder = atrebas_geometry_builder_new ();
+
+  return reader;
+}
+
+/**
+ * atrebas_geojson_reader_free:
+ * @reader: (transfer full): a #AtrebasGeojsonReader
+ *
+ * Free @reader. The underlying stream is not closed.
+ */
+void
+atrebas_geojson_reader_free (AtrebasGeojsonReader *reader)
+{
+  g_return_if_fail (reader != NULL);
+
+  g_clear_object (&reader->stream);
+  g_string_free (reader->key, TRUE);
+  g_string_free (reader->value, TRUE);
+  g_clear_pointer (&reader->id, g_free);
+  g_clear_pointer (&reader->geometry_type, g_free);
+  g_clear_pointer (&reader->properties, g_hash_table_unref);
+  g_clear_pointer (&reader->builder, atrebas_geometry_builder_free);
+  g_clear_pointer (&reader->geometry, g_bytes_unref);
+  g_free (reader);
+}
+
+/**
+ * atrebas_geojson_reader_next:
+ * @reader: a #AtrebasGeojsonReader
+ * @cancellable: (nullable): a #GCancellable
+ * @error: (nullable): a #GError
+ *
+ * Read the next feature from the stream, replacing the current feature.
+ *
+ * If the end of the document is reached, this function returns %FALSE without
+ * setting @error. If the document is malformed, or an element of `features` is
+ * not an object, @error is set to %GEOCODE_ERROR_PARSE.
+ *
+ * Returns: %TRUE if a feature was read, %FALSE otherwise
+ */
+gboolean
+atrebas_geojson_reader_next (AtrebasGeojsonReader  *reader,
+                             GCancellable          *cancellable,
+                             GError               **error)
+{
+  gboolean ret;
+
+  g_return_val_if_fail (reader != NULL, FALSE);
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  reader->cancellable = cancellable;
+  ret = reader_read_next (reader, error);
+  reader->cancellable = NULL;
+
+  if (!ret)
+    reader->state = READER_STATE_END;
+
+  return ret;
+}
+
+/**
+ * atrebas_geojson_reader_get_index:
+ * @reader: a #AtrebasGeojsonReader
+ *
+ * Get the position of the current feature in the `features` array.
+ *
+ * Returns: an index
+ */
+unsigned int
+atrebas_geojson_reader_get_index (AtrebasGeojsonReader *reader)
+{
+  g_return_val_if_fail (reader != NULL, 0);
+
+  return reader->n_features > 0 ? reader->n_features - 1 : 0;
+}
+
+/**
+ * atrebas_geojson_reader_get_id:
+ * @reader: a #AtrebasGeojsonReader
+ *
+ * Get the `id` of the current feature.
+ *
+ * Returns: (nullable): a feature ID
+ */
+const char *
+atrebas_geojson_reader_get_id (AtrebasGeojsonReader *reader)
+{
+  g_return_val_if_fail (reader != NULL, NULL);
+
+  return reader->id;
+}
+
+/**
+ * atrebas_geojson_reader_get_property:
+ * @reader: a #AtrebasGeojsonReader
+ * @name: a property name
+ *
+ * Get the member @name of the `properties` of the current feature. Only string
+ * members are available.
+ *
+ * Returns: (nullable): a string value
+ */
+const char *
+atrebas_geojson_reader_get_property (AtrebasGeojsonReader *reader,
+                                     const char           *name)
+{
+  g_return_val_if_fail (reader != NULL, NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+
+  return g_hash_table_lookup (reader->properties, name);
+}
+
+/**
+ * atrebas_geojson_reader_get_geometry_type:
+ * @reader: a #AtrebasGeojsonReader
+ *
+ * Get the `type` of the geometry of the current feature (eg. `Polygon`).
+ *
+ * Returns: (nullable): a geometry type
+ */
+const char *
+atrebas_geojson_reader_get_geometry_type (AtrebasGeojsonReader *reader)
+{
+  g_return_val_if_fail (reader != NULL, NULL);
+
+  return reader->geometry_type;
+}
+
+/**
+ * atrebas_geojson_reader_get_geometry:
+ * @reader: a #AtrebasGeojsonReader
+ *
+ * Get the packed geometry of the current feature. This is %NULL if the
+ * geometry is not a `Polygon` or `MultiPolygon`, or the `coordinates` are
+ * invalid.
+ *
+ * Returns: (transfer none) (nullable): the encoded geometry
+ */
+GBytes *
+atrebas_geojson_reader_get_geometry (AtrebasGeojsonReader *reader)
+{
+  g_return_val_if_fail (reader != NULL, NULL);
+
+  return reader->geometry;
+}
+
@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// SPDX-FileCopyrightText: 2022 Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _AtrebasGeojsonReader AtrebasGeojsonReader;
+
+AtrebasGeojsonReader * atrebas_geojson_reader_new               (GInputStream          *stream);
+void                   atrebas_geojson_reader_free              (AtrebasGeojsonReader  *reader);
+gboolean               atrebas_geojson_reader_next              (AtrebasGeojsonReader  *reader,
+                                                                 GCancellable          *cancellable,
+                                                                 GError               **error);
+unsigned int           atrebas_geojson_reader_get_index         (AtrebasGeojsonReader  *reader);
+const char           * atrebas_geojson_reader_get_id            (AtrebasGeojsonReader  *reader);
+const char           * atrebas_geojson_reader_get_property      (AtrebasGeojsonReader  *reader,
+                                                                 const char            *name);
+const char           * atrebas_geojson_reader_get_geometry_type (AtrebasGeojsonReader  *reader);
+GBytes               * atrebas_geojson_reader_get_geometry      (AtrebasGeojsonReader  *reader);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (AtrebasGeojsonReader, atrebas_geojson_reader_free)
+
+G_END_DECLS
+
@@ -0,0 +1,2865 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// SPDX-FileCopyrightText: 2022 Andy Holmes <andrew.g.r.holmes@gmail.com>
+// SPDX-FileCopyrightText: Copyright 1994-2006 W Randolph Franklin (WRF)
+
+#define G_LOG_DOMAIN "atrebas-geometry"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#include "atrebas-geometry.h"
+
+
+/**
+ * SECTION:atrebasgeometry
+ * @short_description: Packed polygon geometry
+ * @title: Geometry
+ * @stability: Unstable
+ * @include: atrebas.h
+ *
+ * A compact binary encoding for the `coordinates` of a GeoJSON `Polygon` or
+ * `MultiPolygon`, suitable for storing in a database column and testing in
+ * place.
+ *
+ * All values are little-endian. The encoding begins with a fixed header:
+ *
+ * |[
+ * guint32 version;
+ * guint32 n_parts;
+ * guint32 n_rings;
+ * guint32 n_vertices;
+ * double  min_x, max_x, min_y, max_y;
+ * ]|
+ *
+ * followed by `n_parts` part records, one for each polygon:
+ *
+ * |[
+ * guint32 first_ring;
+ * guint32 n_rings;
+ * double  min_x, max_x, min_y, max_y;
+ * ]|
+ *
+ * and `n_rings` ring records:
+ *
+ * |[
+ * guint32 start;
+ * guint32 end;
+ * guint32 n_slabs;
+ * guint32 first_slab;
+ * double  min_x, max_x, min_y, max_y;
+ * ]|
+ *
+ * and then `n_vertices` pairs of #double coordinates (longitude, latitude). The
+ * rings of a part follow each other from its `first_ring`; the first is the
+ * outermost ring and the rest are holes. The vertices of a ring run from its
+ * `start` to its `end`, and the rings follow each other in the vertices.
+ *
+ * Every part and ring has its own extents, so a point test can reject a part or
+ * hole without reading its vertices. The extents of a part are those of its
+ * outermost ring.
+ *
+ * Polygons that cross the antimeridian are split into a part on each side of
+ * it when they are encoded, so every part lies within ±180° of longitude. The
+ * extents of a part never wrap, but if the parts of a geometry are closest
+ * across the antimeridian, the extents in the header wrap with `min_x` greater
+ * than `max_x`, as for a GeoJSON `bbox`.
+ *
+ * Large rings are prepared for point-in-polygon tests by dividing their
+ * extents into `n_slabs` horizontal slabs of equal height, each with a bucket
+ * of the edges that overlap it. The slabs follow the vertices, as #guint32
+ * words; for each ring with slabs, starting at `first_slab`, there are
+ * `n_slabs + 1` bucket offsets and then the buckets, as #guint32 edge indices.
+ * An edge is identified by the index of its second vertex, so the edge of the
+ * first vertex closes the ring.
+ *
+ * Callers are expected to check foreign data with atrebas_geometry_validate()
+ * before passing it to other functions.
+ */
+
+#define HEADER_SIZE          (4 * sizeof (guint32) + 4 * sizeof (double))
+#define HEADER_VERSION       0
+#define HEADER_N_PARTS       4
+#define HEADER_N_RINGS       8
+#define HEADER_N_VERTICES    12
+#define HEADER_MIN_X         16
+#define HEADER_MAX_X         24
+#define HEADER_MIN_Y         32
+#define HEADER_MAX_Y         40
+
+#define PART_SIZE            (2 * sizeof (guint32) + 4 * sizeof (double))
+#define PART_FIRST_RING      0
+#define PART_N_RINGS         4
+#define PART_MIN_X           8
+#define PART_MAX_X           16
+#define PART_MIN_Y           24
+#define PART_MAX_Y           32
+
+#define RING_SIZE            (4 * sizeof (guint32) + 4 * sizeof (double))
+#define RING_START           0
+#define RING_END             4
+#define RING_N_SLABS         8
+#define RING_FIRST_SLAB      12
+#define RING_MIN_X           16
+#define RING_MAX_X           24
+#define RING_MIN_Y           32
+#define RING_MAX_Y           40
+
+#define VERTEX_SIZE          (2 * sizeof (double))
+
+/* Rings smaller than this are tested faster without slabs */
+#define SLAB_MIN_VERTICES    64
+#define SLAB_MAX             1024
+
+
+static inline guint32
+read_uint32 (const guint8 *data)
+{
+  guint32 value;
+
+  memcpy (&value, data, sizeof (guint32));
+
+  return GUINT32_FROM_LE (value);
+}
+
+static inline double
+read_double (const guint8 *data)
+{
+  guint64 bits;
+  double value;
+
+  memcpy (&bits, data, sizeof (guint64));
+  bits = GUINT64_FROM_LE (bits);
+  memcpy (&value, &bits, sizeof (double));
+
+  return value;
+}
+
+static inline void
+write_uint32 (guint8  *data,
+              guint32  value)
+{
+  value = GUINT32_TO_LE (value);
+  memcpy (data, &value, sizeof (guint32));
+}
+
+static inline void
+write_double (guint8 *data,
+              double  value)
+{
+  guint64 bits;
+
+  memcpy (&bits, &value, sizeof (double));
+  bits = GUINT64_TO_LE (bits);
+  memcpy (data, &bits, sizeof (guint64));
+}
+
+static inline const guint8 *
+geometry_part (const guint8 *data,
+               guint32       part)
+{
+  return data + HEADER_SIZE + part * PART_SIZE;
+}
+
+static inline const guint8 *
+geometry_ring (const guint8 *data,
+               guint32       ring)
+{
+  return data + HEADER_SIZE + read_uint32 (data + HEADER_N_PARTS) * PART_SIZE +
+         ring * RING_SIZE;
+}
+
+static inline const guint8 *
+geometry_vertices (const guint8 *data)
+{
+  return geometry_ring (data, read_uint32 (data + HEADER_N_RINGS));
+}
+
+static inline const guint8 *
+geometry_slabs (const guint8 *data)
+{
+  return geometry_vertices (data) + read_uint32 (data + HEADER_N_VERTICES) * VERTEX_SIZE;
+}
+
+/* Wrap @x into ±180°, so points off the edge of the map are still found */
+static inline double
+normalize_longitude (double x)
+{
+  if G_LIKELY (x >= -180.0 && x <= 180.0)
+    return x;
+
+  return remainder (x, 360.0);
+}
+
+/* Extents crossing the antimeridian wrap, with @min_x greater than @max_x */
+static inline gboolean
+extents_contain (double min_x,
+                 double max_x,
+                 double min_y,
+                 double max_y,
+                 double x,
+                 double y)
+{
+  if (!(y >= min_y && y <= max_y))
+    return FALSE;
+
+  if (min_x > max_x)
+    return (x >= min_x || x <= max_x);
+
+  return (x >= min_x && x <= max_x);
+}
+
+/* Monotonic in @y, so an edge spanning @y always spans the slab of @y */
+static inline guint32
+slab_index (double  y,
+            double  min_y,
+            double  max_y,
+            guint32 n_slabs)
+{
+  double slab = (y - min_y) / (max_y - min_y) * n_slabs;
+
+  if (!(slab >= 0.0))
+    return 0;
+
+  if (slab >= n_slabs)
+    return n_slabs - 1;
+
+  return (guint32)slab;
+}
+
+
+/*
+ * Point-in-polygon kernels
+ *
+ * Each kernel tests points against the edges of one ring with the crossing
+ * test from "pnpoly", and must give exactly the same result as the scalar
+ * version; the vector versions only evaluate the same expression for several
+ * edges (or points) at once.
+ *
+ * The vector versions load the vertices in place, so they are only built for
+ * little-endian hosts. SSE2 is the baseline on x86-64; the AVX2 versions are
+ * chosen at runtime if the CPU supports them.
+ */
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN && defined (__GNUC__) && defined (__SSE2__)
+# define HAVE_PIP_SSE2 1
+# include <emmintrin.h>
+# if defined (__x86_64__) && (defined (__clang__) || G_GNUC_CHECK_VERSION (4, 9))
+#  define HAVE_PIP_AVX2 1
+#  include <immintrin.h>
+# endif
+#endif
+
+/* The number of points tested together by a batch kernel */
+#define PIP_BATCH_SIZE 64
+
+typedef struct
+{
+  gboolean (*ring_contains)       (const guint8 *vertices,
+                                   guint32       start,
+                                   guint32       end,
+                                   double        x,
+                                   double        y);
+  void     (*ring_contains_batch) (const guint8 *vertices,
+                                   guint32       start,
+                                   guint32       end,
+                                   const double *xs,
+                                   const double *ys,
+                                   unsigned int  n_points,
+                                   gboolean     *results);
+} PipKernels;
+
+static inline gboolean
+pip_edge_crosses (double prevx,
+                  double prevy,
+                  double nextx,
+                  double nexty,
+                  double x,
+                  double y)
+{
+  return ((nexty > y) != (prevy > y) &&
+          (x < (prevx - nextx) * (y - nexty) / (prevy - nexty) + nextx));
+}
+
+/* The vertices are packed without alignment, so scalar reads go through
+ * read_double() and only unaligned vector loads use the address directly */
+#define PIP_VERTEX(vertices, i) \
+  ((const double *)(const void *)((vertices) + (size_t)(i) * VERTEX_SIZE))
+
+static inline gboolean
+pip_vertex_edge_crosses (const guint8 *vertices,
+                         guint32       prev,
+                         guint32       next,
+                         double        x,
+                         double        y)
+{
+  const guint8 *p = vertices + (size_t)prev * VERTEX_SIZE;
+  const guint8 *n = vertices + (size_t)next * VERTEX_SIZE;
+
+  return pip_edge_crosses (read_double (p), read_double (p + sizeof (double)),
+                           read_double (n), read_double (n + sizeof (double)),
+                           x, y);
+}
+
+static gboolean
+pip_ring_contains_scalar (const guint8 *vertices,
+                          guint32       start,
+                          guint32       end,
+                          double        x,
+                          double        y)
+{
+  gboolean ret = FALSE;
+
+  for (guint32 i = start, j = end - 1; i < end; j = i++)
+    {
+      const guint8 *next = vertices + i * VERTEX_SIZE;
+      const guint8 *prev = vertices + j * VERTEX_SIZE;
+
+      if (pip_edge_crosses (read_double (prev),
+                            read_double (prev + sizeof (double)),
+                            read_double (next),
+                            read_double (next + sizeof (double)),
+                            x, y))
+        ret = !ret;
+    }
+
+  return ret;
+}
+
+static void
+pip_ring_contains_batch_scalar (const guint8 *vertices,
+                                guint32       start,
+                                guint32       end,
+                                const double *xs,
+                                const double *ys,
+                                unsigned int  n_points,
+                                gboolean     *results)
+{
+  for (guint32 i = start, j = end - 1; i < end; j = i++)
+    {
+      const guint8 *next = vertices + i * VERTEX_SIZE;
+      const guint8 *prev = vertices + j * VERTEX_SIZE;
+      double nextx = read_double (next);
+      double nexty = read_double (next + sizeof (double));
+      double prevx = read_double (prev);
+      double prevy = read_double (prev + sizeof (double));
+
+      for (unsigned int k = 0; k < n_points; k++)
+        results[k] ^= pip_edge_crosses (prevx, prevy, nextx, nexty, xs[k], ys[k]);
+    }
+}
+
+#ifdef HAVE_PIP_SSE2
+static inline __m128d
+pip_crosses_sse2 (__m128d prevx,
+                  __m128d prevy,
+                  __m128d nextx,
+                  __m128d nexty,
+                  __m128d x,
+                  __m128d y)
+{
+  __m128d straddles, intersect;
+
+  straddles = _mm_xor_pd (_mm_cmpgt_pd (nexty, y), _mm_cmpgt_pd (prevy, y));
+  intersect = _mm_add_pd (_mm_div_pd (_mm_mul_pd (_mm_sub_pd (prevx, nextx),
+                                                  _mm_sub_pd (y, nexty)),
+                                      _mm_sub_pd (prevy, nexty)),
+                          nextx);
+
+  return _mm_and_pd (straddles, _mm_cmplt_pd (x, intersect));
+}
+
+static gboolean
+pip_ring_contains_sse2 (const guint8 *vertices,
+                        guint32       start,
+                        guint32       end,
+                        double        x,
+                        double        y)
+{
+  const __m128d px = _mm_set1_pd (x);
+  const __m128d py = _mm_set1_pd (y);
+  unsigned int n_crossings = 0;
+  guint32 i;
+
+  /* Two consecutive edges at a time: (i - 1, i) and (i, i + 1) */
+  for (i = start + 1; i + 2 <= end; i += 2)
+    {
+      __m128d a = _mm_loadu_pd (PIP_VERTEX (vertices, i - 1));
+      __m128d b = _mm_loadu_pd (PIP_VERTEX (vertices, i));
+      __m128d c = _mm_loadu_pd (PIP_VERTEX (vertices, i + 1));
+      __m128d mask;
+
+      mask = pip_crosses_sse2 (_mm_unpacklo_pd (a, b),
+                               _mm_unpackhi_pd (a, b),
+                               _mm_unpacklo_pd (b, c),
+                               _mm_unpackhi_pd (b, c),
+                               px, py);
+      n_crossings += __builtin_popcount (_mm_movemask_pd (mask));
+    }
+
+  /* The remaining edge, if any, and the closing edge */
+  for (; i < end; i++)
+    n_crossings += pip_vertex_edge_crosses (vertices, i - 1, i, x, y);
+
+  n_crossings += pip_vertex_edge_crosses (vertices, end - 1, start, x, y);
+
+  return (n_crossings & 1);
+}
+
+static void
+pip_ring_contains_batch_sse2 (const guint8 *vertices,
+                              guint32       start,
+                              guint32       end,
+                              const double *xs,
+                              const double *ys,
+                              unsigned int  n_points,
+                              gboolean     *results)
+{
+  __m128d inside[PIP_BATCH_SIZE / 2];
+  unsigned int n_vectors = n_points / 2;
+
+  g_assert (n_points <= PIP_BATCH_SIZE);
+
+  for (unsigned int k = 0; k < n_vectors; k++)
+    inside[k] = _mm_setzero_pd ();
+
+  /* One pass over the edges, testing two points at a time */
+  for (guint32 i = start, j = end - 1; i < end; j = i++)
+    {
+      const guint8 *prev = vertices + j * VERTEX_SIZE;
+      const guint8 *next = vertices + i * VERTEX_SIZE;
+      const __m128d prevx = _mm_set1_pd (read_double (prev));
+      const __m128d prevy = _mm_set1_pd (read_double (prev + sizeof (double)));
+      const __m128d nextx = _mm_set1_pd (read_double (next));
+      const __m128d nexty = _mm_set1_pd (read_double (next + sizeof (double)));
+
+      for (unsigned int k = 0; k < n_vectors; k++)
+        {
+          __m128d mask = pip_crosses_sse2 (prevx, prevy, nextx, nexty,
+                                           _mm_loadu_pd (&xs[2 * k]),
+                                           _mm_loadu_pd (&ys[2 * k]));
+          inside[k] = _mm_xor_pd (inside[k], mask);
+        }
+    }
+
+  for (unsigned int k = 0; k < n_vectors; k++)
+    {
+      int mask = _mm_movemask_pd (inside[k]);
+
+      results[2 * k] = !!(mask & 0x1);
+      results[2 * k + 1] = !!(mask & 0x2);
+    }
+
+  /* An odd point out */
+  if (n_points % 2 != 0)
+    {
+      unsigned int k = n_points - 1;
+
+      results[k] = pip_ring_contains_sse2 (vertices, start, end, xs[k], ys[k]);
+    }
+}
+
+static const PipKernels pip_kernels_sse2 = {
+  pip_ring_contains_sse2,
+  pip_ring_contains_batch_sse2,
+};
+#endif /* HAVE_PIP_SSE2 */
+
+#ifdef HAVE_PIP_AVX2
+__attribute__ ((target ("avx2")))
+static inline __m256d
+pip_crosses_avx2 (__m256d prevx,
+                  __m256d prevy,
+                  __m256d nextx,
+                  __m256d nexty,
+                  __m256d x,
+                  __m256d y)
+{
+  __m256d straddles, intersect;
+
+  straddles = _mm256_xor_pd (_mm256_cmp_pd (nexty, y, _CMP_GT_OQ),
+                             _mm256_cmp_pd (prevy, y, _CMP_GT_OQ));
+  intersect = _mm256_add_pd (_mm256_div_pd (_mm256_mul_pd (_mm256_sub_pd (prevx, nextx),
+                                                           _mm256_sub_pd (y, nexty)),
+                                            _mm256_sub_pd (prevy, nexty)),
+                             nextx);
+
+  return _mm256_and_pd (straddles, _mm256_cmp_pd (x, intersect, _CMP_LT_OQ));
+}
+
+__attribute__ ((target ("avx2")))
+static gboolean
+pip_ring_contains_avx2 (const guint8 *vertices,
+                        guint32       start,
+                        guint32       end,
+                        double        x,
+                        double        y)
+{
+  const __m256d px = _mm256_set1_pd (x);
+  const __m256d py = _mm256_set1_pd (y);
+  unsigned int n_crossings = 0;
+  guint32 i;
+
+  /* Four consecutive edges at a time. Unpacking pairs of vertices interleaves
+   * the lanes, but the previous and next vertices are interleaved the same way
+   * so each lane still holds one edge. */
+  for (i = start + 1; i + 4 <= end; i += 4)
+    {
+      __m256d a = _mm256_loadu_pd (PIP_VERTEX (vertices, i - 1));
+      __m256d b = _mm256_loadu_pd (PIP_VERTEX (vertices, i + 1));
+      __m256d c = _mm256_loadu_pd (PIP_VERTEX (vertices, i));
+      __m256d d = _mm256_loadu_pd (PIP_VERTEX (vertices, i + 2));
+      __m256d mask;
+
+      mask = pip_crosses_avx2 (_mm256_unpacklo_pd (a, b),
+                               _mm256_unpackhi_pd (a, b),
+                               _mm256_unpacklo_pd (c, d),
+                               _mm256_unpackhi_pd (c, d),
+                               px, py);
+      n_crossings += __builtin_popcount (_mm256_movemask_pd (mask));
+    }
+
+  /* The remaining edges and the closing edge */
+  for (; i < end; i++)
+    n_crossings += pip_vertex_edge_crosses (vertices, i - 1, i, x, y);
+
+  n_crossings += pip_vertex_edge_crosses (vertices, end - 1, start, x, y);
+
+  return (n_crossings & 1);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+pip_ring_contains_batch_avx2 (const guint8 *vertices,
+                              guint32       start,
+                              guint32       end,
+                              const double *xs,
+                              const double *ys,
+                              unsigned int  n_points,
+                              gboolean     *results)
+{
+  __m256d inside[PIP_BATCH_SIZE / 4];
+  unsigned int n_vectors = n_points / 4;
+
+  g_assert (n_points <= PIP_BATCH_SIZE);
+
+  for (unsigned int k = 0; k < n_vectors; k++)
+    inside[k] = _mm256_setzero_pd ();
+
+  /* One pass over the edges, testing four points at a time */
+  for (guint32 i = start, j = end - 1; i < end; j = i++)
+    {
+      const guint8 *prev = vertices + j * VERTEX_SIZE;
+      const guint8 *next = vertices + i * VERTEX_SIZE;
+      const __m256d prevx = _mm256_set1_pd (read_double (prev));
+      const __m256d prevy = _mm256_set1_pd (read_double (prev + sizeof (double)));
+      const __m256d nextx = _mm256_set1_pd (read_double (next));
+      const __m256d nexty = _mm256_set1_pd (read_double (next + sizeof (double)));
+
+      for (unsigned int k = 0; k < n_vectors; k++)
+        {
+          __m256d mask = pip_crosses_avx2 (prevx, prevy, nextx, nexty,
+                                           _mm256_loadu_pd (&xs[4 * k]),
+                                           _mm256_loadu_pd (&ys[4 * k]));
+          inside[k] = _mm256_xor_pd (inside[k], mask);
+        }
+    }
+
+  for (unsigned int k = 0; k < n_vectors; k++)
+    {
+      int mask = _mm256_movemask_pd (inside[k]);
+
+      for (unsigned int lane = 0; lane < 4; lane++)
+        results[4 * k + lane] = !!(mask & (1 << lane));
+    }
+
+  /* The points left over */
+  for (unsigned int k = 4 * n_vectors; k < n_points; k++)
+    results[k] = pip_ring_contains_avx2 (vertices, start, end, xs[k], ys[k]);
+}
+
+static const PipKernels pip_kernels_avx2 = {
+  pip_ring_contains_avx2,
+  pip_ring_contains_batch_avx2,
+};
+#endif /* HAVE_PIP_AVX2 */
+
+static const PipKernels pip_kernels_scalar = {
+  pip_ring_contains_scalar,
+  pip_ring_contains_batch_scalar,
+};
+
+static const PipKernels *
+pip_get_kernels (void)
+{
+  static gsize kernels = 0;
+
+  if (g_once_init_enter (&kernels))
+    {
+      const PipKernels *selected = &pip_kernels_scalar;
+
+#ifdef HAVE_PIP_SSE2
+      selected = &pip_kernels_sse2;
+#endif
+#ifdef HAVE_PIP_AVX2
+      __builtin_cpu_init ();
+
+      if (__builtin_cpu_supports ("avx2"))
+        selected = &pip_kernels_avx2;
+#endif
+
+      g_once_init_leave (&kernels, (gsize)selected);
+    }
+
+  return (const PipKernels *)kernels;
+}
+
+
+static gboolean
+geometry_slab_contains (const guint8 *data,
+                        const guint8 *ring,
+                        double        x,
+                        double        y,
+                        gboolean     *inside)
+{
+  const guint8 *vertices = geometry_vertices (data);
+  const guint8 *slabs;
+  const guint8 *edges;
+  guint32 start = read_uint32 (ring + RING_START);
+  guint32 end = read_uint32 (ring + RING_END);
+  guint32 n_slabs = read_uint32 (ring + RING_N_SLABS);
+  guint32 n_entries;
+  guint32 slab, first, last;
+  gboolean ret = FALSE;
+
+  slabs = geometry_slabs (data) + read_uint32 (ring + RING_FIRST_SLAB) * sizeof (guint32);
+  edges = slabs + (n_slabs + 1) * sizeof (guint32);
+  n_entries = read_uint32 (slabs + n_slabs * sizeof (guint32));
+
+  slab = slab_index (y,
+                     read_double (ring + RING_MIN_Y),
+                     read_double (ring + RING_MAX_Y),
+                     n_slabs);
+  first = read_uint32 (slabs + slab * sizeof (guint32));
+  last = read_uint32 (slabs + (slab + 1) * sizeof (guint32));
+
+  /* A corrupt bucket; the caller falls back to testing every edge */
+  if G_UNLIKELY (first > last || last > n_entries)
+    return FALSE;
+
+  for (guint32 k = first; k < last; k++)
+    {
+      guint32 i = read_uint32 (edges + k * sizeof (guint32));
+      guint32 j = (i == start) ? end - 1 : i - 1;
+      const guint8 *next = vertices + i * VERTEX_SIZE;
+      const guint8 *prev = vertices + j * VERTEX_SIZE;
+
+      if G_UNLIKELY (i < start || i >= end)
+        return FALSE;
+
+      if (pip_edge_crosses (read_double (prev),
+                            read_double (prev + sizeof (double)),
+                            read_double (next),
+                            read_double (next + sizeof (double)),
+                            x, y))
+        ret = !ret;
+    }
+
+  *inside = ret;
+
+  return TRUE;
+}
+
+static gboolean
+geometry_ring_contains (const guint8 *data,
+                        const guint8 *ring,
+                        double        x,
+                        double        y)
+{
+  guint32 start = read_uint32 (ring + RING_START);
+  guint32 end = read_uint32 (ring + RING_END);
+  gboolean ret = FALSE;
+
+  /* Reject points outside the extents of the ring early */
+  if (start == end ||
+      !extents_contain (read_double (ring + RING_MIN_X),
+                        read_double (ring + RING_MAX_X),
+                        read_double (ring + RING_MIN_Y),
+                        read_double (ring + RING_MAX_Y),
+                        x, y))
+    return FALSE;
+
+  /* Only the edges overlapping the slab of the point can be crossed */
+  if (read_uint32 (ring + RING_N_SLABS) > 0 &&
+      geometry_slab_contains (data, ring, x, y, &ret))
+    return ret;
+
+  return pip_get_kernels ()->ring_contains (geometry_vertices (data),
+                                            start,
+                                            end,
+                                            x,
+                                            y);
+}
+
+static gboolean
+geometry_part_contains (const guint8 *data,
+                        const guint8 *part,
+                        double        x,
+                        double        y)
+{
+  guint32 first_ring = read_uint32 (part + PART_FIRST_RING);
+  guint32 last_ring = first_ring + read_uint32 (part + PART_N_RINGS);
+
+  /* Reject points outside the extents of the part early */
+  if (!extents_contain (read_double (part + PART_MIN_X),
+                        read_double (part + PART_MAX_X),
+                        read_double (part + PART_MIN_Y),
+                        read_double (part + PART_MAX_Y),
+                        x, y))
+    return FALSE;
+
+  if (!geometry_ring_contains (data, geometry_ring (data, first_ring), x, y))
+    return FALSE;
+
+  /* A point in a hole is outside the part */
+  for (guint32 r = first_ring + 1; r < last_ring; r++)
+    {
+      if (geometry_ring_contains (data, geometry_ring (data, r), x, y))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+
+/*
+ * AtrebasGeometryBuilder
+ */
+typedef struct
+{
+  guint32 first_ring;
+  guint32 n_rings;
+  double  min_x;
+  double  max_x;
+  double  min_y;
+  double  max_y;
+} BuilderPart;
+
+typedef struct
+{
+  guint32 start;
+  guint32 end;
+  guint32 n_slabs;
+  guint32 first_slab;
+  double  min_x;
+  double  max_x;
+  double  min_y;
+  double  max_y;
+} BuilderRing;
+
+struct _AtrebasGeometryBuilder
+{
+  GArray *parts;
+  GArray *rings;
+  GArray *vertices;
+
+  /* The output of atrebas_geometry_builder_end(), kept to reuse the space */
+  GArray *unwrapped;
+  GArray *out_parts;
+  GArray *out_rings;
+  GArray *out_vertices;
+  GArray *out_slabs;
+};
+
+/**
+ * atrebas_geometry_builder_new:
+ *
+ * Create a new builder, for encoding a geometry one vertex at a time. A builder
+ * may be reused for any number of geometries, avoiding repeated allocations.
+ *
+ * Returns: (transfer full): a new #AtrebasGeometryBuilder
+ */
+AtrebasGeometryBuilder *
+atrebas_geometry_builder_new (void)
+{
+  AtrebasGeometryBuilder *builder;
+
+  builder = g_new0 (AtrebasGeometryBuilder, 1);
+  builder->parts = g_array_new (FALSE, FALSE, sizeof (guint32));
+  builder->rings = g_array_new (FALSE, FALSE, sizeof (guint32));
+  builder->vertices = g_array_new (FALSE, FALSE, sizeof (double));
+  builder->unwrapped = g_array_new (FALSE, FALSE, sizeof (double));
+  builder->out_parts = g_array_new (FALSE, FALSE, sizeof (BuilderPart));
+  builder->out_rings = g_array_new (FALSE, FALSE, sizeof (BuilderRing));
+  builder->out_vertices = g_array_new (FALSE, FALSE, sizeof (double));
+  builder->out_slabs = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+  return builder;
+}
+
+/**
+ * atrebas_geometry_builder_free:
+ * @builder: (transfer full): a #AtrebasGeometryBuilder
+ *
+ * Free @builder.
+ */
+void
+atrebas_geometry_builder_free (AtrebasGeometryBuilder *builder)
+{
+  g_return_if_fail (builder != NULL);
+
+  g_clear_pointer (&builder->parts, g_array_unref);
+  g_clear_pointer (&builder->rings, g_array_unref);
+  g_clear_pointer (&builder->vertices, g_array_unref);
+  g_clear_pointer (&builder->unwrapped, g_array_unref);
+  g_clear_pointer (&builder->out_parts, g_array_unref);
+  g_clear_pointer (&builder->out_rings, g_array_unref);
+  g_clear_pointer (&builder->out_vertices, g_array_unref);
+  g_clear_pointer (&builder->out_slabs, g_array_unref);
+  g_free (builder);
+}
+
+/**
+ * atrebas_geometry_builder_reset:
+ * @builder: a #AtrebasGeometryBuilder
+ *
+ * Discard any parts, rings and vertices added to @builder.
+ */
+void
+atrebas_geometry_builder_reset (AtrebasGeometryBuilder *builder)
+{
+  g_return_if_fail (builder != NULL);
+
+  g_array_set_size (builder->parts, 0);
+  g_array_set_size (builder->rings, 0);
+  g_array_set_size (builder->vertices, 0);
+  g_array_set_size (builder->unwrapped, 0);
+  g_array_set_size (builder->out_parts, 0);
+  g_array_set_size (builder->out_rings, 0);
+  g_array_set_size (builder->out_vertices, 0);
+  g_array_set_size (builder->out_slabs, 0);
+}
+
+/**
+ * atrebas_geometry_builder_add_part:
+ * @builder: a #AtrebasGeometryBuilder
+ *
+ * Start a new part, for each polygon of a `MultiPolygon`. The first ring added
+ * to a part is its outermost ring.
+ *
+ * A builder starts a part for the first ring if none has been started, so
+ * this is not required for a `Polygon`.
+ */
+void
+atrebas_geometry_builder_add_part (AtrebasGeometryBuilder *builder)
+{
+  guint32 offset;
+
+  g_return_if_fail (builder != NULL);
+
+  offset = builder->rings->len;
+  g_array_append_val (builder->parts, offset);
+}
+
+/**
+ * atrebas_geometry_builder_add_ring:
+ * @builder: a #AtrebasGeometryBuilder
+ *
+ * Start a new ring in the current part. The first ring added to a part is its
+ * outermost ring.
+ */
+void
+atrebas_geometry_builder_add_ring (AtrebasGeometryBuilder *builder)
+{
+  guint32 offset;
+
+  g_return_if_fail (builder != NULL);
+
+  if (builder->parts->len == 0)
+    atrebas_geometry_builder_add_part (builder);
+
+  offset = builder->vertices->len / 2;
+  g_array_append_val (builder->rings, offset);
+}
+
+/**
+ * atrebas_geometry_builder_add_vertex:
+ * @builder: a #AtrebasGeometryBuilder
+ * @x: X-axis coordinate (longitude)
+ * @y: Y-axis coordinate (latitude)
+ *
+ * Append the vertex (@x, @y) to the current ring.
+ */
+void
+atrebas_geometry_builder_add_vertex (AtrebasGeometryBuilder *builder,
+                                     double                  x,
+                                     double                  y)
+{
+  double xy[2] = { x, y };
+
+  g_return_if_fail (builder != NULL);
+  g_return_if_fail (builder->rings->len > 0);
+
+  g_array_append_vals (builder->vertices, xy, 2);
+}
+
+static inline guint32
+builder_ring_start (AtrebasGeometryBuilder *builder,
+                    guint32                 ring)
+{
+  return g_array_index (builder->rings, guint32, ring);
+}
+
+static inline guint32
+builder_ring_end (AtrebasGeometryBuilder *builder,
+                  guint32                 ring)
+{
+  if (ring + 1 < builder->rings->len)
+    return g_array_index (builder->rings, guint32, ring + 1);
+
+  return builder->vertices->len / 2;
+}
+
+static inline void
+builder_emit_vertex (AtrebasGeometryBuilder *builder,
+                     BuilderRing            *ring,
+                     double                  x,
+                     double                  y)
+{
+  double xy[2] = { x, y };
+
+  if G_UNLIKELY (ring->min_x > ring->max_x)
+    {
+      ring->min_x = ring->max_x = x;
+      ring->min_y = ring->max_y = y;
+    }
+  else
+    {
+      ring->min_x = MIN (ring->min_x, x);
+      ring->max_x = MAX (ring->max_x, x);
+      ring->min_y = MIN (ring->min_y, y);
+      ring->max_y = MAX (ring->max_y, y);
+    }
+
+  g_array_append_vals (builder->out_vertices, xy, 2);
+}
+
+/*
+ * Add the rings @first_ring to @last_ring of @coords, a copy of the input
+ * vertices starting at @base, as an output part.
+ *
+ * If @sign is not zero the rings are clipped to the side of the line at @line
+ * where `sign * (x - line) <= 0`, with the Sutherland-Hodgman algorithm, and
+ * then moved by @shift. Clipped rings with less than three vertices are
+ * dropped, and the part is dropped if its outermost ring is.
+ */
+static void
+builder_emit_part (AtrebasGeometryBuilder *builder,
+                   const double           *coords,
+                   guint32                 base,
+                   guint32                 first_ring,
+                   guint32                 last_ring,
+                   double                  line,
+                   double                  sign,
+                   double                  shift)
+{
+  BuilderPart part = { builder->out_rings->len, 0, 0.0, 0.0, 0.0, 0.0 };
+  guint32 out_rings_len = builder->out_rings->len;
+  guint32 out_vertices_len = builder->out_vertices->len;
+
+  for (guint32 r = first_ring; r < last_ring; r++)
+    {
+      guint32 start = builder_ring_start (builder, r) - base;
+      guint32 end = builder_ring_end (builder, r) - base;
+      BuilderRing ring = { builder->out_vertices->len / 2, 0, 0, 0, 1.0, 0.0, 1.0, 0.0 };
+      gboolean outer = (r == first_ring);
+
+      if (sign == 0.0)
+        {
+          for (guint32 i = start; i < end; i++)
+            builder_emit_vertex (builder, &ring, coords[2 * i], coords[2 * i + 1]);
+        }
+      else if (end > start)
+        {
+          for (guint32 i = start, j = end - 1; i < end; j = i++)
+            {
+              double px = coords[2 * j], py = coords[2 * j + 1];
+              double cx = coords[2 * i], cy = coords[2 * i + 1];
+              gboolean prev_in = sign * (px - line) <= 0.0;
+              gboolean cur_in = sign * (cx - line) <= 0.0;
+
+              /* Entering or leaving, so the edge crosses the line */
+              if (cur_in != prev_in)
+                {
+                  builder_emit_vertex (builder, &ring,
+                                       line + shift,
+                                       py + (cy - py) * (line - px) / (cx - px));
+                }
+
+              if (cur_in)
+                builder_emit_vertex (builder, &ring, cx + shift, cy);
+            }
+
+          /* Close the clipped ring, as GeoJSON requires */
+          if (builder->out_vertices->len / 2 > ring.start)
+            {
+              const double *out = (const double *)(void *)builder->out_vertices->data;
+              guint32 last = builder->out_vertices->len / 2 - 1;
+              double first_x = out[2 * ring.start];
+              double first_y = out[2 * ring.start + 1];
+
+              if (out[2 * last] != first_x || out[2 * last + 1] != first_y)
+                builder_emit_vertex (builder, &ring, first_x, first_y);
+            }
+
+          if (builder->out_vertices->len / 2 - ring.start < 3)
+            {
+              g_array_set_size (builder->out_vertices, 2 * ring.start);
+
+              if (outer)
+                {
+                  g_array_set_size (builder->out_rings, out_rings_len);
+                  g_array_set_size (builder->out_vertices, out_vertices_len);
+                  return;
+                }
+
+              continue;
+            }
+        }
+
+      ring.end = builder->out_vertices->len / 2;
+
+      /* An empty ring has no extents */
+      if (ring.min_x > ring.max_x)
+        ring.min_x = ring.max_x = ring.min_y = ring.max_y = 0.0;
+
+      /* The extents of the part are those of its outermost ring */
+      if (outer)
+        {
+          part.min_x = ring.min_x;
+          part.max_x = ring.max_x;
+          part.min_y = ring.min_y;
+          part.max_y = ring.max_y;
+        }
+
+      g_array_append_val (builder->out_rings, ring);
+      part.n_rings++;
+    }
+
+  g_array_append_val (builder->out_parts, part);
+}
+
+/*
+ * Add the polygon in the rings @first_ring to @last_ring, splitting it at the
+ * antimeridian if it crosses it.
+ *
+ * The longitude of each vertex is first unwrapped to the copy nearest the one
+ * before it, so a ring crossing the antimeridian runs continuously past ±180°
+ * however it was written. If the outermost ring then extends past one side,
+ * the polygon is clipped into a part on each side of the line, and the part
+ * beyond it is moved back by a full turn.
+ */
+static void
+builder_add_polygon (AtrebasGeometryBuilder *builder,
+                     guint32                 first_ring,
+                     guint32                 last_ring)
+{
+  const double *vertices = (const double *)(void *)builder->vertices->data;
+  const double *unwrapped;
+  guint32 base = builder_ring_start (builder, first_ring);
+  guint32 n_vertices = builder_ring_end (builder, last_ring - 1) - base;
+  double origin = 0.0;
+  double lo = 0.0;
+  double hi = 0.0;
+  double sign;
+
+  g_array_set_size (builder->unwrapped, 2 * n_vertices);
+  unwrapped = (const double *)(void *)builder->unwrapped->data;
+
+  for (guint32 r = first_ring; r < last_ring; r++)
+    {
+      guint32 start = builder_ring_start (builder, r);
+      guint32 end = builder_ring_end (builder, r);
+      double prev;
+
+      if (start == end)
+        continue;
+
+      /* Holes start from the copy nearest the start of the outermost ring */
+      prev = (r == first_ring) ? normalize_longitude (vertices[2 * start]) : origin;
+
+      for (guint32 i = start; i < end; i++)
+        {
+          double x = vertices[2 * i];
+
+          if (fabs (x - prev) > 180.0)
+            x += 360.0 * round ((prev - x) / 360.0);
+
+          g_array_index (builder->unwrapped, double, 2 * (i - base)) = x;
+          g_array_index (builder->unwrapped, double, 2 * (i - base) + 1) = vertices[2 * i + 1];
+          prev = x;
+
+          if (r != first_ring)
+            continue;
+
+          if (i == start)
+            origin = lo = hi = x;
+
+          lo = MIN (lo, x);
+          hi = MAX (hi, x);
+        }
+    }
+
+  /* Polygons within ±180°, or around the whole globe, are kept whole */
+  if ((lo >= -180.0 && hi <= 180.0) || hi - lo >= 360.0)
+    {
+      builder_emit_part (builder,
+                         (hi - lo >= 360.0) ? vertices + 2 * base : unwrapped,
+                         base, first_ring, last_ring,
+                         0.0, 0.0, 0.0);
+      return;
+    }
+
+  /* The side within ±180°, then the side beyond it moved back by a turn */
+  sign = (hi > 180.0) ? 1.0 : -1.0;
+  builder_emit_part (builder, unwrapped, base, first_ring, last_ring,
+                     sign * 180.0, sign, 0.0);
+  builder_emit_part (builder, unwrapped, base, first_ring, last_ring,
+                     sign * 180.0, -sign, -sign * 360.0);
+}
+
+/* Bucket the edges of a large ring by the slabs they overlap; first count the
+ * entries for each slab, then fill them in */
+static void
+builder_add_slabs (AtrebasGeometryBuilder *builder,
+                   BuilderRing            *ring)
+{
+  g_autofree guint32 *slab_offsets = NULL;
+  g_autofree guint32 *slab_edges = NULL;
+  const double *vertices = (const double *)(void *)builder->out_vertices->data;
+  guint32 start = ring->start;
+  guint32 end = ring->end;
+  guint32 n_slabs;
+  guint32 n_entries = 0;
+
+  if (end - start < SLAB_MIN_VERTICES || !(ring->max_y > ring->min_y))
+    return;
+
+  n_slabs = MIN ((end - start) / 4, SLAB_MAX);
+  slab_offsets = g_new0 (guint32, n_slabs + 1);
+
+  for (unsigned int pass = 0; pass < 2; pass++)
+    {
+      for (guint32 i = start, j = end - 1; i < end; j = i++)
+        {
+          double y1 = vertices[2 * j + 1];
+          double y2 = vertices[2 * i + 1];
+          guint32 first, last;
+
+          first = slab_index (MIN (y1, y2), ring->min_y, ring->max_y, n_slabs);
+          last = slab_index (MAX (y1, y2), ring->min_y, ring->max_y, n_slabs);
+
+          for (guint32 slab = first; slab <= last; slab++)
+            {
+              if (pass == 0)
+                slab_offsets[slab + 1]++;
+              else
+                slab_edges[slab_offsets[slab]++] = i;
+            }
+        }
+
+      /* Running totals, as the start of each bucket */
+      if (pass == 0)
+        {
+          for (guint32 slab = 0; slab < n_slabs; slab++)
+            slab_offsets[slab + 1] += slab_offsets[slab];
+
+          n_entries = slab_offsets[n_slabs];
+          slab_edges = g_new (guint32, n_entries);
+        }
+    }
+
+  /* Filling advanced each start to the next, so shift them back */
+  memmove (slab_offsets + 1, slab_offsets, n_slabs * sizeof (guint32));
+  slab_offsets[0] = 0;
+
+  ring->n_slabs = n_slabs;
+  ring->first_slab = builder->out_slabs->len;
+  g_array_append_vals (builder->out_slabs, slab_offsets, n_slabs + 1);
+  g_array_append_vals (builder->out_slabs, slab_edges, n_entries);
+}
+
+static int
+builder_part_compare (gconstpointer a,
+                      gconstpointer b)
+{
+  const BuilderPart *part1 = *(const BuilderPart * const *)a;
+  const BuilderPart *part2 = *(const BuilderPart * const *)b;
+
+  return (part1->min_x > part2->min_x) - (part1->min_x < part2->min_x);
+}
+
+/*
+ * Merge the extents of the parts. The longitude extents are the shortest span
+ * covering every part, which wraps across the antimeridian if the widest gap
+ * between the parts is not the one that does.
+ */
+static void
+builder_merge_extents (AtrebasGeometryBuilder *builder,
+                       double                 *min_x,
+                       double                 *max_x,
+                       double                 *min_y,
+                       double                 *max_y)
+{
+  g_autofree BuilderPart **sorted = NULL;
+  unsigned int n_parts = builder->out_parts->len;
+  double reach, gap;
+
+  sorted = g_new (BuilderPart *, n_parts);
+
+  for (unsigned int i = 0; i < n_parts; i++)
+    {
+      sorted[i] = &g_array_index (builder->out_parts, BuilderPart, i);
+
+      if (i == 0)
+        {
+          *min_y = sorted[i]->min_y;
+          *max_y = sorted[i]->max_y;
+        }
+
+      *min_y = MIN (*min_y, sorted[i]->min_y);
+      *max_y = MAX (*max_y, sorted[i]->max_y);
+    }
+
+  if (n_parts > 1)
+    qsort (sorted, n_parts, sizeof (BuilderPart *), builder_part_compare);
+
+  *min_x = sorted[0]->min_x;
+  reach = sorted[0]->max_x;
+
+  for (unsigned int i = 1; i < n_parts; i++)
+    reach = MAX (reach, sorted[i]->max_x);
+
+  *max_x = reach;
+
+  /* The gap across the antimeridian, then each gap between the parts */
+  gap = (sorted[0]->min_x + 360.0) - reach;
+  reach = sorted[0]->max_x;
+
+  for (unsigned int i = 1; i < n_parts; i++)
+    {
+      if (sorted[i]->min_x - reach > gap)
+        {
+          gap = sorted[i]->min_x - reach;
+          *min_x = sorted[i]->min_x;
+          *max_x = reach;
+        }
+
+      reach = MAX (reach, sorted[i]->max_x);
+    }
+}
+
+/**
+ * atrebas_geometry_builder_end:
+ * @builder: a #AtrebasGeometryBuilder
+ *
+ * Encode the parts, rings and vertices added to @builder, then reset it.
+ * Polygons crossing the antimeridian are split into a part on each side.
+ *
+ * Returns: (transfer full) (nullable): the encoded geometry, or %NULL if empty
+ */
+GBytes *
+atrebas_geometry_builder_end (AtrebasGeometryBuilder *builder)
+{
+  guint8 *data, *ptr;
+  size_t size;
+  guint32 n_parts;
+  guint32 n_rings;
+  guint32 n_vertices;
+  double min_x, max_x, min_y, max_y;
+
+  g_return_val_if_fail (builder != NULL, NULL);
+
+  if (builder->rings->len == 0 || builder->vertices->len == 0)
+    {
+      atrebas_geometry_builder_reset (builder);
+      return NULL;
+    }
+
+  for (guint32 p = 0; p < builder->parts->len; p++)
+    {
+      guint32 first_ring = g_array_index (builder->parts, guint32, p);
+      guint32 last_ring = (p + 1 < builder->parts->len)
+        ? g_array_index (builder->parts, guint32, p + 1)
+        : builder->rings->len;
+
+      if (first_ring < last_ring)
+        builder_add_polygon (builder, first_ring, last_ring);
+    }
+
+  if (builder->out_parts->len == 0 || builder->out_vertices->len == 0)
+    {
+      atrebas_geometry_builder_reset (builder);
+      return NULL;
+    }
+
+  for (guint32 r = 0; r < builder->out_rings->len; r++)
+    builder_add_slabs (builder, &g_array_index (builder->out_rings, BuilderRing, r));
+
+  builder_merge_extents (builder, &min_x, &max_x, &min_y, &max_y);
+
+  /* Pack the header, parts, rings, vertices and slabs */
+  n_parts = builder->out_parts->len;
+  n_rings = builder->out_rings->len;
+  n_vertices = builder->out_vertices->len / 2;
+  size = HEADER_SIZE +
+         n_parts * PART_SIZE +
+         n_rings * RING_SIZE +
+         n_vertices * VERTEX_SIZE +
+         builder->out_slabs->len * sizeof (guint32);
+  data = g_malloc0 (size);
+
+  write_uint32 (data + HEADER_VERSION, ATREBAS_GEOMETRY_VERSION);
+  write_uint32 (data + HEADER_N_PARTS, n_parts);
+  write_uint32 (data + HEADER_N_RINGS, n_rings);
+  write_uint32 (data + HEADER_N_VERTICES, n_vertices);
+  write_double (data + HEADER_MIN_X, min_x);
+  write_double (data + HEADER_MAX_X, max_x);
+  write_double (data + HEADER_MIN_Y, min_y);
+  write_double (data + HEADER_MAX_Y, max_y);
+
+  ptr = data + HEADER_SIZE;
+  for (unsigned int i = 0; i < n_parts; i++, ptr += PART_SIZE)
+    {
+      const BuilderPart *part = &g_array_index (builder->out_parts, BuilderPart, i);
+
+      write_uint32 (ptr + PART_FIRST_RING, part->first_ring);
+      write_uint32 (ptr + PART_N_RINGS, part->n_rings);
+      write_double (ptr + PART_MIN_X, part->min_x);
+      write_double (ptr + PART_MAX_X, part->max_x);
+      write_double (ptr + PART_MIN_Y, part->min_y);
+      write_double (ptr + PART_MAX_Y, part->max_y);
+    }
+
+  for (unsigned int i = 0; i < n_rings; i++, ptr += RING_SIZE)
+    {
+      const BuilderRing *ring = &g_array_index (builder->out_rings, BuilderRing, i);
+
+      write_uint32 (ptr + RING_START, ring->start);
+      write_uint32 (ptr + RING_END, ring->end);
+      write_uint32 (ptr + RING_N_SLABS, ring->n_slabs);
+      write_uint32 (ptr + RING_FIRST_SLAB, ring->first_slab);
+      write_double (ptr + RING_MIN_X, ring->min_x);
+      write_double (ptr + RING_MAX_X, ring->max_x);
+      write_double (ptr + RING_MIN_Y, ring->min_y);
+      write_double (ptr + RING_MAX_Y, ring->max_y);
+    }
+
+  for (unsigned int i = 0; i < builder->out_vertices->len; i++, ptr += sizeof (double))
+    write_double (ptr, g_array_index (builder->out_vertices, double, i));
+
+  for (unsigned int i = 0; i < builder->out_slabs->len; i++, ptr += sizeof (guint32))
+    write_uint32 (ptr, g_array_index (builder->out_slabs, guint32, i));
+
+  atrebas_geometry_builder_reset (builder);
+
+  return g_bytes_new_take (data, size);
+}
+
+
+static gboolean
+encode_polygon (AtrebasGeometryBuilder *builder,
+                JsonArray              *polygon)
+{
+  unsigned int n_rings = json_array_get_length (polygon);
+
+  for (unsigned int i = 0; i < n_rings; i++)
+    {
+      JsonNode *node = json_array_get_element (polygon, i);
+      JsonArray *ring;
+      unsigned int n_points;
+
+      if (!JSON_NODE_HOLDS_ARRAY (node))
+        return FALSE;
+
+      ring = json_node_get_array (node);
+      n_points = json_array_get_length (ring);
+      atrebas_geometry_builder_add_ring (builder);
+
+      for (unsigned int j = 0; j < n_points; j++)
+        {
+          JsonNode *point_node = json_array_get_element (ring, j);
+          JsonArray *point;
+
+          if (!JSON_NODE_HOLDS_ARRAY (point_node) ||
+              json_array_get_length (json_node_get_array (point_node)) < 2)
+            return FALSE;
+
+          point = json_node_get_array (point_node);
+          atrebas_geometry_builder_add_vertex (builder,
+                                               json_array_get_double_element (point, 0),
+                                               json_array_get_double_element (point, 1));
+        }
+    }
+
+  return TRUE;
+}
+
+/* A `MultiPolygon` nests its positions one level deeper than a `Polygon` */
+static gboolean
+coordinates_are_multipolygon (JsonArray *coordinates)
+{
+  JsonNode *node;
+
+  for (unsigned int depth = 0; depth < 3; depth++)
+    {
+      if (json_array_get_length (coordinates) == 0)
+        return FALSE;
+
+      node = json_array_get_element (coordinates, 0);
+
+      if (!JSON_NODE_HOLDS_ARRAY (node))
+        return FALSE;
+
+      coordinates = json_node_get_array (node);
+    }
+
+  return TRUE;
+}
+
+/**
+ * atrebas_geometry_encode:
+ * @coordinates: a #JsonArray
+ *
+ * Encode the `coordinates` field of a GeoJSON fragment containing a `Polygon`
+ * or `MultiPolygon` type. Any coordinates beyond the longitude and latitude
+ * (eg. altitude) are discarded.
+ *
+ * Returns: (transfer full) (nullable): the encoded geometry
+ */
+GBytes *
+atrebas_geometry_encode (JsonArray *coordinates)
+{
+  g_autoptr (AtrebasGeometryBuilder) builder = NULL;
+
+  g_return_val_if_fail (coordinates != NULL, NULL);
+
+  builder = atrebas_geometry_builder_new ();
+
+  if (coordinates_are_multipolygon (coordinates))
+    {
+      unsigned int n_polygons = json_array_get_length (coordinates);
+
+      for (unsigned int i = 0; i < n_polygons; i++)
+        {
+          JsonNode *node = json_array_get_element (coordinates, i);
+
+          if (!JSON_NODE_HOLDS_ARRAY (node))
+            return NULL;
+
+          atrebas_geometry_builder_add_part (builder);
+
+          if (!encode_polygon (builder, json_node_get_array (node)))
+            return NULL;
+        }
+    }
+  else if (!encode_polygon (builder, coordinates))
+    {
+      return NULL;
+    }
+
+  return atrebas_geometry_builder_end (builder);
+}
+
+/**
+ * atrebas_geometry_validate:
+ * @data: (array length=size): encoded geometry
+ * @size: the size of @data
+ *
+ * Check that @data is a complete geometry of a supported version, with part,
+ * ring, vertex and slab offsets in bounds.
+ *
+ * Returns: %TRUE if valid, %FALSE if not
+ */
+gboolean
+atrebas_geometry_validate (const guint8 *data,
+                           size_t        size)
+{
+  guint32 n_parts;
+  guint32 n_rings;
+  guint32 n_vertices;
+  guint32 n_words;
+  guint32 n_part_rings = 0;
+  guint32 n_slab_words = 0;
+  guint32 prev = 0;
+  size_t base_size;
+
+  if (data == NULL || size < HEADER_SIZE)
+    return FALSE;
+
+  if (read_uint32 (data + HEADER_VERSION) != ATREBAS_GEOMETRY_VERSION)
+    return FALSE;
+
+  n_parts = read_uint32 (data + HEADER_N_PARTS);
+  n_rings = read_uint32 (data + HEADER_N_RINGS);
+  n_vertices = read_uint32 (data + HEADER_N_VERTICES);
+
+  if (n_parts == 0 || n_parts > (size - HEADER_SIZE) / PART_SIZE)
+    return FALSE;
+
+  if (n_rings < n_parts || n_rings > (size - HEADER_SIZE) / RING_SIZE)
+    return FALSE;
+
+  if (n_vertices > (size - HEADER_SIZE) / VERTEX_SIZE)
+    return FALSE;
+
+  base_size = HEADER_SIZE +
+              n_parts * PART_SIZE +
+              n_rings * RING_SIZE +
+              n_vertices * VERTEX_SIZE;
+
+  if (size < base_size || (size - base_size) % sizeof (guint32) != 0)
+    return FALSE;
+
+  /* The rings of each part follow those of the one before */
+  for (guint32 i = 0; i < n_parts; i++)
+    {
+      const guint8 *part = geometry_part (data, i);
+      guint32 part_rings = read_uint32 (part + PART_N_RINGS);
+
+      if (read_uint32 (part + PART_FIRST_RING) != n_part_rings ||
+          part_rings == 0 || part_rings > n_rings - n_part_rings)
+        return FALSE;
+
+      n_part_rings += part_rings;
+    }
+
+  if (n_part_rings != n_rings)
+    return FALSE;
+
+  /* The vertices and slabs of each ring follow those of the one before; the
+   * bucket contents are checked as they are used, to keep this cheap */
+  n_words = (size - base_size) / sizeof (guint32);
+
+  for (guint32 i = 0; i < n_rings; i++)
+    {
+      const guint8 *ring = geometry_ring (data, i);
+      guint32 start = read_uint32 (ring + RING_START);
+      guint32 end = read_uint32 (ring + RING_END);
+      guint32 n_slabs = read_uint32 (ring + RING_N_SLABS);
+      guint32 n_entries;
+
+      if (start != prev || end < start || end > n_vertices)
+        return FALSE;
+
+      prev = end;
+
+      if (n_slabs == 0)
+        continue;
+
+      if (read_uint32 (ring + RING_FIRST_SLAB) != n_slab_words ||
+          n_slabs >= n_words - n_slab_words)
+        return FALSE;
+
+      n_entries = read_uint32 (data + base_size + (n_slab_words + n_slabs) * sizeof (guint32));
+      n_slab_words += n_slabs + 1;
+
+      if (n_entries > n_words - n_slab_words)
+        return FALSE;
+
+      n_slab_words += n_entries;
+    }
+
+  return prev == n_vertices && n_slab_words == n_words;
+}
+
+static JsonArray *
+geometry_part_to_json (const guint8 *data,
+                       guint32       part)
+{
+  JsonArray *ret = NULL;
+  const guint8 *vertices;
+  unsigned int first_ring, last_ring;
+
+  atrebas_geometry_get_part (data, part, &first_ring, &last_ring);
+  vertices = geometry_vertices (data);
+  ret = json_array_sized_new (last_ring - first_ring);
+
+  for (unsigned int i = first_ring; i < last_ring; i++)
+    {
+      guint32 start = read_uint32 (geometry_ring (data, i) + RING_START);
+      guint32 end = read_uint32 (geometry_ring (data, i) + RING_END);
+      JsonArray *ring = json_array_sized_new (end - start);
+
+      for (guint32 j = start; j < end; j++)
+        {
+          JsonArray *point = json_array_sized_new (2);
+          const guint8 *vertex = vertices + j * VERTEX_SIZE;
+
+          json_array_add_double_element (point, read_double (vertex));
+          json_array_add_double_element (point, read_double (vertex + sizeof (double)));
+          json_array_add_array_element (ring, point);
+        }
+
+      json_array_add_array_element (ret, ring);
+    }
+
+  return ret;
+}
+
+/**
+ * atrebas_geometry_to_json:
+ * @data: (array length=size): encoded geometry
+ * @size: the size of @data
+ *
+ * Decode @data into the `coordinates` field of a GeoJSON `Polygon`, or of a
+ * `MultiPolygon` if @data has more than one part.
+ *
+ * Returns: (transfer full) (nullable): a #JsonArray
+ */
+JsonArray *
+atrebas_geometry_to_json (const guint8 *data,
+                          size_t        size)
+{
+  JsonArray *ret = NULL;
+  guint32 n_parts;
+
+  if (!atrebas_geometry_validate (data, size))
+    return NULL;
+
+  n_parts = read_uint32 (data + HEADER_N_PARTS);
+
+  if (n_parts == 1)
+    return geometry_part_to_json (data, 0);
+
+  ret = json_array_sized_new (n_parts);
+
+  for (guint32 i = 0; i < n_parts; i++)
+    json_array_add_array_element (ret, geometry_part_to_json (data, i));
+
+  return ret;
+}
+
+/**
+ * atrebas_geometry_get_bounds:
+ * @data: encoded geometry
+ * @min_x: (out) (optional): western extent
+ * @max_x: (out) (optional): eastern extent
+ * @min_y: (out) (optional): southern extent
+ * @max_y: (out) (optional): northern extent
+ *
+ * Get the extents of the outermost rings of @data.
+ *
+ * If the parts of @data are closest across the antimeridian, the extents wrap
+ * and @min_x is greater than @max_x.
+ */
+void
+atrebas_geometry_get_bounds (const guint8 *data,
+                             double       *min_x,
+                             double       *max_x,
+                             double       *min_y,
+                             double       *max_y)
+{
+  g_return_if_fail (data != NULL);
+
+  if (min_x != NULL)
+    *min_x = read_double (data + HEADER_MIN_X);
+
+  if (max_x != NULL)
+    *max_x = read_double (data + HEADER_MAX_X);
+
+  if (min_y != NULL)
+    *min_y = read_double (data + HEADER_MIN_Y);
+
+  if (max_y != NULL)
+    *max_y = read_double (data + HEADER_MAX_Y);
+}
+
+/**
+ * atrebas_geometry_get_center:
+ * @data: encoded geometry
+ * @x: (out): X-axis coordinate (longitude)
+ * @y: (out): Y-axis coordinate (latitude)
+ *
+ * Get the center of the extents of @data, on the near side of the antimeridian
+ * if the extents wrap.
+ */
+void
+atrebas_geometry_get_center (const guint8 *data,
+                             double       *x,
+                             double       *y)
+{
+  double min_x, max_x, min_y, max_y;
+
+  g_return_if_fail (data != NULL);
+  g_return_if_fail (x != NULL && y != NULL);
+
+  atrebas_geometry_get_bounds (data, &min_x, &max_x, &min_y, &max_y);
+
+  if (min_x > max_x)
+    max_x += 360.0;
+
+  *x = normalize_longitude (min_x + (max_x - min_x) / 2);
+  *y = min_y + (max_y - min_y) / 2;
+}
+
+/**
+ * atrebas_geometry_get_n_parts:
+ * @data: encoded geometry
+ *
+ * Get the number of parts in @data. Each part is a polygon, with an outermost
+ * ring and any holes.
+ *
+ * Returns: a part count
+ */
+unsigned int
+atrebas_geometry_get_n_parts (const guint8 *data)
+{
+  g_return_val_if_fail (data != NULL, 0);
+
+  return read_uint32 (data + HEADER_N_PARTS);
+}
+
+/**
+ * atrebas_geometry_get_part:
+ * @data: encoded geometry
+ * @part: a part index
+ * @first_ring: (out): the index of the outermost ring
+ * @last_ring: (out): the index after the last ring
+ *
+ * Get the range of rings in @part of @data, for use with
+ * atrebas_geometry_get_ring().
+ */
+void
+atrebas_geometry_get_part (const guint8 *data,
+                           unsigned int  part,
+                           unsigned int *first_ring,
+                           unsigned int *last_ring)
+{
+  const guint8 *ptr;
+
+  g_return_if_fail (data != NULL);
+  g_return_if_fail (part < read_uint32 (data + HEADER_N_PARTS));
+  g_return_if_fail (first_ring != NULL && last_ring != NULL);
+
+  ptr = geometry_part (data, part);
+  *first_ring = read_uint32 (ptr + PART_FIRST_RING);
+  *last_ring = *first_ring + read_uint32 (ptr + PART_N_RINGS);
+}
+
+/**
+ * atrebas_geometry_get_part_bounds:
+ * @data: encoded geometry
+ * @part: a part index
+ * @min_x: (out) (optional): western extent
+ * @max_x: (out) (optional): eastern extent
+ * @min_y: (out) (optional): southern extent
+ * @max_y: (out) (optional): northern extent
+ *
+ * Get the extents of the outermost ring of @part of @data. These never wrap
+ * across the antimeridian.
+ */
+void
+atrebas_geometry_get_part_bounds (const guint8 *data,
+                                  unsigned int  part,
+                                  double       *min_x,
+                                  double       *max_x,
+                                  double       *min_y,
+                                  double       *max_y)
+{
+  const guint8 *ptr;
+
+  g_return_if_fail (data != NULL);
+  g_return_if_fail (part < read_uint32 (data + HEADER_N_PARTS));
+
+  ptr = geometry_part (data, part);
+
+  if (min_x != NULL)
+    *min_x = read_double (ptr + PART_MIN_X);
+
+  if (max_x != NULL)
+    *max_x = read_double (ptr + PART_MAX_X);
+
+  if (min_y != NULL)
+    *min_y = read_double (ptr + PART_MIN_Y);
+
+  if (max_y != NULL)
+    *max_y = read_double (ptr + PART_MAX_Y);
+}
+
+/**
+ * atrebas_geometry_get_n_rings:
+ * @data: encoded geometry
+ *
+ * Get the total number of rings in @data, in every part.
+ *
+ * Returns: a ring count
+ */
+unsigned int
+atrebas_geometry_get_n_rings (const guint8 *data)
+{
+  g_return_val_if_fail (data != NULL, 0);
+
+  return read_uint32 (data + HEADER_N_RINGS);
+}
+
+/**
+ * atrebas_geometry_get_ring:
+ * @data: encoded geometry
+ * @ring: a ring index
+ * @start: (out): the index of the first vertex
+ * @end: (out): the index after the last vertex
+ *
+ * Get the range of vertices in @ring of @data, for use with
+ * atrebas_geometry_get_vertex().
+ */
+void
+atrebas_geometry_get_ring (const guint8 *data,
+                           unsigned int  ring,
+                           unsigned int *start,
+                           unsigned int *end)
+{
+  const guint8 *ptr;
+
+  g_return_if_fail (data != NULL);
+  g_return_if_fail (ring < read_uint32 (data + HEADER_N_RINGS));
+  g_return_if_fail (start != NULL && end != NULL);
+
+  ptr = geometry_ring (data, ring);
+  *start = read_uint32 (ptr + RING_START);
+  *end = read_uint32 (ptr + RING_END);
+}
+
+/**
+ * atrebas_geometry_get_ring_bounds:
+ * @data: encoded geometry
+ * @ring: a ring index
+ * @min_x: (out) (optional): western extent
+ * @max_x: (out) (optional): eastern extent
+ * @min_y: (out) (optional): southern extent
+ * @max_y: (out) (optional): northern extent
+ *
+ * Get the extents of @ring of @data. These never wrap across the antimeridian.
+ */
+void
+atrebas_geometry_get_ring_bounds (const guint8 *data,
+                                  unsigned int  ring,
+                                  double       *min_x,
+                                  double       *max_x,
+                                  double       *min_y,
+                                  double       *max_y)
+{
+  const guint8 *ptr;
+
+  g_return_if_fail (data != NULL);
+  g_return_if_fail (ring < read_uint32 (data + HEADER_N_RINGS));
+
+  ptr = geometry_ring (data, ring);
+
+  if (min_x != NULL)
+    *min_x = read_double (ptr + RING_MIN_X);
+
+  if (max_x != NULL)
+    *max_x = read_double (ptr + RING_MAX_X);
+
+  if (min_y != NULL)
+    *min_y = read_double (ptr + RING_MIN_Y);
+
+  if (max_y != NULL)
+    *max_y = read_double (ptr + RING_MAX_Y);
+}
+
+/**
+ * atrebas_geometry_get_vertex:
+ * @data: encoded geometry
+ * @index: a vertex index
+ * @x: (out): X-axis coordinate (longitude)
+ * @y: (out): Y-axis coordinate (latitude)
+ *
+ * Get the vertex at @index in @data.
+ */
+void
+atrebas_geometry_get_vertex (const guint8 *data,
+                             unsigned int  index,
+                             double       *x,
+                             double       *y)
+{
+  const guint8 *vertex;
+
+  g_return_if_fail (data != NULL);
+  g_return_if_fail (x != NULL && y != NULL);
+
+  vertex = geometry_vertices (data) + index * VERTEX_SIZE;
+  *x = read_double (vertex);
+  *y = read_double (vertex + sizeof (double));
+}
+
+/**
+ * atrebas_geometry_get_n_vertices:
+ * @data: encoded geometry
+ *
+ * Get the total number of vertices in @data.
+ *
+ * Returns: a vertex count
+ */
+unsigned int
+atrebas_geometry_get_n_vertices (const guint8 *data)
+{
+  g_return_val_if_fail (data != NULL, 0);
+
+  return read_uint32 (data + HEADER_N_VERTICES);
+}
+
+/**
+ * atrebas_geometry_contains_point:
+ * @data: encoded geometry
+ * @x: X-axis coordinate of the test point
+ * @y: Y-axis coordinate of the test point
+ *
+ * Check if the point (@x, @y) is within the outermost ring of any part of
+ * @data, and not within one of its holes. The longitude is wrapped into ±180°
+ * first, and parts and rings that do not contain the point in their extents
+ * are skipped. If a ring is divided into slabs, only the edges in the slab of
+ * the point are tested.
+ *
+ * Based on "pnpoly":
+ *     Copyright 1994-2006 W Randolph Franklin (WRF)
+ *     https://wrf.ecse.rpi.edu/Research/Short_Notes/pnpoly.html
+ *
+ * Returns: %TRUE if inside, %FALSE if outside
+ */
+gboolean
+atrebas_geometry_contains_point (const guint8 *data,
+                                 double        x,
+                                 double        y)
+{
+  guint32 n_parts;
+
+  g_return_val_if_fail (data != NULL, FALSE);
+
+  x = normalize_longitude (x);
+
+  /* Reject points outside the extents early */
+  if (!extents_contain (read_double (data + HEADER_MIN_X),
+                        read_double (data + HEADER_MAX_X),
+                        read_double (data + HEADER_MIN_Y),
+                        read_double (data + HEADER_MAX_Y),
+                        x, y))
+    return FALSE;
+
+  n_parts = read_uint32 (data + HEADER_N_PARTS);
+
+  for (guint32 i = 0; i < n_parts; i++)
+    {
+      if (geometry_part_contains (data, geometry_part (data, i), x, y))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Clear the result of each point in a batch that is in a hole of @part, with a
+ * pass over the edges of each hole that has a point inside in its extents */
+static void
+geometry_part_exclude_holes (const guint8 *data,
+                             const guint8 *part,
+                             const double *xs,
+                             const double *ys,
+                             unsigned int  n_points,
+                             gboolean     *inside)
+{
+  const PipKernels *kernels = pip_get_kernels ();
+  const guint8 *vertices = geometry_vertices (data);
+  guint32 first_ring = read_uint32 (part + PART_FIRST_RING);
+  guint32 last_ring = first_ring + read_uint32 (part + PART_N_RINGS);
+  double hole_xs[PIP_BATCH_SIZE];
+  double hole_ys[PIP_BATCH_SIZE];
+  unsigned int indices[PIP_BATCH_SIZE];
+  gboolean in_hole[PIP_BATCH_SIZE];
+
+  for (guint32 r = first_ring + 1; r < last_ring; r++)
+    {
+      const guint8 *ring = geometry_ring (data, r);
+      guint32 start = read_uint32 (ring + RING_START);
+      guint32 end = read_uint32 (ring + RING_END);
+      double min_x = read_double (ring + RING_MIN_X);
+      double max_x = read_double (ring + RING_MAX_X);
+      double min_y = read_double (ring + RING_MIN_Y);
+      double max_y = read_double (ring + RING_MAX_Y);
+      unsigned int n_hole = 0;
+
+      if (start == end)
+        continue;
+
+      for (unsigned int k = 0; k < n_points; k++)
+        {
+          if (!inside[k] || !extents_contain (min_x, max_x, min_y, max_y, xs[k], ys[k]))
+            continue;
+
+          hole_xs[n_hole] = xs[k];
+          hole_ys[n_hole] = ys[k];
+          indices[n_hole++] = k;
+        }
+
+      if (n_hole == 0)
+        continue;
+
+      memset (in_hole, 0, sizeof (in_hole));
+      kernels->ring_contains_batch (vertices, start, end, hole_xs, hole_ys, n_hole, in_hole);
+
+      for (unsigned int h = 0; h < n_hole; h++)
+        {
+          if (in_hole[h])
+            inside[indices[h]] = FALSE;
+        }
+    }
+}
+
+/**
+ * atrebas_geometry_contains_points:
+ * @data: encoded geometry
+ * @points: (array length=n_points): X and Y-axis coordinate pairs
+ * @n_points: the number of points in @points
+ * @results: (array length=n_points) (out caller-allocates): a result for each point
+ *
+ * Check if each point in @points is within the outermost ring of any part of
+ * @data and not within one of its holes, setting the corresponding element of
+ * @results.
+ *
+ * This gives the same results as calling atrebas_geometry_contains_point() for
+ * each point, but makes a single pass over the edges of each ring for every
+ * batch of points, which is much faster for large polygons.
+ *
+ * Returns: the number of points inside
+ */
+unsigned int
+atrebas_geometry_contains_points (const guint8 *data,
+                                  const double *points,
+                                  unsigned int  n_points,
+                                  gboolean     *results)
+{
+  const PipKernels *kernels;
+  const guint8 *vertices;
+  guint32 n_parts;
+  double xs[PIP_BATCH_SIZE];
+  double ys[PIP_BATCH_SIZE];
+  unsigned int indices[PIP_BATCH_SIZE];
+  gboolean inside[PIP_BATCH_SIZE];
+  unsigned int n_inside = 0;
+
+  g_return_val_if_fail (data != NULL, 0);
+  g_return_val_if_fail (points != NULL || n_points == 0, 0);
+  g_return_val_if_fail (results != NULL || n_points == 0, 0);
+
+  kernels = pip_get_kernels ();
+  vertices = geometry_vertices (data);
+  n_parts = read_uint32 (data + HEADER_N_PARTS);
+
+  for (unsigned int i = 0; i < n_points; i++)
+    results[i] = FALSE;
+
+  for (guint32 p = 0; p < n_parts; p++)
+    {
+      const guint8 *part = geometry_part (data, p);
+      const guint8 *outer = geometry_ring (data, read_uint32 (part + PART_FIRST_RING));
+      guint32 start = read_uint32 (outer + RING_START);
+      guint32 end = read_uint32 (outer + RING_END);
+      double min_x, max_x, min_y, max_y;
+      unsigned int n_batch = 0;
+
+      min_x = read_double (part + PART_MIN_X);
+      max_x = read_double (part + PART_MAX_X);
+      min_y = read_double (part + PART_MIN_Y);
+      max_y = read_double (part + PART_MAX_Y);
+
+      if (start == end)
+        continue;
+
+      /* The last iteration only runs the final batch */
+      for (unsigned int i = 0; i <= n_points; i++)
+        {
+          if (i < n_points)
+            {
+              double x = normalize_longitude (points[2 * i]);
+              double y = points[2 * i + 1];
+
+              /* Only points not yet found and within the extents of the part
+               * are queued for the edge pass */
+              if (results[i] || !extents_contain (min_x, max_x, min_y, max_y, x, y))
+                continue;
+
+              xs[n_batch] = x;
+              ys[n_batch] = y;
+              indices[n_batch++] = i;
+
+              if (n_batch < PIP_BATCH_SIZE)
+                continue;
+            }
+
+          if (n_batch == 0)
+            continue;
+
+          memset (inside, 0, sizeof (inside));
+          kernels->ring_contains_batch (vertices, start, end, xs, ys, n_batch, inside);
+          geometry_part_exclude_holes (data, part, xs, ys, n_batch, inside);
+
+          for (unsigned int k = 0; k < n_batch; k++)
+            results[indices[k]] = inside[k];
+
+          n_batch = 0;
+        }
+    }
+
+  for (unsigned int i = 0; i < n_points; i++)
+    n_inside += !!results[i];
+
+  return n_inside;
+}
+
+/**
+ * atrebas_geometry_intersects:
+ * @data: encoded geometry
+ * @left: left extent
+ * @top: top extent
+ * @right: right extent
+ * @bottom: bottom extent
+ *
+ * Check if the bounding box defined by @top, @right, @bottom and @left
+ * intersects with the extents of @data, which may wrap across the antimeridian.
+ *
+ * Returns: %TRUE if inside, %FALSE if outside
+ */
+gboolean
+atrebas_geometry_intersects (const guint8 *data,
+                             double        left,
+                             double        top,
+                             double        right,
+                             double        bottom)
+{
+  double min_x, max_x;
+
+  g_return_val_if_fail (data != NULL, FALSE);
+
+  min_x = read_double (data + HEADER_MIN_X);
+  max_x = read_double (data + HEADER_MAX_X);
+
+  if (!(read_double (data + HEADER_MIN_Y) <= top &&
+        bottom <= read_double (data + HEADER_MAX_Y)))
+    return FALSE;
+
+  if (min_x > max_x)
+    return (min_x <= right || left <= max_x);
+
+  return (min_x <= right && left <= max_x);
+}
+
+
+/*
+ * Derived Attributes
+ *
+ * Attributes that take a pass over the vertices, computed once when a feature
+ * is stored rather than each time it is loaded.
+ */
+#define EARTH_RADIUS_KM      6371.0088
+
+/* A label point is searched for in at most LABEL_MAX_CELLS cells, and to
+ * within LABEL_PRECISION of the larger side of the part */
+#define LABEL_MAX_CELLS      512
+#define LABEL_MIN_SPLIT      64
+#define LABEL_PRECISION      1e-3
+
+typedef struct
+{
+  double x;
+  double y;
+  double h;
+  double distance;
+  double max;
+} LabelCell;
+
+/* The area of a ring on a sphere, in square kilometres. Each edge contributes
+ * the lune between it and the pole, after "Some Algorithms for Polygons on a
+ * Sphere" (Chamberlain & Duquette, 2007). */
+static double
+geometry_ring_area (const guint8 *data,
+                    const guint8 *ring)
+{
+  const guint8 *vertices = geometry_vertices (data);
+  guint32 start = read_uint32 (ring + RING_START);
+  guint32 end = read_uint32 (ring + RING_END);
+  double area = 0.0;
+
+  if (end - start < 3)
+    return 0.0;
+
+  for (guint32 i = start, j = end - 1; i < end; j = i++)
+    {
+      const guint8 *next = vertices + i * VERTEX_SIZE;
+      const guint8 *prev = vertices + j * VERTEX_SIZE;
+      double dx = read_double (next) - read_double (prev);
+
+      area += dx * (2.0 + sin (read_double (prev + sizeof (double)) * G_PI / 180.0) +
+                          sin (read_double (next + sizeof (double)) * G_PI / 180.0));
+    }
+
+  return fabs (area * G_PI / 180.0 * EARTH_RADIUS_KM * EARTH_RADIUS_KM / 2.0);
+}
+
+static double
+geometry_part_area (const guint8 *data,
+                    const guint8 *part)
+{
+  guint32 first_ring = read_uint32 (part + PART_FIRST_RING);
+  guint32 last_ring = first_ring + read_uint32 (part + PART_N_RINGS);
+  double area;
+
+  area = geometry_ring_area (data, geometry_ring (data, first_ring));
+
+  for (guint32 r = first_ring + 1; r < last_ring; r++)
+    area -= geometry_ring_area (data, geometry_ring (data, r));
+
+  return MAX (area, 0.0);
+}
+
+/* The distance from (@x, @y) to the nearest edge of @part, with longitudes
+ * scaled by @kx, positive inside the part and negative outside */
+static double
+geometry_part_distance (const guint8 *data,
+                        const guint8 *part,
+                        double        kx,
+                        double        x,
+                        double        y)
+{
+  const guint8 *vertices = geometry_vertices (data);
+  guint32 first_ring = read_uint32 (part + PART_FIRST_RING);
+  guint32 last_ring = first_ring + read_uint32 (part + PART_N_RINGS);
+  double min_d2 = G_MAXDOUBLE;
+
+  for (guint32 r = first_ring; r < last_ring; r++)
+    {
+      const guint8 *ring = geometry_ring (data, r);
+      guint32 start = read_uint32 (ring + RING_START);
+      guint32 end = read_uint32 (ring + RING_END);
+
+      if (start == end)
+        continue;
+
+      for (guint32 i = start, j = end - 1; i < end; j = i++)
+        {
+          const guint8 *next = vertices + i * VERTEX_SIZE;
+          const guint8 *prev = vertices + j * VERTEX_SIZE;
+          double ax = (read_double (prev) - x) * kx;
+          double ay = read_double (prev + sizeof (double)) - y;
+          double dx = (read_double (next) - x) * kx - ax;
+          double dy = read_double (next + sizeof (double)) - y - ay;
+          double len2 = dx * dx + dy * dy;
+          double t = 0.0;
+
+          /* Project the point onto the edge, clamped to its ends */
+          if (len2 > 0.0)
+            t = CLAMP (-(ax * dx + ay * dy) / len2, 0.0, 1.0);
+
+          ax += t * dx;
+          ay += t * dy;
+          min_d2 = MIN (min_d2, ax * ax + ay * ay);
+        }
+    }
+
+  if (min_d2 == G_MAXDOUBLE)
+    return 0.0;
+
+  if (geometry_part_contains (data, part, x, y))
+    return sqrt (min_d2);
+
+  return -sqrt (min_d2);
+}
+
+static inline LabelCell
+label_cell_new (const guint8 *data,
+                const guint8 *part,
+                double        kx,
+                double        x,
+                double        y,
+                double        h)
+{
+  LabelCell cell = { x, y, h, 0.0, 0.0 };
+
+  /* The best distance any point in the cell could have */
+  cell.distance = geometry_part_distance (data, part, kx, x, y);
+  cell.max = cell.distance + h * G_SQRT2;
+
+  return cell;
+}
+
+/* A binary max-heap of cells, ordered by their potential */
+static void
+label_queue_push (GArray    *queue,
+                  LabelCell  cell)
+{
+  LabelCell *cells;
+  guint i = queue->len;
+
+  g_array_append_val (queue, cell);
+  cells = (LabelCell *)queue->data;
+
+  while (i > 0 && cells[(i - 1) / 2].max < cells[i].max)
+    {
+      LabelCell tmp = cells[i];
+
+      cells[i] = cells[(i - 1) / 2];
+      cells[(i - 1) / 2] = tmp;
+      i = (i - 1) / 2;
+    }
+}
+
+static LabelCell
+label_queue_pop (GArray *queue)
+{
+  LabelCell *cells = (LabelCell *)queue->data;
+  LabelCell ret = cells[0];
+  guint i = 0;
+
+  cells[0] = cells[queue->len - 1];
+  g_array_set_size (queue, queue->len - 1);
+
+  for (;;)
+    {
+      guint l = 2 * i + 1;
+      guint r = l + 1;
+      guint largest = i;
+      LabelCell tmp;
+
+      if (l < queue->len && cells[l].max > cells[largest].max)
+        largest = l;
+
+      if (r < queue->len && cells[r].max > cells[largest].max)
+        largest = r;
+
+      if (largest == i)
+        break;
+
+      tmp = cells[i];
+      cells[i] = cells[largest];
+      cells[largest] = tmp;
+      i = largest;
+    }
+
+  return ret;
+}
+
+/* The pole of inaccessibility of @part, the point inside it furthest from its
+ * edges, after "polylabel" (Agafonkin, 2016):
+ *
+ *     Copyright (c) 2016 Mapbox
+ *     https://github.com/mapbox/polylabel
+ */
+static void
+geometry_part_label_point (const guint8 *data,
+                           const guint8 *part,
+                           double       *x,
+                           double       *y)
+{
+  g_autoptr (GArray) queue = NULL;
+  double min_x = read_double (part + PART_MIN_X);
+  double max_x = read_double (part + PART_MAX_X);
+  double min_y = read_double (part + PART_MIN_Y);
+  double max_y = read_double (part + PART_MAX_Y);
+  double kx, width, height, cell_size, precision;
+  LabelCell best;
+  unsigned int n_cells = 0;
+
+  /* Distances are taken with longitudes scaled to the middle latitude, so the
+   * label is not drawn towards the poles */
+  kx = MAX (cos ((min_y + max_y) / 2 * G_PI / 180.0), 1e-6);
+  width = (max_x - min_x) * kx;
+  height = max_y - min_y;
+  cell_size = MAX (MIN (width, height), MAX (width, height) / LABEL_MIN_SPLIT);
+  precision = MAX (width, height) * LABEL_PRECISION;
+
+  best = label_cell_new (data, part, kx, min_x + (max_x - min_x) / 2,
+                         min_y + height / 2, 0.0);
+
+  if (cell_size <= 0.0)
+    {
+      *x = best.x;
+      *y = best.y;
+      return;
+    }
+
+  /* Cover the part with square cells, in scaled units */
+  queue = g_array_new (FALSE, FALSE, sizeof (LabelCell));
+
+  for (double cy = min_y; cy < max_y; cy += cell_size)
+    {
+      for (double cx = 0.0; cx < width; cx += cell_size)
+        {
+          label_queue_push (queue,
+                            label_cell_new (data, part, kx,
+                                            min_x + (cx + cell_size / 2) / kx,
+                                            cy + cell_size / 2,
+                                            cell_size / 2));
+          n_cells++;
+        }
+    }
+
+  /* Split the most promising cells, until none can beat the best */
+  while (queue->len > 0)
+    {
+      LabelCell cell = label_queue_pop (queue);
+      double h = cell.h / 2;
+
+      if (cell.distance > best.distance)
+        best = cell;
+
+      if (cell.max - best.distance <= precision || n_cells >= LABEL_MAX_CELLS)
+        continue;
+
+      for (unsigned int i = 0; i < 4; i++)
+        {
+          double cx = cell.x + ((i & 1) ? h : -h) / kx;
+          double cy = cell.y + ((i & 2) ? h : -h);
+
+          label_queue_push (queue, label_cell_new (data, part, kx, cx, cy, h));
+          n_cells++;
+        }
+    }
+
+  *x = best.x;
+  *y = best.y;
+}
+
+/**
+ * atrebas_geometry_get_area:
+ * @data: encoded geometry
+ *
+ * Get the area of @data on a spherical Earth, less the area of any holes.
+ *
+ * Returns: an area in square kilometres
+ */
+double
+atrebas_geometry_get_area (const guint8 *data)
+{
+  guint32 n_parts;
+  double area = 0.0;
+
+  g_return_val_if_fail (data != NULL, 0.0);
+
+  n_parts = read_uint32 (data + HEADER_N_PARTS);
+
+  for (guint32 i = 0; i < n_parts; i++)
+    area += geometry_part_area (data, geometry_part (data, i));
+
+  return area;
+}
+
+/**
+ * atrebas_geometry_get_label_point:
+ * @data: encoded geometry
+ * @x: (out): X-axis coordinate (longitude)
+ * @y: (out): Y-axis coordinate (latitude)
+ *
+ * Get a point to place a label or marker for @data. This is the point in the
+ * largest part of @data that is furthest from its edges, so unlike the center
+ * of the extents it is inside concave or holed polygons.
+ *
+ * This takes many passes over the vertices of the part, so should be computed
+ * once and stored.
+ */
+void
+atrebas_geometry_get_label_point (const guint8 *data,
+                                  double       *x,
+                                  double       *y)
+{
+  guint32 n_parts;
+  const guint8 *largest = NULL;
+  double largest_area = -1.0;
+
+  g_return_if_fail (data != NULL);
+  g_return_if_fail (x != NULL && y != NULL);
+
+  n_parts = read_uint32 (data + HEADER_N_PARTS);
+
+  for (guint32 i = 0; i < n_parts; i++)
+    {
+      const guint8 *part = geometry_part (data, i);
+      double area = geometry_part_area (data, part);
+
+      if (area > largest_area)
+        {
+          largest = part;
+          largest_area = area;
+        }
+    }
+
+  if (largest == NULL)
+    {
+      atrebas_geometry_get_center (data, x, y);
+      return;
+    }
+
+  geometry_part_label_point (data, largest, x, y);
+}
+
+
+/*
+ * Cell Covering
+ *
+ * A quadtree over the extents of the geometry, with each cell labelled as
+ * outside, inside or crossed by the boundary. The encoding begins with a
+ * header:
+ *
+ * |[
+ * guint32 version;
+ * guint32 n_nodes;
+ * double  min_x, max_x, min_y, max_y;
+ * ]|
+ *
+ * followed by `n_nodes` #guint32 nodes, starting with the root. The low two
+ * bits of a node are its kind; the rest are the index of its first child if
+ * it is split. The four children of a node are contiguous, ordered south-west,
+ * south-east, north-west, north-east.
+ *
+ * The extents of a covering never wrap; for a geometry that crosses the
+ * antimeridian `max_x` is past 180°, and the parts west of the antimeridian are
+ * moved east by a full turn.
+ */
+#define COVER_HEADER_SIZE    (2 * sizeof (guint32) + 4 * sizeof (double))
+#define COVER_VERSION        0
+#define COVER_N_NODES        4
+#define COVER_MIN_X          8
+#define COVER_MAX_X          16
+#define COVER_MIN_Y          24
+#define COVER_MAX_Y          32
+
+#define COVER_SPLIT          3
+#define COVER_MAX_DEPTH      12
+#define COVER_MAX_NODES      1024
+
+/* Cells are inflated by this fraction of the extents when checking for edges,
+ * so that rounding in the crossing test can not contradict a label */
+#define COVER_EPSILON        1e-9
+
+typedef struct
+{
+  double  min_x;
+  double  min_y;
+  double  max_x;
+  double  max_y;
+  guint32 node;
+  guint32 depth;
+  guint32 first_edge;
+  guint32 n_edges;
+} CoverCell;
+
+typedef struct
+{
+  guint32 prev;
+  guint32 next;
+  double  shift;
+} CoverEdge;
+
+static inline gboolean
+segment_intersects_box (double x1,
+                        double y1,
+                        double x2,
+                        double y2,
+                        double left,
+                        double bottom,
+                        double right,
+                        double top)
+{
+  double dx = x2 - x1;
+  double dy = y2 - y1;
+  double c1, c2, c3, c4;
+
+  if (MAX (x1, x2) < left || MIN (x1, x2) > right ||
+      MAX (y1, y2) < bottom || MIN (y1, y2) > top)
+    return FALSE;
+
+  /* The segment crosses the box if its line separates any of the corners */
+  c1 = dx * (bottom - y1) - dy * (left - x1);
+  c2 = dx * (bottom - y1) - dy * (right - x1);
+  c3 = dx * (top - y1) - dy * (left - x1);
+  c4 = dx * (top - y1) - dy * (right - x1);
+
+  return !((c1 > 0 && c2 > 0 && c3 > 0 && c4 > 0) ||
+           (c1 < 0 && c2 < 0 && c3 < 0 && c4 < 0));
+}
+
+/**
+ * atrebas_geometry_cover:
+ * @data: encoded geometry
+ *
+ * Build a cell covering for @data: a quadtree over the extents of the outermost
+ * rings, subdivided where the boundary of a part or hole crosses it, with every
+ * cell labelled as outside, inside or crossed by the boundary.
+ *
+ * Cells are subdivided breadth-first, to a fixed depth and number of cells, so
+ * the covering of a large polygon is as even as its budget allows.
+ *
+ * Returns: (transfer full): the encoded covering
+ */
+GBytes *
+atrebas_geometry_cover (const guint8 *data)
+{
+  g_autoptr (GArray) nodes = NULL;
+  g_autoptr (GArray) edges = NULL;
+  g_autoptr (GQueue) cells = NULL;
+  const guint8 *vertices;
+  guint32 n_parts;
+  double min_x, max_x, min_y, max_y;
+  double epsilon;
+  CoverCell *cell;
+  guint8 *cover, *ptr;
+  size_t size;
+
+  g_return_val_if_fail (data != NULL, NULL);
+
+  vertices = geometry_vertices (data);
+  n_parts = read_uint32 (data + HEADER_N_PARTS);
+  atrebas_geometry_get_bounds (data, &min_x, &max_x, &min_y, &max_y);
+
+  nodes = g_array_new (FALSE, TRUE, sizeof (guint32));
+  edges = g_array_new (FALSE, FALSE, sizeof (CoverEdge));
+  cells = g_queue_new ();
+
+  /* The root cell starts with every edge of every ring, holes included, with
+   * the parts west of a wrapped antimeridian moved east to meet the others */
+  for (guint32 p = 0; p < n_parts; p++)
+    {
+      const guint8 *part = geometry_part (data, p);
+      guint32 first_ring = read_uint32 (part + PART_FIRST_RING);
+      guint32 last_ring = first_ring + read_uint32 (part + PART_N_RINGS);
+      double shift = 0.0;
+
+      if (min_x > max_x && read_double (part + PART_MIN_X) < min_x)
+        shift = 360.0;
+
+      for (guint32 r = first_ring; r < last_ring; r++)
+        {
+          const guint8 *ring = geometry_ring (data, r);
+          guint32 start = read_uint32 (ring + RING_START);
+          guint32 end = read_uint32 (ring + RING_END);
+
+          for (guint32 i = start, j = end - 1; i < end; j = i++)
+            {
+              CoverEdge edge = { j, i, shift };
+
+              g_array_append_val (edges, edge);
+            }
+        }
+    }
+
+  if (min_x > max_x)
+    max_x += 360.0;
+
+  epsilon = COVER_EPSILON * ((max_x - min_x) + (max_y - min_y));
+
+  g_array_set_size (nodes, 1);
+  cell = g_new0 (CoverCell, 1);
+  *cell = (CoverCell){ min_x, min_y, max_x, max_y, 0, 0, 0, edges->len };
+  g_queue_push_tail (cells, cell);
+
+  while ((cell = g_queue_pop_head (cells)) != NULL)
+    {
+      guint32 *node = &g_array_index (nodes, guint32, cell->node);
+      guint32 first_edge = edges->len;
+      guint32 first_child;
+      double mid_x, mid_y;
+
+      /* Keep the edges that cross this cell */
+      for (guint32 k = cell->first_edge; k < cell->first_edge + cell->n_edges; k++)
+        {
+          CoverEdge edge = g_array_index (edges, CoverEdge, k);
+          const guint8 *next = vertices + edge.next * VERTEX_SIZE;
+          const guint8 *prev = vertices + edge.prev * VERTEX_SIZE;
+
+          if (segment_intersects_box (read_double (prev) + edge.shift,
+                                      read_double (prev + sizeof (double)),
+                                      read_double (next) + edge.shift,
+                                      read_double (next + sizeof (double)),
+                                      cell->min_x - epsilon,
+                                      cell->min_y - epsilon,
+                                      cell->max_x + epsilon,
+                                      cell->max_y + epsilon))
+            g_array_append_val (edges, edge);
+        }
+
+      /* A cell without edges is entirely on one side of the boundary */
+      if (edges->len == first_edge)
+        {
+          gboolean inside;
+
+          inside = atrebas_geometry_contains_point (data,
+                                                    cell->min_x + (cell->max_x - cell->min_x) / 2,
+                                                    cell->min_y + (cell->max_y - cell->min_y) / 2);
+          *node = inside ? ATREBAS_GEOMETRY_REGION_INSIDE
+                         : ATREBAS_GEOMETRY_REGION_OUTSIDE;
+          g_free (cell);
+          continue;
+        }
+
+      if (cell->depth >= COVER_MAX_DEPTH || nodes->len + 4 > COVER_MAX_NODES)
+        {
+          *node = ATREBAS_GEOMETRY_REGION_BOUNDARY;
+          g_free (cell);
+          continue;
+        }
+
+      /* Split the cell, with the same midpoints as atrebas_geometry_cover_locate() */
+      first_child = nodes->len;
+      *node = (first_child << 2) | COVER_SPLIT;
+      g_array_set_size (nodes, first_child + 4);
+
+      mid_x = cell->min_x + (cell->max_x - cell->min_x) / 2;
+      mid_y = cell->min_y + (cell->max_y - cell->min_y) / 2;
+
+      for (guint32 q = 0; q < 4; q++)
+        {
+          CoverCell *child = g_new0 (CoverCell, 1);
+
+          child->min_x = (q & 1) ? mid_x : cell->min_x;
+          child->max_x = (q & 1) ? cell->max_x : mid_x;
+          child->min_y = (q & 2) ? mid_y : cell->min_y;
+          child->max_y = (q & 2) ? cell->max_y : mid_y;
+          child->node = first_child + q;
+          child->depth = cell->depth + 1;
+          child->first_edge = first_edge;
+          child->n_edges = edges->len - first_edge;
+          g_queue_push_tail (cells, child);
+        }
+
+      g_free (cell);
+    }
+
+  /* Pack the header and nodes */
+  size = COVER_HEADER_SIZE + nodes->len * sizeof (guint32);
+  cover = g_malloc0 (size);
+
+  write_uint32 (cover + COVER_VERSION, ATREBAS_GEOMETRY_COVER_VERSION);
+  write_uint32 (cover + COVER_N_NODES, nodes->len);
+  write_double (cover + COVER_MIN_X, min_x);
+  write_double (cover + COVER_MAX_X, max_x);
+  write_double (cover + COVER_MIN_Y, min_y);
+  write_double (cover + COVER_MAX_Y, max_y);
+
+  ptr = cover + COVER_HEADER_SIZE;
+  for (unsigned int i = 0; i < nodes->len; i++, ptr += sizeof (guint32))
+    write_uint32 (ptr, g_array_index (nodes, guint32, i));
+
+  return g_bytes_new_take (cover, size);
+}
+
+/**
+ * atrebas_geometry_cover_validate:
+ * @cover: (array length=size): encoded covering
+ * @size: the size of @cover
+ *
+ * Check that @cover is a complete covering of a supported version.
+ *
+ * Returns: %TRUE if valid, %FALSE if not
+ */
+gboolean
+atrebas_geometry_cover_validate (const guint8 *cover,
+                                 size_t        size)
+{
+  guint32 n_nodes;
+
+  if (cover == NULL || size < COVER_HEADER_SIZE + sizeof (guint32))
+    return FALSE;
+
+  if (read_uint32 (cover + COVER_VERSION) != ATREBAS_GEOMETRY_COVER_VERSION)
+    return FALSE;
+
+  n_nodes = read_uint32 (cover + COVER_N_NODES);
+
+  return n_nodes > 0 &&
+         n_nodes == (size - COVER_HEADER_SIZE) / sizeof (guint32) &&
+         size == COVER_HEADER_SIZE + n_nodes * sizeof (guint32);
+}
+
+/**
+ * atrebas_geometry_cover_locate:
+ * @cover: encoded covering
+ * @x: X-axis coordinate of the test point
+ * @y: Y-axis coordinate of the test point
+ *
+ * Find the region of the point (@x, @y) in @cover, as built by
+ * atrebas_geometry_cover(). Only a point in a cell crossed by the boundary
+ * needs to be tested with atrebas_geometry_contains_point().
+ *
+ * Returns: a #AtrebasGeometryRegion
+ */
+AtrebasGeometryRegion
+atrebas_geometry_cover_locate (const guint8 *cover,
+                               double        x,
+                               double        y)
+{
+  const guint8 *nodes;
+  guint32 n_nodes;
+  guint32 index = 0;
+  double min_x, max_x, min_y, max_y;
+
+  g_return_val_if_fail (cover != NULL, ATREBAS_GEOMETRY_REGION_BOUNDARY);
+
+  min_x = read_double (cover + COVER_MIN_X);
+  max_x = read_double (cover + COVER_MAX_X);
+  min_y = read_double (cover + COVER_MIN_Y);
+  max_y = read_double (cover + COVER_MAX_Y);
+
+  /* A covering across the antimeridian continues past 180° */
+  x = normalize_longitude (x);
+
+  if (x < min_x)
+    x += 360.0;
+
+  if (!(x >= min_x && x <= max_x && y >= min_y && y <= max_y))
+    return ATREBAS_GEOMETRY_REGION_OUTSIDE;
+
+  nodes = cover + COVER_HEADER_SIZE;
+  n_nodes = read_uint32 (cover + COVER_N_NODES);
+
+  while (index < n_nodes)
+    {
+      guint32 node = read_uint32 (nodes + index * sizeof (guint32));
+      guint32 first_child = node >> 2;
+      double mid_x, mid_y;
+      guint32 q = 0;
+
+      if ((node & 0x3) != COVER_SPLIT)
+        return (AtrebasGeometryRegion)(node & 0x3);
+
+      /* Children always follow their parent, so a corrupt node can not loop */
+      if G_UNLIKELY (first_child <= index || first_child + 4 > n_nodes)
+        break;
+
+      mid_x = min_x + (max_x - min_x) / 2;
+      mid_y = min_y + (max_y - min_y) / 2;
+
+      if (x >= mid_x)
+        {
+          min_x = mid_x;
+          q |= 1;
+        }
+      else
+        {
+          max_x = mid_x;
+        }
+
+      if (y >= mid_y)
+        {
+          min_y = mid_y;
+          q |= 2;
+        }
+      else
+        {
+          max_y = mid_y;
+        }
+
+      index = first_child + q;
+    }
+
+  return ATREBAS_GEOMETRY_REGION_BOUNDARY;
+}
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// SPDX-FileCopyrightText: 2022 Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * ATREBAS_GEOMETRY_VERSION:
+ *
+ * The version of the packed geometry encoding.
+ */
+#define ATREBAS_GEOMETRY_VERSION 4
+
+/**
+ * ATREBAS_GEOMETRY_COVER_VERSION:
+ *
+ * The version of the cell covering encoding, built by
+ * atrebas_geometry_cover().
+ */
+#define ATREBAS_GEOMETRY_COVER_VERSION 1
+
+
+/**
+ * AtrebasGeometryRegion:
+ * @ATREBAS_GEOMETRY_REGION_OUTSIDE: Entirely outside the geometry
+ * @ATREBAS_GEOMETRY_REGION_INSIDE: Entirely inside the geometry
+ * @ATREBAS_GEOMETRY_REGION_BOUNDARY: Crossed by the boundary of the geometry
+ *
+ * Enumeration of the labels of a cell in a covering, built by
+ * atrebas_geometry_cover().
+ */
+typedef enum
+{
+  ATREBAS_GEOMETRY_REGION_OUTSIDE,
+  ATREBAS_GEOMETRY_REGION_INSIDE,
+  ATREBAS_GEOMETRY_REGION_BOUNDARY,
+} AtrebasGeometryRegion;
+
+typedef struct _AtrebasGeometryBuilder AtrebasGeometryBuilder;
+
+AtrebasGeometryBuilder * atrebas_geometry_builder_new        (void);
+void                     atrebas_geometry_builder_free       (AtrebasGeometryBuilder *builder);
+void                     atrebas_geometry_builder_reset      (AtrebasGeometryBuilder *builder);
+void                     atrebas_geometry_builder_add_part   (AtrebasGeometryBuilder *builder);
+void                     atrebas_geometry_builder_add_ring   (AtrebasGeometryBuilder *builder);
+void                     atrebas_geometry_builder_add_vertex (AtrebasGeometryBuilder *builder,
+                                                              double                  x,
+                                                              double                  y);
+GBytes                 * atrebas_geometry_builder_end        (AtrebasGeometryBuilder *builder);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (AtrebasGeometryBuilder, atrebas_geometry_builder_free)
+
+GBytes       * atrebas_geometry_encode          (JsonArray    *coordinates);
+gboolean       atrebas_geometry_validate        (const guint8 *data,
+                                                 size_t        size);
+JsonArray    * atrebas_geometry_to_json         (const guint8 *data,
+                                                 size_t        size);
+void           atrebas_geometry_get_bounds      (const guint8 *data,
+                                                 double       *min_x,
+                                                 double       *max_x,
+                                                 double       *min_y,
+                                                 double       *max_y);
+void           atrebas_geometry_get_center      (const guint8 *data,
+                                                 double       *x,
+                                                 double       *y);
+unsigned int   atrebas_geometry_get_n_parts     (const guint8 *data);
+void           atrebas_geometry_get_part        (const guint8 *data,
+                                                 unsigned int  part,
+                                                 unsigned int *first_ring,
+                                                 unsigned int *last_ring);
+void           atrebas_geometry_get_part_bounds (const guint8 *data,
+                                                 unsigned int  part,
+                                                 double       *min_x,
+                                                 double       *max_x,
+                                                 double       *min_y,
+                                                 double       *max_y);
+unsigned int   atrebas_geometry_get_n_rings     (const guint8 *data);
+void           atrebas_geometry_get_ring        (const guint8 *data,
+                                                 unsigned int  ring,
+                                                 unsigned int *start,
+                                                 unsigned int *end);
+void           atrebas_geometry_get_ring_bounds (const guint8 *data,
+                                                 unsigned int  ring,
+                                                 double       *min_x,
+                                                 double       *max_x,
+                                                 double       *min_y,
+                                                 double       *max_y);
+unsigned int   atrebas_geometry_get_n_vertices  (const guint8 *data);
+void           atrebas_geometry_get_vertex      (const guint8 *data,
+                                                 unsigned int  index,
+                                                 double       *x,
+                                                 double       *y);
+gboolean       atrebas_geometry_contains_point  (const guint8 *data,
+                                                 double        x,
+                                                 double        y);
+unsigned int   atrebas_geometry_contains_points (const guint8 *data,
+                                                 const double *points,
+                                                 unsigned int  n_points,
+                                                 gboolean     *results);
+gboolean       atrebas_geometry_intersects      (const guint8 *data,
+                                                 double        left,
+                                                 double        top,
+                                                 double        right,
+                                                 double        bottom);
+double         atrebas_geometry_get_area        (const guint8 *data);
+void           atrebas_geometry_get_label_point (const guint8 *data,
+                                                 double       *x,
+                                                 double       *y);
+
+GBytes                * atrebas_geometry_cover          (const guint8 *data);
+gboolean                atrebas_geometry_cover_validate (const guint8 *cover,
+                                                         size_t        size);
+AtrebasGeometryRegion   atrebas_geometry_cover_locate   (const guint8 *cover,
+                                                         double        x,
+                                                         double        y);
+
+G_END_DECLS
+
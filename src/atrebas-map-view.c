@@ -267,6 +267,11 @@ atrebas_map_view_get_zoom_for_place (AtrebasMapView   *self,
       double max_x = shumate_map_source_get_x (source, zoom, right);
       double max_y = shumate_map_source_get_y (source, zoom, top);
 
+      /* Extents across the antimeridian continue into the next world */
+      if (left > right)
+        max_x += shumate_map_source_get_x (source, zoom, 180.0) -
+                 shumate_map_source_get_x (source, zoom, -180.0);
+
       if (min_y - max_y <= height && max_x - min_x <= width)
         good = TRUE;
       else
@@ -363,6 +368,8 @@ atrebas_map_view_resolve (AtrebasMapView *self)
   /* Query features */
   params = atrebas_geocode_parameters_for_coordinates (self->latitude,
                                                    self->longitude);
+  atrebas_geocode_parameters_add_int (params, "priority", G_PRIORITY_HIGH);
+  atrebas_geocode_parameters_add_pointer (params, "coalesce", self);
   geocode_backend_reverse_resolve_async (atrebas_backend_get_default (),
                                          params,
                                          self->cancellable,
@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// SPDX-FileCopyrightText: 2022 Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+/*
+ * atrebas-mkdb OUTPUT LANGUAGES TERRITORIES TREATIES
+ *
+ * Build the prebuilt feature database from the bundled GeoJSON maps, so that
+ * a new installation doesn't have to import them on first launch. The maps are
+ * imported under the source key of their theme, rather than the path they are
+ * read from in the build tree, so a later update replaces their features.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <sqlite3.h>
+
+#include "atrebas-backend.h"
+#include "atrebas-backend-private.h"
+
+
+static gboolean done = FALSE;
+
+static void
+load_cb (AtrebasBackend *backend,
+         GAsyncResult   *result,
+         GError        **error)
+{
+  atrebas_backend_load_finish (backend, result, error);
+  done = TRUE;
+}
+
+static gboolean
+compact_database (const char  *path,
+                  GError     **error)
+{
+  sqlite3 *connection = NULL;
+  int rc;
+
+  /* Leave a single, compact file without a write-ahead log */
+  if ((rc = sqlite3_open (path, &connection)) == SQLITE_OK)
+    rc = sqlite3_exec (connection,
+                       "PRAGMA journal_mode=DELETE; VACUUM;",
+                       NULL,
+                       NULL,
+                       NULL);
+
+  if (rc != SQLITE_OK)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_FAILED,
+                   "%s: [%i] %s",
+                   path, rc, sqlite3_errmsg (connection));
+    }
+
+  sqlite3_close (connection);
+
+  return rc == SQLITE_OK;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_autoptr (GeocodeBackend) backend = NULL;
+  static const AtrebasMapTheme themes[] = {
+    ATREBAS_MAP_THEME_LANGUAGE,
+    ATREBAS_MAP_THEME_TERRITORY,
+    ATREBAS_MAP_THEME_TREATY,
+  };
+  GError *error = NULL;
+
+  if (argc != (int)(2 + G_N_ELEMENTS (themes)))
+    {
+      g_printerr ("Usage: %s OUTPUT LANGUAGES TERRITORIES TREATIES\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  /* Start from an empty database */
+  if (g_remove (argv[1]) == -1 && errno != ENOENT)
+    {
+      g_printerr ("%s: %s\n", argv[1], g_strerror (errno));
+      return EXIT_FAILURE;
+    }
+
+  backend = g_object_new (ATREBAS_TYPE_BACKEND,
+                          "bundled", FALSE,
+                          "path",    argv[1],
+                          NULL);
+
+  for (unsigned int i = 0; i < G_N_ELEMENTS (themes) && error == NULL; i++)
+    {
+      atrebas_backend_load_bundled (ATREBAS_BACKEND (backend),
+                                    argv[2 + i],
+                                    themes[i],
+                                    NULL,
+                                    (GAsyncReadyCallback)load_cb,
+                                    &error);
+
+      while (!done)
+        g_main_context_iteration (NULL, TRUE);
+      done = FALSE;
+    }
+
+  /* Closing the backend checkpoints the database */
+  g_clear_object (&backend);
+
+  if (error == NULL)
+    compact_database (argv[1], &error);
+
+  if (error != NULL)
+    {
+      g_printerr ("%s\n", error->message);
+      g_clear_error (&error);
+      g_remove (argv[1]);
+
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
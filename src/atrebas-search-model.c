@@ -240,6 +240,8 @@ atrebas_search_model_update_idle (gpointer data)
       self->cancellable = g_cancellable_new ();
       params = atrebas_geocode_parameters_for_coordinates (self->latitude,
                                                        self->longitude);
+      atrebas_geocode_parameters_add_int (params, "priority", G_PRIORITY_HIGH);
+      atrebas_geocode_parameters_add_pointer (params, "coalesce", self);
       geocode_backend_reverse_resolve_async (self->backend,
                                              params,
                                              self->cancellable,
@@ -255,6 +257,8 @@ atrebas_search_model_update_idle (gpointer data)
 
       self->cancellable = g_cancellable_new ();
       params = atrebas_geocode_parameters_for_location (self->query);
+      atrebas_geocode_parameters_add_int (params, "priority", G_PRIORITY_HIGH);
+      atrebas_geocode_parameters_add_pointer (params, "coalesce", self);
       geocode_backend_forward_search_async (self->backend,
                                             params,
                                             self->cancellable,
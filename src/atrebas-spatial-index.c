@@ -0,0 +1,394 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// SPDX-FileCopyrightText: 2022 Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#define G_LOG_DOMAIN "atrebas-spatial-index"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "atrebas-spatial-index.h"
+
+
+/**
+ * SECTION:atrebasspatialindex
+ * @short_description: A packed R-tree of bounding boxes
+ * @title: Spatial Index
+ * @stability: Unstable
+ * @include: atrebas.h
+ *
+ * An immutable, static R-tree over the bounding boxes of a set of items,
+ * packed with the Sort-Tile-Recursive (STR) algorithm.
+ *
+ * The tree is stored in flat arrays, one entry per node, with the leaves
+ * first and each level of the tree following the one below it. The children
+ * of a node are always contiguous, so a search only needs the offset of the
+ * first child and the end of its level.
+ *
+ * An index is reference counted and never modified once built, so it can be
+ * shared between threads without locking.
+ */
+
+#define NODE_SIZE  16
+#define MAX_LEVELS 16
+
+typedef struct
+{
+  double min_x;
+  double min_y;
+  double max_x;
+  double max_y;
+  gint64 id;
+} SpatialItem;
+
+struct _AtrebasSpatialIndexBuilder
+{
+  GArray *items;
+};
+
+struct _AtrebasSpatialIndex
+{
+  gatomicrefcount  ref_count;
+
+  unsigned int     n_items;
+  unsigned int     n_nodes;
+  unsigned int     n_levels;
+  unsigned int     level_ends[MAX_LEVELS];
+
+  /* min_x, min_y, max_x, max_y for each node */
+  double          *boxes;
+
+  /* The first child of each internal node, or the item of each leaf */
+  guint32         *children;
+  gint64          *ids;
+};
+
+
+static int
+spatial_item_compare_x (const void *a,
+                        const void *b)
+{
+  const SpatialItem *item1 = a;
+  const SpatialItem *item2 = b;
+  double x1 = item1->min_x + item1->max_x;
+  double x2 = item2->min_x + item2->max_x;
+
+  return (x1 > x2) - (x1 < x2);
+}
+
+static int
+spatial_item_compare_y (const void *a,
+                        const void *b)
+{
+  const SpatialItem *item1 = a;
+  const SpatialItem *item2 = b;
+  double y1 = item1->min_y + item1->max_y;
+  double y2 = item2->min_y + item2->max_y;
+
+  return (y1 > y2) - (y1 < y2);
+}
+
+static inline gboolean
+node_intersects (const double *box,
+                 double        left,
+                 double        top,
+                 double        right,
+                 double        bottom)
+{
+  return (box[0] <= right && left <= box[2] &&
+          box[1] <= top && bottom <= box[3]);
+}
+
+/**
+ * atrebas_spatial_index_builder_new:
+ *
+ * Create a new builder, for packing a #AtrebasSpatialIndex.
+ *
+ * Returns: (transfer full): a new #AtrebasSpatialIndexBuilder
+ */
+AtrebasSpatialIndexBuilder *
+atrebas_spatial_index_builder_new (void)
+{
+  AtrebasSpatialIndexBuilder *builder;
+
+  builder = g_new0 (AtrebasSpatialIndexBuilder, 1);
+  builder->items = g_array_new (FALSE, FALSE, sizeof (SpatialItem));
+
+  return builder;
+}
+
+/**
+ * atrebas_spatial_index_builder_free:
+ * @builder: (transfer full): a #AtrebasSpatialIndexBuilder
+ *
+ * Free @builder.
+ */
+void
+atrebas_spatial_index_builder_free (AtrebasSpatialIndexBuilder *builder)
+{
+  g_return_if_fail (builder != NULL);
+
+  g_clear_pointer (&builder->items, g_array_unref);
+  g_free (builder);
+}
+
+/**
+ * atrebas_spatial_index_builder_add:
+ * @builder: a #AtrebasSpatialIndexBuilder
+ * @id: an item ID
+ * @min_x: minimum X-axis extent (west)
+ * @max_x: maximum X-axis extent (east)
+ * @min_y: minimum Y-axis extent (south)
+ * @max_y: maximum Y-axis extent (north)
+ *
+ * Add an item with @id and the given extents to @builder.
+ */
+void
+atrebas_spatial_index_builder_add (AtrebasSpatialIndexBuilder *builder,
+                                   gint64                      id,
+                                   double                      min_x,
+                                   double                      max_x,
+                                   double                      min_y,
+                                   double                      max_y)
+{
+  SpatialItem item = { min_x, min_y, max_x, max_y, id };
+
+  g_return_if_fail (builder != NULL);
+
+  g_array_append_val (builder->items, item);
+}
+
+/**
+ * atrebas_spatial_index_builder_end:
+ * @builder: a #AtrebasSpatialIndexBuilder
+ *
+ * Pack the items added to @builder into a new index. The builder is reset and
+ * may be reused.
+ *
+ * Returns: (transfer full): a new #AtrebasSpatialIndex
+ */
+AtrebasSpatialIndex *
+atrebas_spatial_index_builder_end (AtrebasSpatialIndexBuilder *builder)
+{
+  AtrebasSpatialIndex *index;
+  SpatialItem *items;
+  unsigned int n_items;
+  unsigned int n_nodes;
+  unsigned int level_start, level_end, pos;
+
+  g_return_val_if_fail (builder != NULL, NULL);
+
+  items = (SpatialItem *)(void *)builder->items->data;
+  n_items = builder->items->len;
+
+  index = g_new0 (AtrebasSpatialIndex, 1);
+  g_atomic_ref_count_init (&index->ref_count);
+  index->n_items = n_items;
+
+  if (n_items == 0)
+    return index;
+
+  /* Sort-Tile-Recursive: sort by X into vertical slices of whole leaf pages,
+   * then sort each slice by Y */
+  if (n_items > NODE_SIZE)
+    {
+      unsigned int n_pages = (n_items + NODE_SIZE - 1) / NODE_SIZE;
+      unsigned int n_slices = (unsigned int)ceil (sqrt ((double)n_pages));
+      unsigned int slice_size = n_slices * NODE_SIZE;
+
+      qsort (items, n_items, sizeof (SpatialItem), spatial_item_compare_x);
+
+      for (unsigned int i = 0; i < n_items; i += slice_size)
+        {
+          qsort (items + i,
+                 MIN (slice_size, n_items - i),
+                 sizeof (SpatialItem),
+                 spatial_item_compare_y);
+        }
+    }
+
+  /* Count the nodes in each level, up to a single root */
+  n_nodes = n_items;
+
+  for (unsigned int n = n_items; n > 1; n = (n + NODE_SIZE - 1) / NODE_SIZE)
+    n_nodes += (n + NODE_SIZE - 1) / NODE_SIZE;
+
+  index->n_nodes = n_nodes;
+  index->boxes = g_new (double, 4 * n_nodes);
+  index->children = g_new (guint32, n_nodes);
+  index->ids = g_new (gint64, n_items);
+
+  /* The leaves */
+  for (unsigned int i = 0; i < n_items; i++)
+    {
+      index->boxes[4 * i + 0] = items[i].min_x;
+      index->boxes[4 * i + 1] = items[i].min_y;
+      index->boxes[4 * i + 2] = items[i].max_x;
+      index->boxes[4 * i + 3] = items[i].max_y;
+      index->children[i] = i;
+      index->ids[i] = items[i].id;
+    }
+
+  index->level_ends[index->n_levels++] = n_items;
+
+  /* Each parent bounds a run of consecutive nodes from the level below */
+  level_start = 0;
+  level_end = n_items;
+  pos = n_items;
+
+  while (level_end - level_start > 1)
+    {
+      for (unsigned int i = level_start; i < level_end; i += NODE_SIZE)
+        {
+          unsigned int end = MIN (i + NODE_SIZE, level_end);
+          double *box = &index->boxes[4 * pos];
+
+          box[0] = box[1] = INFINITY;
+          box[2] = box[3] = -INFINITY;
+
+          for (unsigned int j = i; j < end; j++)
+            {
+              const double *child = &index->boxes[4 * j];
+
+              box[0] = MIN (box[0], child[0]);
+              box[1] = MIN (box[1], child[1]);
+              box[2] = MAX (box[2], child[2]);
+              box[3] = MAX (box[3], child[3]);
+            }
+
+          index->children[pos++] = i;
+        }
+
+      level_start = level_end;
+      level_end = pos;
+
+      g_assert (index->n_levels < MAX_LEVELS);
+      index->level_ends[index->n_levels++] = level_end;
+    }
+
+  g_array_set_size (builder->items, 0);
+
+  return index;
+}
+
+/**
+ * atrebas_spatial_index_ref:
+ * @index: a #AtrebasSpatialIndex
+ *
+ * Acquire a reference on @index.
+ *
+ * Returns: (transfer full): @index
+ */
+AtrebasSpatialIndex *
+atrebas_spatial_index_ref (AtrebasSpatialIndex *index)
+{
+  g_return_val_if_fail (index != NULL, NULL);
+
+  g_atomic_ref_count_inc (&index->ref_count);
+
+  return index;
+}
+
+/**
+ * atrebas_spatial_index_unref:
+ * @index: (transfer full): a #AtrebasSpatialIndex
+ *
+ * Release a reference on @index, freeing it if this was the last.
+ */
+void
+atrebas_spatial_index_unref (AtrebasSpatialIndex *index)
+{
+  g_return_if_fail (index != NULL);
+
+  if (!g_atomic_ref_count_dec (&index->ref_count))
+    return;
+
+  g_clear_pointer (&index->boxes, g_free);
+  g_clear_pointer (&index->children, g_free);
+  g_clear_pointer (&index->ids, g_free);
+  g_free (index);
+}
+
+/**
+ * atrebas_spatial_index_get_n_items:
+ * @index: a #AtrebasSpatialIndex
+ *
+ * Get the number of items in @index.
+ *
+ * Returns: the number of items
+ */
+unsigned int
+atrebas_spatial_index_get_n_items (AtrebasSpatialIndex *index)
+{
+  g_return_val_if_fail (index != NULL, 0);
+
+  return index->n_items;
+}
+
+/**
+ * atrebas_spatial_index_search:
+ * @index: a #AtrebasSpatialIndex
+ * @left: left extent
+ * @top: top extent
+ * @right: right extent
+ * @bottom: bottom extent
+ * @results: (element-type gint64): a #GArray of item IDs
+ *
+ * Append the ID of each item with extents intersecting the bounding box
+ * defined by @top, @right, @bottom and @left to @results. For a point query,
+ * pass the same coordinates for both corners.
+ *
+ * Returns: the number of items found
+ */
+unsigned int
+atrebas_spatial_index_search (AtrebasSpatialIndex *index,
+                              double               left,
+                              double               top,
+                              double               right,
+                              double               bottom,
+                              GArray              *results)
+{
+  guint32 stack[NODE_SIZE * MAX_LEVELS];
+  guint32 levels[NODE_SIZE * MAX_LEVELS];
+  unsigned int n_stack = 0;
+  unsigned int n_found = 0;
+
+  g_return_val_if_fail (index != NULL, 0);
+  g_return_val_if_fail (results != NULL, 0);
+
+  if (index->n_nodes == 0)
+    return 0;
+
+  stack[n_stack] = index->n_nodes - 1;
+  levels[n_stack++] = index->n_levels - 1;
+
+  while (n_stack > 0)
+    {
+      guint32 node = stack[--n_stack];
+      guint32 level = levels[n_stack];
+      unsigned int first, end;
+
+      if (!node_intersects (&index->boxes[4 * node], left, top, right, bottom))
+        continue;
+
+      if (level == 0)
+        {
+          g_array_append_val (results, index->ids[node]);
+          n_found++;
+          continue;
+        }
+
+      first = index->children[node];
+      end = MIN (first + NODE_SIZE, index->level_ends[level - 1]);
+
+      for (unsigned int i = first; i < end; i++)
+        {
+          stack[n_stack] = i;
+          levels[n_stack++] = level - 1;
+        }
+    }
+
+  return n_found;
+}
+
@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// SPDX-FileCopyrightText: 2022 Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _AtrebasSpatialIndex        AtrebasSpatialIndex;
+typedef struct _AtrebasSpatialIndexBuilder AtrebasSpatialIndexBuilder;
+
+AtrebasSpatialIndexBuilder * atrebas_spatial_index_builder_new  (void);
+void                         atrebas_spatial_index_builder_free (AtrebasSpatialIndexBuilder *builder);
+void                         atrebas_spatial_index_builder_add  (AtrebasSpatialIndexBuilder *builder,
+                                                                 gint64                      id,
+                                                                 double                      min_x,
+                                                                 double                      max_x,
+                                                                 double                      min_y,
+                                                                 double                      max_y);
+AtrebasSpatialIndex        * atrebas_spatial_index_builder_end  (AtrebasSpatialIndexBuilder *builder);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (AtrebasSpatialIndexBuilder, atrebas_spatial_index_builder_free)
+
+AtrebasSpatialIndex * atrebas_spatial_index_ref         (AtrebasSpatialIndex *index);
+void                  atrebas_spatial_index_unref       (AtrebasSpatialIndex *index);
+unsigned int          atrebas_spatial_index_get_n_items (AtrebasSpatialIndex *index);
+unsigned int          atrebas_spatial_index_search      (AtrebasSpatialIndex *index,
+                                                         double               left,
+                                                         double               top,
+                                                         double               right,
+                                                         double               bottom,
+                                                         GArray              *results);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (AtrebasSpatialIndex, atrebas_spatial_index_unref)
+
+G_END_DECLS
+
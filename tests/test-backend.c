@@ -2,6 +2,9 @@
 // SPDX-FileCopyrightText: 2022 Andy Holmes <andrew.g.r.holmes@gmail.com>
 
 #include <gio/gio.h>
+#include <libsoup/soup.h>
+
+#include "atrebas-backend-private.h"
 
 #include "mock-common.h"
 
@@ -30,6 +33,235 @@ load_cb (AtrebasBackend   *backend,
   task_done;
 }
 
+static void
+load_invalid_cb (AtrebasBackend *backend,
+                 GAsyncResult   *result,
+                 gpointer        user_data)
+{
+  GError *error = NULL;
+
+  g_assert_false (atrebas_backend_load_finish (backend, result, &error));
+  g_assert_error (error, GEOCODE_ERROR, GEOCODE_ERROR_PARSE);
+  g_clear_error (&error);
+
+  task_done;
+}
+
+static void
+progress_cb (AtrebasBackend  *backend,
+             AtrebasMapTheme  theme,
+             unsigned int     n_features,
+             unsigned int    *n_emissions)
+{
+  g_assert_cmpuint (theme, ==, ATREBAS_MAP_THEME_TERRITORY);
+  g_assert_cmpuint (n_features, >, 0);
+
+  *n_emissions += 1;
+}
+
+static void
+update_cb (AtrebasBackend *backend,
+           GAsyncResult   *result,
+           gpointer        user_data)
+{
+  GError *error = NULL;
+
+  if (!atrebas_backend_update_finish (backend, result, &error))
+    g_assert_no_error (error);
+
+  task_done;
+}
+
+static void
+update_error_cb (AtrebasBackend *backend,
+                 GAsyncResult   *result,
+                 gpointer        user_data)
+{
+  GError *error = NULL;
+
+  g_assert_false (atrebas_backend_update_finish (backend, result, &error));
+  g_assert_error (error, GEOCODE_ERROR, GEOCODE_ERROR_INTERNAL_SERVER);
+  g_clear_error (&error);
+
+  task_done;
+}
+
+static void
+update_cancelled_cb (AtrebasBackend *backend,
+                     GAsyncResult   *result,
+                     gpointer        user_data)
+{
+  GError *error = NULL;
+
+  g_assert_false (atrebas_backend_update_finish (backend, result, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_clear_error (&error);
+
+  task_done;
+}
+
+static void
+update_progress_cb (AtrebasBackend  *backend,
+                    AtrebasMapTheme  theme,
+                    unsigned int     n_features,
+                    unsigned int    *themes)
+{
+  *themes |= (1 << theme);
+}
+
+static void
+lookup_theme_cb (AtrebasBackend *backend,
+                 GAsyncResult   *result,
+                 gpointer        user_data)
+{
+  g_autoptr (AtrebasFeature) feature = NULL;
+  AtrebasMapTheme theme = GPOINTER_TO_UINT (user_data);
+  GError *error = NULL;
+
+  feature = atrebas_backend_lookup_finish (backend, result, &error);
+  g_assert_no_error (error);
+  g_assert_true (ATREBAS_IS_FEATURE (feature));
+  g_assert_cmpuint (atrebas_feature_get_theme (feature), ==, theme);
+
+  task_done;
+}
+
+/* A stand-in for the native-land.ca API, serving the bundled maps */
+static const char *territories_file = TEST_MAPS_DIR"/indigenousTerritories.json";
+static unsigned int n_not_modified = 0;
+
+/* If set, the treaties are sent in part and the rest held until released */
+static gboolean hold_treaties = FALSE;
+static SoupServerMessage *held_message = NULL;
+static GBytes *held_bytes = NULL;
+
+static void
+test_server_release (void)
+{
+  SoupMessageBody *body;
+
+  if (held_message == NULL)
+    return;
+
+  body = soup_server_message_get_response_body (held_message);
+  soup_message_body_append_bytes (body, held_bytes);
+  soup_message_body_complete (body);
+  soup_server_message_unpause (held_message);
+
+  g_clear_pointer (&held_bytes, g_bytes_unref);
+  held_message = NULL;
+}
+
+static void
+api_handler (SoupServer        *server,
+             SoupServerMessage *msg,
+             const char        *path,
+             GHashTable        *query,
+             gpointer           user_data)
+{
+  const char *maps = NULL;
+  const char *filename = NULL;
+  const char *if_none_match = NULL;
+  g_autofree char *contents = NULL;
+  g_autofree char *checksum = NULL;
+  g_autofree char *etag = NULL;
+  size_t length = 0;
+
+  if (query != NULL && g_str_equal (path, "/api/index.php"))
+    maps = g_hash_table_lookup (query, "maps");
+
+  if (g_strcmp0 (maps, "languages") == 0)
+    filename = TEST_MAPS_DIR"/indigenousLanguages.json";
+  else if (g_strcmp0 (maps, "territories") == 0)
+    filename = territories_file;
+  else if (g_strcmp0 (maps, "treaties") == 0)
+    filename = TEST_MAPS_DIR"/indigenousTreaties.json";
+
+  if (filename == NULL || !g_file_get_contents (filename, &contents, &length, NULL))
+    {
+      soup_server_message_set_status (msg, SOUP_STATUS_NOT_FOUND, NULL);
+      return;
+    }
+
+  /* Validate conditional requests against a checksum of the contents */
+  checksum = g_compute_checksum_for_data (G_CHECKSUM_MD5,
+                                          (const guint8 *)contents,
+                                          length);
+  etag = g_strdup_printf ("\"%s\"", checksum);
+  if_none_match = soup_message_headers_get_one (soup_server_message_get_request_headers (msg),
+                                                "If-None-Match");
+  soup_message_headers_replace (soup_server_message_get_response_headers (msg),
+                                "ETag",
+                                etag);
+
+  if (g_strcmp0 (if_none_match, etag) == 0)
+    {
+      n_not_modified++;
+      soup_server_message_set_status (msg, SOUP_STATUS_NOT_MODIFIED, NULL);
+      return;
+    }
+
+  soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+
+  /* Send most of the treaties, so the import is well underway but can't
+   * finish until the rest is released */
+  if (hold_treaties && g_strcmp0 (maps, "treaties") == 0)
+    {
+      SoupMessageHeaders *headers = soup_server_message_get_response_headers (msg);
+      SoupMessageBody *body = soup_server_message_get_response_body (msg);
+      size_t offset = length - length / 10;
+
+      soup_message_headers_set_content_type (headers, "application/json", NULL);
+      soup_message_headers_set_encoding (headers, SOUP_ENCODING_CHUNKED);
+      soup_message_body_append (body, SOUP_MEMORY_COPY, contents, offset);
+
+      held_bytes = g_bytes_new (contents + offset, length - offset);
+      held_message = msg;
+      return;
+    }
+
+  soup_server_message_set_response (msg,
+                                    "application/json",
+                                    SOUP_MEMORY_TAKE,
+                                    g_steal_pointer (&contents),
+                                    length);
+}
+
+static SoupServer *
+test_server_new (char **api_uri)
+{
+  g_autoptr (SoupServer) server = NULL;
+  g_autoslist (GUri) uris = NULL;
+  GError *error = NULL;
+
+  server = soup_server_new (NULL, NULL);
+  soup_server_add_handler (server, "/api", api_handler, NULL, NULL);
+  soup_server_listen_local (server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY, &error);
+  g_assert_no_error (error);
+
+  uris = soup_server_get_uris (server);
+  g_assert_nonnull (uris);
+
+  *api_uri = g_strdup_printf ("http://127.0.0.1:%d/api/index.php",
+                              g_uri_get_port (uris->data));
+
+  return g_steal_pointer (&server);
+}
+
+static void
+update_cancel_progress_cb (AtrebasBackend  *backend,
+                           AtrebasMapTheme  theme,
+                           unsigned int     n_features,
+                           GCancellable    *cancellable)
+{
+  /* The treaties can't be committed until the rest is released */
+  if (theme != ATREBAS_MAP_THEME_TREATY)
+    return;
+
+  g_cancellable_cancel (cancellable);
+  test_server_release ();
+}
+
 static void
 forward_search_cb (GeocodeBackend *backend,
                    GAsyncResult   *result,
@@ -45,6 +277,46 @@ forward_search_cb (GeocodeBackend *backend,
   task_done;
 }
 
+static void
+forward_search_timeout_cb (GeocodeBackend *backend,
+                           GAsyncResult   *result,
+                           unsigned int   *n_pending)
+{
+  g_autolist (GeocodePlace) results = NULL;
+  GError *error = NULL;
+
+  results = geocode_backend_forward_search_finish (backend, result, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT);
+  g_assert_null (results);
+  g_clear_error (&error);
+
+  *n_pending -= 1;
+}
+
+static void
+forward_search_superseded_cb (GeocodeBackend *backend,
+                              GAsyncResult   *result,
+                              unsigned int   *n_pending)
+{
+  g_autolist (GeocodePlace) results = NULL;
+  GError *error = NULL;
+
+  /* An older request may or may not have started before it was superseded */
+  results = geocode_backend_forward_search_finish (backend, result, &error);
+
+  if (error != NULL)
+    {
+      g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+      g_clear_error (&error);
+    }
+  else
+    {
+      g_assert_cmpuint (g_list_length (results), ==, 2);
+    }
+
+  *n_pending -= 1;
+}
+
 static void
 reverse_resolve_cb (GeocodeBackend *backend,
                     GAsyncResult   *result,
@@ -60,6 +332,38 @@ reverse_resolve_cb (GeocodeBackend *backend,
   task_done;
 }
 
+static void
+lookup_none_cb (AtrebasBackend *backend,
+                GAsyncResult   *result,
+                gpointer        user_data)
+{
+  g_autoptr (AtrebasFeature) feature = NULL;
+  GError *error = NULL;
+
+  feature = atrebas_backend_lookup_finish (backend, result, &error);
+  g_assert_no_error (error);
+  g_assert_null (feature);
+
+  task_done;
+}
+
+static void
+load_geometry_cb (AtrebasBackend *backend,
+                  GAsyncResult   *result,
+                  AtrebasFeature *feature)
+{
+  g_autoptr (GBytes) geometry = NULL;
+  GError *error = NULL;
+
+  geometry = atrebas_backend_load_geometry_finish (backend, result, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (geometry);
+  g_assert_true (geometry == atrebas_feature_get_geometry (feature));
+
+  g_object_unref (feature);
+  task_done;
+}
+
 static void
 lookup_cb (AtrebasBackend   *backend,
            GAsyncResult *result,
@@ -73,6 +377,63 @@ lookup_cb (AtrebasBackend   *backend,
   g_assert_true (ATREBAS_IS_FEATURE (feature));
   g_assert_cmpstr (ATREBAS_TEST_FEATURE_NAME, ==, geocode_place_get_name (GEOCODE_PLACE (feature)));
 
+  /* The summary has the extents, even before the geometry is loaded */
+  g_assert_nonnull (geocode_place_get_bounding_box (GEOCODE_PLACE (feature)));
+  g_assert_nonnull (geocode_place_get_location (GEOCODE_PLACE (feature)));
+
+  atrebas_backend_load_geometry (backend,
+                                 feature,
+                                 NULL,
+                                 (GAsyncReadyCallback)load_geometry_cb,
+                                 g_object_ref (feature));
+}
+
+static void
+lookup_bounds_cb (AtrebasBackend *backend,
+                  GAsyncResult   *result,
+                  gpointer        user_data)
+{
+  g_autoptr (AtrebasFeature) feature = NULL;
+  GeocodeBoundingBox *expected = GEOCODE_BOUNDING_BOX (user_data);
+  GeocodeBoundingBox *bounds;
+  GError *error = NULL;
+
+  feature = atrebas_backend_lookup_finish (backend, result, &error);
+  g_assert_no_error (error);
+  g_assert_true (ATREBAS_IS_FEATURE (feature));
+  g_assert_null (atrebas_feature_get_geometry (feature));
+
+  bounds = geocode_place_get_bounding_box (GEOCODE_PLACE (feature));
+  g_assert_cmpfloat_with_epsilon (geocode_bounding_box_get_top (bounds),
+                                  geocode_bounding_box_get_top (expected),
+                                  1e-6);
+  g_assert_cmpfloat_with_epsilon (geocode_bounding_box_get_bottom (bounds),
+                                  geocode_bounding_box_get_bottom (expected),
+                                  1e-6);
+  g_assert_cmpfloat_with_epsilon (geocode_bounding_box_get_left (bounds),
+                                  geocode_bounding_box_get_left (expected),
+                                  1e-6);
+  g_assert_cmpfloat_with_epsilon (geocode_bounding_box_get_right (bounds),
+                                  geocode_bounding_box_get_right (expected),
+                                  1e-6);
+
+  task_done;
+}
+
+static void
+lookup_name_cb (AtrebasBackend *backend,
+                GAsyncResult   *result,
+                gpointer        user_data)
+{
+  g_autoptr (AtrebasFeature) feature = NULL;
+  const char *name = user_data;
+  GError *error = NULL;
+
+  feature = atrebas_backend_lookup_finish (backend, result, &error);
+  g_assert_no_error (error);
+  g_assert_true (ATREBAS_IS_FEATURE (feature));
+  g_assert_cmpstr (name, ==, geocode_place_get_name (GEOCODE_PLACE (feature)));
+
   task_done;
 }
 
@@ -82,12 +443,17 @@ test_backend_new (void)
 {
   GeocodeBackend *backend = NULL;
   g_autofree char *path = NULL;
+  gboolean bundled = FALSE;
 
   backend = atrebas_backend_new (":memory:");
 
   g_assert_cmpstr (atrebas_backend_get_path (ATREBAS_BACKEND (backend)), ==, ":memory:");
 
-  g_object_get (backend, "path", &path, NULL);
+  g_object_get (backend,
+                "bundled", &bundled,
+                "path",    &path,
+                NULL);
+  g_assert_true (bundled);
   g_assert_cmpstr (path, ==, ":memory:");
 
   /* Cleanup */
@@ -101,6 +467,12 @@ static void
 test_backend_load (void)
 {
   GeocodeBackend *backend = atrebas_backend_get_default ();
+  unsigned int n_emissions = 0;
+
+  g_signal_connect (backend,
+                    "progress",
+                    G_CALLBACK (progress_cb),
+                    &n_emissions);
 
   atrebas_backend_load (ATREBAS_BACKEND (backend),
                         TEST_DATA_DIR"/testFeatureCollection.json",
@@ -109,6 +481,83 @@ test_backend_load (void)
                         (GAsyncReadyCallback)load_cb,
                         NULL);
   task_wait;
+
+  /* Progress is emitted in the main context, after the task completes */
+  while (n_emissions == 0)
+    g_main_context_iteration (NULL, FALSE);
+
+  g_signal_handlers_disconnect_by_data (backend, &n_emissions);
+}
+
+static void
+test_backend_load_invalid (void)
+{
+  GeocodeBackend *backend = atrebas_backend_get_default ();
+
+  /* A malformed feature partway through should roll back the whole load */
+  atrebas_backend_load (ATREBAS_BACKEND (backend),
+                        TEST_DATA_DIR"/testFeatureCollectionInvalid.json",
+                        ATREBAS_MAP_THEME_TERRITORY,
+                        NULL,
+                        (GAsyncReadyCallback)load_invalid_cb,
+                        NULL);
+  task_wait;
+
+  atrebas_backend_lookup (ATREBAS_BACKEND (backend),
+                          "0000000000000000000000000000dead",
+                          NULL,
+                          (GAsyncReadyCallback)lookup_none_cb,
+                          NULL);
+  task_wait;
+}
+
+static void
+test_backend_bounding_box (void)
+{
+  GeocodeBackend *backend = atrebas_backend_get_default ();
+  g_autoptr (JsonParser) parser = NULL;
+  g_autoptr (AtrebasFeature) feature = NULL;
+  JsonArray *features;
+  GeocodeBoundingBox *bounds;
+  GError *error = NULL;
+
+  parser = json_parser_new ();
+  json_parser_load_from_file (parser,
+                              TEST_DATA_DIR"/testFeatureCollection.json",
+                              &error);
+  g_assert_no_error (error);
+
+  features = json_object_get_array_member (json_node_get_object (json_parser_get_root (parser)),
+                                           "features");
+
+  for (unsigned int i = 0; i < json_array_get_length (features); i++)
+    {
+      JsonNode *node = json_array_get_element (features, i);
+      JsonObject *object = json_node_get_object (node);
+
+      if (g_strcmp0 (json_object_get_string_member (object, "id"),
+                     ATREBAS_TEST_FEATURE_ID) == 0)
+        {
+          feature = atrebas_feature_deserialize (node, &error);
+          g_assert_no_error (error);
+          break;
+        }
+    }
+
+  g_assert_true (ATREBAS_IS_FEATURE (feature));
+
+  /* The top of the box is the northern edge, whether it comes from the
+   * geometry or from the extents stored in the summary */
+  bounds = geocode_place_get_bounding_box (GEOCODE_PLACE (feature));
+  g_assert_cmpfloat (geocode_bounding_box_get_top (bounds), >,
+                     geocode_bounding_box_get_bottom (bounds));
+
+  atrebas_backend_lookup (ATREBAS_BACKEND (backend),
+                          ATREBAS_TEST_FEATURE_ID,
+                          NULL,
+                          (GAsyncReadyCallback)lookup_bounds_cb,
+                          bounds);
+  task_wait;
 }
 
 static inline GValue *
@@ -123,6 +572,18 @@ parameter_boolean (gboolean value)
   return ret;
 }
 
+static inline GValue *
+parameter_uint (unsigned int value)
+{
+  GValue *ret;
+
+  ret = g_new0 (GValue, 1);
+  g_value_init (ret, G_TYPE_UINT);
+  g_value_set_uint (ret, value);
+
+  return ret;
+}
+
 static inline GValue *
 parameter_string (const char *value)
 {
@@ -135,6 +596,318 @@ parameter_string (const char *value)
   return ret;
 }
 
+static void
+test_backend_update (void)
+{
+  g_autoptr (SoupServer) server = NULL;
+  g_autoptr (GeocodeBackend) backend = NULL;
+  g_autofree char *api_uri = NULL;
+  g_autofree char *path = NULL;
+  unsigned int themes = 0;
+
+  server = test_server_new (&api_uri);
+  path = g_build_filename (g_get_user_cache_dir (), "update.db", NULL);
+  backend = g_object_new (ATREBAS_TYPE_BACKEND,
+                          "api-uri", api_uri,
+                          "path",    path,
+                          "bundled", FALSE,
+                          NULL);
+  g_signal_connect (backend,
+                    "progress",
+                    G_CALLBACK (update_progress_cb),
+                    &themes);
+
+  /* All three themes are downloaded and committed */
+  atrebas_backend_update (ATREBAS_BACKEND (backend),
+                          NULL,
+                          (GAsyncReadyCallback)update_cb,
+                          NULL);
+  task_wait;
+
+  while (themes != ((1 << ATREBAS_MAP_THEME_LANGUAGE) |
+                    (1 << ATREBAS_MAP_THEME_TERRITORY) |
+                    (1 << ATREBAS_MAP_THEME_TREATY)))
+    g_main_context_iteration (NULL, FALSE);
+
+  atrebas_backend_lookup (ATREBAS_BACKEND (backend),
+                          "0078efb2a719da5ac03b2d6f74b13183",
+                          NULL,
+                          (GAsyncReadyCallback)lookup_theme_cb,
+                          GUINT_TO_POINTER (ATREBAS_MAP_THEME_LANGUAGE));
+  task_wait;
+
+  atrebas_backend_lookup (ATREBAS_BACKEND (backend),
+                          "007d3821e00f3a136fa7285091646eff",
+                          NULL,
+                          (GAsyncReadyCallback)lookup_theme_cb,
+                          GUINT_TO_POINTER (ATREBAS_MAP_THEME_TERRITORY));
+  task_wait;
+
+  atrebas_backend_lookup (ATREBAS_BACKEND (backend),
+                          "001d87fa60dc576a07f5d5da3c8157ce",
+                          NULL,
+                          (GAsyncReadyCallback)lookup_theme_cb,
+                          GUINT_TO_POINTER (ATREBAS_MAP_THEME_TREATY));
+  task_wait;
+}
+
+static void
+test_backend_update_error (void)
+{
+  g_autoptr (SoupServer) server = NULL;
+  g_autoptr (GeocodeBackend) backend = NULL;
+  g_autofree char *api_uri = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *missing_uri = NULL;
+
+  /* An HTTP error for any source fails the update */
+  server = test_server_new (&api_uri);
+  missing_uri = g_strconcat (api_uri, "/missing", NULL);
+  path = g_build_filename (g_get_user_cache_dir (), "update-error.db", NULL);
+  backend = g_object_new (ATREBAS_TYPE_BACKEND,
+                          "api-uri", missing_uri,
+                          "path",    path,
+                          "bundled", FALSE,
+                          NULL);
+
+  atrebas_backend_update (ATREBAS_BACKEND (backend),
+                          NULL,
+                          (GAsyncReadyCallback)update_error_cb,
+                          NULL);
+  task_wait;
+}
+
+static void
+test_backend_update_cancel (void)
+{
+  g_autoptr (SoupServer) server = NULL;
+  g_autoptr (GeocodeBackend) backend = NULL;
+  g_autoptr (GCancellable) cancellable = NULL;
+  g_autofree char *api_uri = NULL;
+  g_autofree char *path = NULL;
+
+  server = test_server_new (&api_uri);
+  path = g_build_filename (g_get_user_cache_dir (), "update-cancel.db", NULL);
+  backend = g_object_new (ATREBAS_TYPE_BACKEND,
+                          "api-uri", api_uri,
+                          "path",    path,
+                          "bundled", FALSE,
+                          NULL);
+
+  /* Cancelling a running update should stop it promptly */
+  cancellable = g_cancellable_new ();
+  atrebas_backend_update (ATREBAS_BACKEND (backend),
+                          cancellable,
+                          (GAsyncReadyCallback)update_cancelled_cb,
+                          NULL);
+  g_cancellable_cancel (cancellable);
+  task_wait;
+}
+
+static void
+test_backend_update_cancel_progress (void)
+{
+  g_autoptr (SoupServer) server = NULL;
+  g_autoptr (GeocodeBackend) backend = NULL;
+  g_autoptr (GCancellable) cancellable = NULL;
+  g_autofree char *api_uri = NULL;
+  g_autofree char *path = NULL;
+
+  server = test_server_new (&api_uri);
+  path = g_build_filename (g_get_user_cache_dir (), "update-cancel-progress.db", NULL);
+  backend = g_object_new (ATREBAS_TYPE_BACKEND,
+                          "api-uri", api_uri,
+                          "path",    path,
+                          "bundled", FALSE,
+                          NULL);
+
+  /* Cancelling partway through a source rolls back its transaction */
+  cancellable = g_cancellable_new ();
+  g_signal_connect (backend,
+                    "progress",
+                    G_CALLBACK (update_cancel_progress_cb),
+                    cancellable);
+
+  hold_treaties = TRUE;
+  atrebas_backend_update (ATREBAS_BACKEND (backend),
+                          cancellable,
+                          (GAsyncReadyCallback)update_cancelled_cb,
+                          NULL);
+  task_wait;
+  hold_treaties = FALSE;
+
+  g_signal_handlers_disconnect_by_data (backend, cancellable);
+  test_server_release ();
+
+  /* The first treaty was imported before the cancellation, but not kept */
+  atrebas_backend_lookup (ATREBAS_BACKEND (backend),
+                          "001d87fa60dc576a07f5d5da3c8157ce",
+                          NULL,
+                          (GAsyncReadyCallback)lookup_none_cb,
+                          NULL);
+  task_wait;
+}
+
+static void
+test_backend_update_conditional (void)
+{
+  g_autoptr (SoupServer) server = NULL;
+  g_autoptr (GeocodeBackend) backend = NULL;
+  g_autofree char *api_uri = NULL;
+  g_autofree char *path = NULL;
+
+  server = test_server_new (&api_uri);
+  path = g_build_filename (g_get_user_cache_dir (), "update-conditional.db", NULL);
+  backend = g_object_new (ATREBAS_TYPE_BACKEND,
+                          "api-uri", api_uri,
+                          "path",    path,
+                          "bundled", FALSE,
+                          NULL);
+
+  territories_file = TEST_DATA_DIR"/testFeatureCollection.json";
+  n_not_modified = 0;
+
+  atrebas_backend_update (ATREBAS_BACKEND (backend),
+                          NULL,
+                          (GAsyncReadyCallback)update_cb,
+                          NULL);
+  task_wait;
+  g_assert_cmpuint (n_not_modified, ==, 0);
+
+  /* Unchanged sources are not downloaded again */
+  atrebas_backend_update (ATREBAS_BACKEND (backend),
+                          NULL,
+                          (GAsyncReadyCallback)update_cb,
+                          NULL);
+  task_wait;
+  g_assert_cmpuint (n_not_modified, ==, 3);
+
+  /* A changed source updates modified features and removes missing ones */
+  territories_file = TEST_DATA_DIR"/testFeatureCollectionUpdate.json";
+
+  atrebas_backend_update (ATREBAS_BACKEND (backend),
+                          NULL,
+                          (GAsyncReadyCallback)update_cb,
+                          NULL);
+  task_wait;
+  g_assert_cmpuint (n_not_modified, ==, 5);
+
+  atrebas_backend_lookup (ATREBAS_BACKEND (backend),
+                          "1a06d1f9693a307ce18e674a7fb94d59",
+                          NULL,
+                          (GAsyncReadyCallback)lookup_name_cb,
+                          (gpointer)"Zacatecos");
+  task_wait;
+
+  atrebas_backend_lookup (ATREBAS_BACKEND (backend),
+                          ATREBAS_TEST_FEATURE_ID,
+                          NULL,
+                          (GAsyncReadyCallback)lookup_none_cb,
+                          NULL);
+  task_wait;
+
+  territories_file = TEST_MAPS_DIR"/indigenousTerritories.json";
+}
+
+static void
+test_backend_update_bundled (void)
+{
+  g_autoptr (SoupServer) server = NULL;
+  g_autoptr (GeocodeBackend) backend = NULL;
+  g_autofree char *api_uri = NULL;
+  g_autofree char *path = NULL;
+
+  server = test_server_new (&api_uri);
+  path = g_build_filename (g_get_user_cache_dir (), "update-bundled.db", NULL);
+  backend = g_object_new (ATREBAS_TYPE_BACKEND,
+                          "api-uri", api_uri,
+                          "path",    path,
+                          "bundled", FALSE,
+                          NULL);
+
+  /* Seed the database the way the prebuilt database is built */
+  atrebas_backend_load_bundled (ATREBAS_BACKEND (backend),
+                                TEST_DATA_DIR"/testFeatureCollection.json",
+                                ATREBAS_MAP_THEME_TERRITORY,
+                                NULL,
+                                (GAsyncReadyCallback)load_cb,
+                                NULL);
+  task_wait;
+
+  atrebas_backend_lookup (ATREBAS_BACKEND (backend),
+                          ATREBAS_TEST_FEATURE_ID,
+                          NULL,
+                          (GAsyncReadyCallback)lookup_theme_cb,
+                          GUINT_TO_POINTER (ATREBAS_MAP_THEME_TERRITORY));
+  task_wait;
+
+  /* A feature missing from the remote source is removed, even though it was
+   * imported from the bundled one */
+  territories_file = TEST_DATA_DIR"/testFeatureCollectionUpdate.json";
+
+  atrebas_backend_update (ATREBAS_BACKEND (backend),
+                          NULL,
+                          (GAsyncReadyCallback)update_cb,
+                          NULL);
+  task_wait;
+
+  atrebas_backend_lookup (ATREBAS_BACKEND (backend),
+                          ATREBAS_TEST_FEATURE_ID,
+                          NULL,
+                          (GAsyncReadyCallback)lookup_none_cb,
+                          NULL);
+  task_wait;
+
+  territories_file = TEST_MAPS_DIR"/indigenousTerritories.json";
+}
+
+static void
+test_backend_timeout (void)
+{
+  g_autoptr (SoupServer) server = NULL;
+  g_autoptr (GeocodeBackend) backend = NULL;
+  g_autoptr (GHashTable) params = NULL;
+  g_autofree char *api_uri = NULL;
+  unsigned int n_pending = 0;
+
+  /* Without write-ahead logging, queries share the writer thread */
+  server = test_server_new (&api_uri);
+  backend = g_object_new (ATREBAS_TYPE_BACKEND,
+                          "api-uri", api_uri,
+                          "path",    ":memory:",
+                          "bundled", FALSE,
+                          NULL);
+
+  /* Keep the writer busy with an update, until the treaties are released */
+  hold_treaties = TRUE;
+  atrebas_backend_update (ATREBAS_BACKEND (backend),
+                          NULL,
+                          (GAsyncReadyCallback)update_cb,
+                          NULL);
+
+  while (held_message == NULL)
+    g_main_context_iteration (NULL, FALSE);
+
+  /* A request that can't start before its deadline times out */
+  params = atrebas_geocode_parameters_for_location ("Zacateco");
+  atrebas_geocode_parameters_add_uint (params, "timeout", 1);
+
+  n_pending++;
+  geocode_backend_forward_search_async (backend,
+                                        params,
+                                        NULL,
+                                        (GAsyncReadyCallback)forward_search_timeout_cb,
+                                        &n_pending);
+  g_usleep (10 * G_TIME_SPAN_MILLISECOND);
+
+  hold_treaties = FALSE;
+  test_server_release ();
+  task_wait;
+
+  while (n_pending > 0)
+    g_main_context_iteration (NULL, FALSE);
+}
+
 static void
 test_backend_operations (void)
 {
@@ -142,8 +915,15 @@ test_backend_operations (void)
   g_autoptr (GHashTable) bounded_params = NULL;
   g_autoptr (GHashTable) forward_params = NULL;
   g_autoptr (GHashTable) reverse_params = NULL;
+  g_autoptr (GHashTable) outside_params = NULL;
+  g_autoptr (GHashTable) coalesce_params = NULL;
+  g_autoptr (GHashTable) folded_params = NULL;
+  g_autoptr (GHashTable) limit_params = NULL;
   g_autolist (GeocodePlace) forward_results = NULL;
+  g_autolist (GeocodePlace) limit_results = NULL;
   g_autolist (GeocodePlace) reverse_results = NULL;
+  g_autolist (GeocodePlace) outside_results = NULL;
+  unsigned int n_pending = 0;
   GError *error = NULL;
 
   atrebas_backend_load (ATREBAS_BACKEND (backend),
@@ -164,6 +944,13 @@ test_backend_operations (void)
                        parameter_string ("-102.56,22.78,-102.57,22.77"));
   forward_params = atrebas_geocode_parameters_for_location ("Zacateco");
   reverse_params = atrebas_geocode_parameters_for_coordinates (22.78, -102.56);
+  outside_params = atrebas_geocode_parameters_for_coordinates (0.0, 0.0);
+  coalesce_params = atrebas_geocode_parameters_for_location ("Zacateco");
+  folded_params = atrebas_geocode_parameters_for_location ("ZACATÉ");
+  limit_params = atrebas_geocode_parameters_for_location ("Zacateco");
+  g_hash_table_insert (limit_params,
+                       (gpointer)"limit",
+                       parameter_uint (1));
 
   /* GeocodeBackend (async) */
   geocode_backend_forward_search_async (backend,
@@ -180,6 +967,14 @@ test_backend_operations (void)
                                         NULL);
   task_wait;
 
+  /* Case and diacritics are folded, and words match as prefixes */
+  geocode_backend_forward_search_async (backend,
+                                        folded_params,
+                                        NULL,
+                                        (GAsyncReadyCallback)forward_search_cb,
+                                        NULL);
+  task_wait;
+
   geocode_backend_reverse_resolve_async (backend,
                                          reverse_params,
                                          NULL,
@@ -187,6 +982,34 @@ test_backend_operations (void)
                                          NULL);
   task_wait;
 
+  /* Coalesced requests; only the newest is guaranteed to complete */
+  for (unsigned int i = 0; i < 2; i++)
+    {
+      g_autoptr (GHashTable) params = NULL;
+
+      params = atrebas_geocode_parameters_for_location ("Zacateco");
+      atrebas_geocode_parameters_add_pointer (params, "coalesce", &n_pending);
+
+      n_pending++;
+      geocode_backend_forward_search_async (backend,
+                                            params,
+                                            NULL,
+                                            (GAsyncReadyCallback)forward_search_superseded_cb,
+                                            &n_pending);
+    }
+
+  atrebas_geocode_parameters_add_int (coalesce_params, "priority", G_PRIORITY_HIGH);
+  atrebas_geocode_parameters_add_pointer (coalesce_params, "coalesce", &n_pending);
+  geocode_backend_forward_search_async (backend,
+                                        coalesce_params,
+                                        NULL,
+                                        (GAsyncReadyCallback)forward_search_cb,
+                                        NULL);
+  task_wait;
+
+  while (n_pending > 0)
+    g_main_context_iteration (NULL, FALSE);
+
   /* GeocodeBackend (sync) */
   forward_results = geocode_backend_forward_search (backend,
                                                     forward_params,
@@ -194,6 +1017,18 @@ test_backend_operations (void)
                                                     &error);
   g_assert_no_error (error);
   g_assert_cmpuint (g_list_length (forward_results), ==, 2);
+  g_assert_null (atrebas_feature_get_geometry (forward_results->data));
+
+  /* Only the closest matches are kept */
+  limit_results = geocode_backend_forward_search (backend,
+                                                  limit_params,
+                                                  NULL,
+                                                  &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (g_list_length (limit_results), ==, 1);
+
+  /* Live features are shared between queries */
+  g_assert_true (limit_results->data == forward_results->data);
 
   reverse_results = geocode_backend_reverse_resolve (backend,
                                                      reverse_params,
@@ -201,6 +1036,18 @@ test_backend_operations (void)
                                                      &error);
   g_assert_no_error (error);
   g_assert_cmpuint (g_list_length (reverse_results), ==, 2);
+  g_assert_nonnull (atrebas_feature_get_geometry (reverse_results->data));
+
+  /* A live summary takes the geometry from a reverse resolve */
+  g_assert_nonnull (atrebas_feature_get_geometry (forward_results->data));
+
+  outside_results = geocode_backend_reverse_resolve (backend,
+                                                     outside_params,
+                                                     NULL,
+                                                     &error);
+  g_assert_error (error, GEOCODE_ERROR, GEOCODE_ERROR_NO_MATCHES);
+  g_assert_null (outside_results);
+  g_clear_error (&error);
 
   /* Custom operations */
   atrebas_backend_lookup (ATREBAS_BACKEND (backend),
@@ -222,8 +1069,26 @@ main (int   argc,
                    test_backend_new);
   g_test_add_func ("/atrebas/backend/load",
                    test_backend_load);
+  g_test_add_func ("/atrebas/backend/load-invalid",
+                   test_backend_load_invalid);
+  g_test_add_func ("/atrebas/backend/bounding-box",
+                   test_backend_bounding_box);
+  g_test_add_func ("/atrebas/backend/update",
+                   test_backend_update);
+  g_test_add_func ("/atrebas/backend/update-error",
+                   test_backend_update_error);
+  g_test_add_func ("/atrebas/backend/update-cancel",
+                   test_backend_update_cancel);
+  g_test_add_func ("/atrebas/backend/update-cancel-progress",
+                   test_backend_update_cancel_progress);
+  g_test_add_func ("/atrebas/backend/update-conditional",
+                   test_backend_update_conditional);
+  g_test_add_func ("/atrebas/backend/update-bundled",
+                   test_backend_update_bundled);
   g_test_add_func ("/atrebas/backend/operations",
                    test_backend_operations);
+  g_test_add_func ("/atrebas/backend/timeout",
+                   test_backend_timeout);
 
   return g_test_run ();
 }
@@ -56,7 +56,9 @@ test_feature_basic (void)
   g_autofree char *uri = NULL;
   g_autofree char *uri_fr = NULL;
   g_autoptr (JsonArray) coordinates = NULL;
+  g_autoptr (GBytes) geometry = NULL;
   AtrebasMapTheme theme;
+  GeocodeLocation *location;
   GError *error = NULL;
 
   /* Load the JSON */
@@ -77,6 +79,7 @@ test_feature_basic (void)
                 "uri-fr",      &uri_fr,
                 "color",       &color,
                 "coordinates", &coordinates,
+                "geometry",    &geometry,
                 "slug",        &slug,
                 "theme",       &theme,
                 NULL);
@@ -89,6 +92,7 @@ test_feature_basic (void)
   g_assert_cmpstr (uri_fr, ==, "https://native-land.ca/maps/territories/zacateco/");
   g_assert_cmpstr (color, ==, "#389a2a");
   g_assert_nonnull (coordinates);
+  g_assert_nonnull (geometry);
   g_assert_cmpstr (slug, ==, "zacateco");
   g_assert_cmpuint (theme, ==, ATREBAS_MAP_THEME_TERRITORY);
 
@@ -98,9 +102,21 @@ test_feature_basic (void)
   g_assert_cmpstr (atrebas_feature_get_uri_fr (feature), ==, "https://native-land.ca/maps/territories/zacateco/");
   g_assert_cmpstr (atrebas_feature_get_color (feature), ==, "#389a2a");
   g_assert_true (atrebas_feature_get_coordinates (feature) == coordinates);
+  g_assert_true (atrebas_feature_get_geometry (feature) == geometry);
   g_assert_cmpstr (atrebas_feature_get_slug (feature), ==, "zacateco");
   g_assert_cmpuint (atrebas_feature_get_theme (feature), ==, ATREBAS_MAP_THEME_TERRITORY);
 
+  /* The derived attributes are computed from the coordinates, with the
+   * location placed inside the feature */
+  g_assert_cmpfloat (atrebas_feature_get_area (feature), >, 0.0);
+  g_assert_cmpuint (atrebas_feature_get_n_vertices (feature), >, 0);
+
+  location = geocode_place_get_location (GEOCODE_PLACE (feature));
+  g_assert_nonnull (location);
+  g_assert_true (atrebas_feature_contains_point (feature,
+                                                 geocode_location_get_latitude (location),
+                                                 geocode_location_get_longitude (location)));
+
   g_assert_finalize_object (feature);
 }
 
@@ -166,6 +182,13 @@ test_feature_serialize (void)
 
   g_assert_finalize_object (feature1);
   g_assert_finalize_object (feature2);
+
+  /* A feature can't be serialized before its geometry is loaded */
+  feature1 = g_object_new (ATREBAS_TYPE_FEATURE,
+                           "nld-id", ATREBAS_TEST_FEATURE_ID,
+                           NULL);
+  g_assert_null (atrebas_feature_serialize (feature1));
+  g_assert_finalize_object (feature1);
 }
 
 
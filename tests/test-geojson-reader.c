@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// SPDX-FileCopyrightText: 2022 Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include <geocode-glib/geocode-glib.h>
+#include <gio/gio.h>
+
+#include "atrebas-geojson-reader.h"
+#include "atrebas-geometry.h"
+
+#include "mock-common.h"
+
+
+static AtrebasGeojsonReader *
+test_reader_new_for_path (const char *path)
+{
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GFileInputStream) stream = NULL;
+
+  file = g_file_new_for_path (path);
+  stream = g_file_read (file, NULL, NULL);
+  g_assert_nonnull (stream);
+
+  return atrebas_geojson_reader_new (G_INPUT_STREAM (stream));
+}
+
+static AtrebasGeojsonReader *
+test_reader_new_for_data (const char *data)
+{
+  g_autoptr (GInputStream) stream = NULL;
+
+  stream = g_memory_input_stream_new_from_data (data, -1, NULL);
+
+  return atrebas_geojson_reader_new (stream);
+}
+
+static void
+test_geojson_reader_collection (void)
+{
+  g_autoptr (AtrebasGeojsonReader) reader = NULL;
+  g_autoptr (JsonParser) parser = NULL;
+  JsonArray *features;
+  unsigned int n_features = 0;
+  GError *error = NULL;
+
+  parser = json_parser_new ();
+  json_parser_load_from_file (parser,
+                              TEST_DATA_DIR"/testFeatureCollection.json",
+                              &error);
+  g_assert_no_error (error);
+
+  features = json_object_get_array_member (json_node_get_object (json_parser_get_root (parser)),
+                                           "features");
+
+  /* The streamed features should match the document */
+  reader = test_reader_new_for_path (TEST_DATA_DIR"/testFeatureCollection.json");
+
+  while (atrebas_geojson_reader_next (reader, NULL, &error))
+    {
+      JsonObject *feature = json_array_get_object_element (features, n_features);
+      JsonObject *props = json_object_get_object_member (feature, "properties");
+      JsonObject *geometry = json_object_get_object_member (feature, "geometry");
+      JsonArray *coordinates = json_object_get_array_member (geometry, "coordinates");
+      JsonArray *polygon = json_array_get_array_element (coordinates, 0);
+      GBytes *bytes;
+      const guint8 *data;
+      size_t size;
+
+      g_assert_cmpuint (atrebas_geojson_reader_get_index (reader), ==, n_features);
+      g_assert_cmpstr (atrebas_geojson_reader_get_id (reader), ==,
+                       json_object_get_string_member (feature, "id"));
+      g_assert_cmpstr (atrebas_geojson_reader_get_property (reader, "Name"), ==,
+                       json_object_get_string_member (props, "Name"));
+      g_assert_cmpstr (atrebas_geojson_reader_get_geometry_type (reader), ==,
+                       "Polygon");
+      g_assert_null (atrebas_geojson_reader_get_property (reader, "Missing"));
+
+      bytes = atrebas_geojson_reader_get_geometry (reader);
+      g_assert_nonnull (bytes);
+
+      data = g_bytes_get_data (bytes, &size);
+      g_assert_true (atrebas_geometry_validate (data, size));
+      g_assert_cmpuint (atrebas_geometry_get_n_vertices (data), ==,
+                        json_array_get_length (polygon));
+
+      n_features++;
+    }
+  g_assert_no_error (error);
+  g_assert_cmpuint (n_features, ==, json_array_get_length (features));
+
+  /* The reader should stay at the end */
+  g_assert_false (atrebas_geojson_reader_next (reader, NULL, &error));
+  g_assert_no_error (error);
+}
+
+static void
+test_geojson_reader_array (void)
+{
+  g_autoptr (AtrebasGeojsonReader) reader = NULL;
+  GBytes *bytes;
+  const guint8 *data;
+  GError *error = NULL;
+
+  /* A bare array of features, with members in any order */
+  reader = test_reader_new_for_data ("[{"
+                                     "\"geometry\": {"
+                                     "  \"coordinates\": [[[0, 0, 0], [1, 0], [1, 1e0], [0, 0]]],"
+                                     "  \"type\": \"Polygon\""
+                                     "},"
+                                     "\"properties\": {"
+                                     "  \"Name\": \"Caf\\u00e9 \\ud83d\\ude00\","
+                                     "  \"Null\": null,"
+                                     "  \"Object\": {\"nested\": [true, false]}"
+                                     "},"
+                                     "\"id\": 42"
+                                     "}, {"
+                                     "\"geometry\": {"
+                                     "  \"coordinates\": [[[[0, 0], [4, 0], [4, 4], [0, 0]],"
+                                     "                     [[2, 1], [3, 1], [3, 2], [2, 1]]],"
+                                     "                    [[[5, 0], [6, 0], [6, 1], [5, 0]]]],"
+                                     "  \"type\": \"MultiPolygon\""
+                                     "}"
+                                     "}, {"
+                                     "\"geometry\": {"
+                                     "  \"type\": \"LineString\","
+                                     "  \"coordinates\": [[0, 0], [1, 0]]"
+                                     "}"
+                                     "}]");
+
+  g_assert_true (atrebas_geojson_reader_next (reader, NULL, &error));
+  g_assert_no_error (error);
+  g_assert_cmpstr (atrebas_geojson_reader_get_id (reader), ==, "42");
+  g_assert_cmpstr (atrebas_geojson_reader_get_property (reader, "Name"), ==,
+                   "Café 😀");
+  g_assert_null (atrebas_geojson_reader_get_property (reader, "Null"));
+  g_assert_null (atrebas_geojson_reader_get_property (reader, "Object"));
+  g_assert_nonnull (atrebas_geojson_reader_get_geometry (reader));
+
+  /* Each polygon of a multipolygon is a part, with its holes */
+  g_assert_true (atrebas_geojson_reader_next (reader, NULL, &error));
+  g_assert_no_error (error);
+  g_assert_null (atrebas_geojson_reader_get_id (reader));
+  g_assert_cmpstr (atrebas_geojson_reader_get_geometry_type (reader), ==,
+                   "MultiPolygon");
+  bytes = atrebas_geojson_reader_get_geometry (reader);
+  g_assert_nonnull (bytes);
+
+  data = g_bytes_get_data (bytes, NULL);
+  g_assert_cmpuint (atrebas_geometry_get_n_parts (data), ==, 2);
+  g_assert_cmpuint (atrebas_geometry_get_n_rings (data), ==, 3);
+
+  /* Unsupported geometry is skipped */
+  g_assert_true (atrebas_geojson_reader_next (reader, NULL, &error));
+  g_assert_no_error (error);
+  g_assert_cmpstr (atrebas_geojson_reader_get_geometry_type (reader), ==,
+                   "LineString");
+  g_assert_null (atrebas_geojson_reader_get_geometry (reader));
+
+  g_assert_false (atrebas_geojson_reader_next (reader, NULL, &error));
+  g_assert_no_error (error);
+}
+
+static void
+test_geojson_reader_invalid (void)
+{
+  static const char *documents[] = {
+    "",
+    "{\"type\": \"Feature\", \"features\": []}",
+    "{\"features\": []}",
+    "{\"type\": \"FeatureCollection\", \"features\": [{\"id\": \"abc",
+    "{\"type\": \"FeatureCollection\", \"features\": [{\"id\" \"abc\"}]}",
+    "[{\"id\": \"abc\"}] []",
+  };
+  g_autoptr (AtrebasGeojsonReader) reader = NULL;
+  GError *error = NULL;
+
+  for (unsigned int i = 0; i < G_N_ELEMENTS (documents); i++)
+    {
+      g_autoptr (AtrebasGeojsonReader) document = NULL;
+
+      document = test_reader_new_for_data (documents[i]);
+
+      while (atrebas_geojson_reader_next (document, NULL, &error))
+        continue;
+
+      g_assert_error (error, GEOCODE_ERROR, GEOCODE_ERROR_PARSE);
+      g_clear_error (&error);
+    }
+
+  /* A feature that is not an object is an error */
+  reader = test_reader_new_for_path (TEST_DATA_DIR"/testFeatureCollectionInvalid.json");
+
+  g_assert_true (atrebas_geojson_reader_next (reader, NULL, &error));
+  g_assert_no_error (error);
+  g_assert_false (atrebas_geojson_reader_next (reader, NULL, &error));
+  g_assert_error (error, GEOCODE_ERROR, GEOCODE_ERROR_PARSE);
+  g_clear_error (&error);
+
+  /* Invalid coordinates are not an error, but there is no geometry */
+  g_clear_pointer (&reader, atrebas_geojson_reader_free);
+  reader = test_reader_new_for_data ("[{"
+                                     "\"geometry\": {"
+                                     "  \"type\": \"Polygon\","
+                                     "  \"coordinates\": [[[0], [1, 0], [1, 1]]]"
+                                     "}"
+                                     "}]");
+
+  g_assert_true (atrebas_geojson_reader_next (reader, NULL, &error));
+  g_assert_no_error (error);
+  g_assert_null (atrebas_geojson_reader_get_geometry (reader));
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, G_TEST_OPTION_ISOLATE_DIRS, NULL);
+
+  g_test_add_func ("/atrebas/geojson-reader/collection",
+                   test_geojson_reader_collection);
+  g_test_add_func ("/atrebas/geojson-reader/array",
+                   test_geojson_reader_array);
+  g_test_add_func ("/atrebas/geojson-reader/invalid",
+                   test_geojson_reader_invalid);
+
+  return g_test_run ();
+}
+
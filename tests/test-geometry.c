@@ -0,0 +1,489 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// SPDX-FileCopyrightText: 2022 Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include <math.h>
+
+#include <gio/gio.h>
+
+#include "atrebas-geometry.h"
+
+#include "mock-common.h"
+
+
+static JsonArray *
+test_get_coordinates (void)
+{
+  g_autoptr (JsonParser) parser = NULL;
+  JsonObject *feature;
+  JsonObject *geometry;
+
+  parser = json_parser_new ();
+  json_parser_load_from_file (parser, TEST_DATA_DIR"/testFeature.json", NULL);
+  feature = json_node_get_object (json_parser_get_root (parser));
+  geometry = json_object_get_object_member (feature, "geometry");
+
+  return json_array_ref (json_object_get_array_member (geometry, "coordinates"));
+}
+
+static void
+test_geometry_encode (void)
+{
+  g_autoptr (JsonArray) coordinates = NULL;
+  g_autoptr (JsonArray) decoded = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  JsonArray *polygon, *decoded_polygon;
+  const guint8 *data;
+  size_t size;
+
+  coordinates = test_get_coordinates ();
+  bytes = atrebas_geometry_encode (coordinates);
+  g_assert_nonnull (bytes);
+
+  data = g_bytes_get_data (bytes, &size);
+  g_assert_true (atrebas_geometry_validate (data, size));
+  g_assert_false (atrebas_geometry_validate (data, size - 1));
+  g_assert_false (atrebas_geometry_validate (NULL, 0));
+
+  polygon = json_array_get_array_element (coordinates, 0);
+  g_assert_cmpuint (atrebas_geometry_get_n_vertices (data), ==,
+                    json_array_get_length (polygon));
+
+  /* The decoded coordinates should match, less the altitude */
+  decoded = atrebas_geometry_to_json (data, size);
+  g_assert_nonnull (decoded);
+  g_assert_cmpuint (json_array_get_length (decoded), ==,
+                    json_array_get_length (coordinates));
+
+  decoded_polygon = json_array_get_array_element (decoded, 0);
+  g_assert_cmpuint (json_array_get_length (decoded_polygon), ==,
+                    json_array_get_length (polygon));
+
+  for (unsigned int i = 0; i < json_array_get_length (polygon); i++)
+    {
+      JsonArray *point = json_array_get_array_element (polygon, i);
+      JsonArray *decoded_point = json_array_get_array_element (decoded_polygon, i);
+
+      g_assert_cmpuint (json_array_get_length (decoded_point), ==, 2);
+      g_assert_cmpfloat (json_array_get_double_element (point, 0), ==,
+                         json_array_get_double_element (decoded_point, 0));
+      g_assert_cmpfloat (json_array_get_double_element (point, 1), ==,
+                         json_array_get_double_element (decoded_point, 1));
+    }
+}
+
+static void
+test_geometry_spatial (void)
+{
+  g_autoptr (JsonArray) coordinates = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  const guint8 *data;
+  double min_x, max_x, min_y, max_y;
+
+  coordinates = test_get_coordinates ();
+  bytes = atrebas_geometry_encode (coordinates);
+  data = g_bytes_get_data (bytes, NULL);
+
+  /* Extents */
+  atrebas_geometry_get_bounds (data, &min_x, &max_x, &min_y, &max_y);
+  g_assert_cmpfloat (min_x, <, max_x);
+  g_assert_cmpfloat (min_y, <, max_y);
+  g_assert_cmpfloat (ATREBAS_TEST_FEATURE_LON, >=, min_x);
+  g_assert_cmpfloat (ATREBAS_TEST_FEATURE_LON, <=, max_x);
+  g_assert_cmpfloat (ATREBAS_TEST_FEATURE_LAT, >=, min_y);
+  g_assert_cmpfloat (ATREBAS_TEST_FEATURE_LAT, <=, max_y);
+
+  /* Point-in-polygon */
+  g_assert_true (atrebas_geometry_contains_point (data,
+                                                  ATREBAS_TEST_FEATURE_LON,
+                                                  ATREBAS_TEST_FEATURE_LAT));
+  g_assert_false (atrebas_geometry_contains_point (data, 0.0, 0.0));
+
+  /* Intersection */
+  g_assert_true (atrebas_geometry_intersects (data,
+                                              ATREBAS_TEST_FEATURE_LON - 0.01,
+                                              ATREBAS_TEST_FEATURE_LAT + 0.01,
+                                              ATREBAS_TEST_FEATURE_LON + 0.01,
+                                              ATREBAS_TEST_FEATURE_LAT - 0.01));
+  g_assert_false (atrebas_geometry_intersects (data, -1.0, 1.0, 1.0, -1.0));
+}
+
+static void
+test_geometry_slabs (void)
+{
+  g_autoptr (AtrebasGeometryBuilder) builder = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  const guint8 *data;
+  size_t size;
+
+  /* A star with enough vertices to be divided into slabs */
+  builder = atrebas_geometry_builder_new ();
+  atrebas_geometry_builder_add_ring (builder);
+
+  for (unsigned int i = 0; i < 512; i++)
+    {
+      double angle = 2 * G_PI * i / 512;
+      double radius = (i % 2 == 0) ? 1.0 : 0.5;
+
+      atrebas_geometry_builder_add_vertex (builder,
+                                           radius * cos (angle),
+                                           radius * sin (angle));
+    }
+
+  bytes = atrebas_geometry_builder_end (builder);
+  data = g_bytes_get_data (bytes, &size);
+  g_assert_true (atrebas_geometry_validate (data, size));
+  g_assert_false (atrebas_geometry_validate (data, size - sizeof (guint32)));
+
+  /* The slabs should give the same results as testing every edge */
+  for (int i = -12; i <= 12; i++)
+    {
+      for (int j = -12; j <= 12; j++)
+        {
+          double x = i / 10.0;
+          double y = j / 10.0;
+          gboolean inside = FALSE;
+
+          atrebas_geometry_contains_points (data, (double[]){ x, y }, 1, &inside);
+          g_assert_cmpint (atrebas_geometry_contains_point (data, x, y), ==, inside);
+        }
+    }
+
+  g_assert_true (atrebas_geometry_contains_point (data, 0.0, 0.0));
+  g_assert_true (atrebas_geometry_contains_point (data, 0.45, 0.0));
+  g_assert_false (atrebas_geometry_contains_point (data, 0.0, 1.01));
+}
+
+static void
+test_geometry_contains_points (void)
+{
+  g_autoptr (JsonArray) coordinates = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autofree double *points = NULL;
+  g_autofree gboolean *results = NULL;
+  const guint8 *data;
+  double min_x, max_x, min_y, max_y;
+  unsigned int n_points = 0;
+  unsigned int n_inside = 0;
+
+  coordinates = test_get_coordinates ();
+  bytes = atrebas_geometry_encode (coordinates);
+  data = g_bytes_get_data (bytes, NULL);
+  atrebas_geometry_get_bounds (data, &min_x, &max_x, &min_y, &max_y);
+
+  /* A grid over and around the extents, in more than one batch */
+  points = g_new (double, 2 * 41 * 41);
+  results = g_new (gboolean, 41 * 41);
+
+  for (unsigned int i = 0; i < 41; i++)
+    {
+      for (unsigned int j = 0; j < 41; j++)
+        {
+          points[2 * n_points] = min_x + (max_x - min_x) * (i / 30.0 - 1.0 / 6.0);
+          points[2 * n_points + 1] = min_y + (max_y - min_y) * (j / 30.0 - 1.0 / 6.0);
+          n_points++;
+        }
+    }
+
+  /* The results should match testing each point */
+  for (unsigned int i = 0; i < n_points; i++)
+    n_inside += atrebas_geometry_contains_point (data, points[2 * i], points[2 * i + 1]);
+
+  g_assert_cmpuint (n_inside, >, 0);
+  g_assert_cmpuint (n_inside, <, n_points);
+  g_assert_cmpuint (atrebas_geometry_contains_points (data, points, n_points, results), ==, n_inside);
+
+  for (unsigned int i = 0; i < n_points; i++)
+    {
+      g_assert_cmpint (results[i], ==,
+                       atrebas_geometry_contains_point (data, points[2 * i], points[2 * i + 1]));
+    }
+}
+
+static void
+test_geometry_cover (void)
+{
+  g_autoptr (AtrebasGeometryBuilder) builder = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (GBytes) cover = NULL;
+  const guint8 *data;
+  const guint8 *cover_data;
+  size_t cover_size;
+  unsigned int n_labelled = 0;
+
+  /* A star, so the covering has cells on both sides of the boundary */
+  builder = atrebas_geometry_builder_new ();
+  atrebas_geometry_builder_add_ring (builder);
+
+  for (unsigned int i = 0; i < 16; i++)
+    {
+      double angle = 2 * G_PI * i / 16;
+      double radius = (i % 2 == 0) ? 1.0 : 0.5;
+
+      atrebas_geometry_builder_add_vertex (builder,
+                                           radius * cos (angle),
+                                           radius * sin (angle));
+    }
+
+  bytes = atrebas_geometry_builder_end (builder);
+  data = g_bytes_get_data (bytes, NULL);
+
+  cover = atrebas_geometry_cover (data);
+  cover_data = g_bytes_get_data (cover, &cover_size);
+  g_assert_true (atrebas_geometry_cover_validate (cover_data, cover_size));
+  g_assert_false (atrebas_geometry_cover_validate (cover_data, cover_size - 1));
+
+  /* A labelled cell must agree with testing the geometry */
+  for (int i = -12; i <= 12; i++)
+    {
+      for (int j = -12; j <= 12; j++)
+        {
+          double x = i / 10.0;
+          double y = j / 10.0;
+          AtrebasGeometryRegion region;
+
+          region = atrebas_geometry_cover_locate (cover_data, x, y);
+
+          if (region == ATREBAS_GEOMETRY_REGION_BOUNDARY)
+            continue;
+
+          g_assert_cmpint (atrebas_geometry_contains_point (data, x, y), ==,
+                           region == ATREBAS_GEOMETRY_REGION_INSIDE);
+          n_labelled++;
+        }
+    }
+
+  g_assert_cmpuint (n_labelled, >, 0);
+  g_assert_cmpint (atrebas_geometry_cover_locate (cover_data, 0.0, 0.0), ==,
+                   ATREBAS_GEOMETRY_REGION_INSIDE);
+  g_assert_cmpint (atrebas_geometry_cover_locate (cover_data, 2.0, 0.0), ==,
+                   ATREBAS_GEOMETRY_REGION_OUTSIDE);
+}
+
+static void
+test_geometry_multipolygon (void)
+{
+  g_autoptr (AtrebasGeometryBuilder) builder = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (JsonArray) decoded = NULL;
+  const guint8 *data;
+  size_t size;
+  unsigned int first_ring, last_ring;
+  double min_x, max_x, min_y, max_y;
+  double points[] = { 1.0, 1.0, 5.0, 5.0, 21.0, 1.0, 15.0, 5.0, 30.0, 5.0 };
+  gboolean results[G_N_ELEMENTS (points) / 2];
+
+  /* A square with a square hole, and a square beside it */
+  builder = atrebas_geometry_builder_new ();
+  atrebas_geometry_builder_add_part (builder);
+  atrebas_geometry_builder_add_ring (builder);
+  atrebas_geometry_builder_add_vertex (builder, 0.0, 0.0);
+  atrebas_geometry_builder_add_vertex (builder, 10.0, 0.0);
+  atrebas_geometry_builder_add_vertex (builder, 10.0, 10.0);
+  atrebas_geometry_builder_add_vertex (builder, 0.0, 10.0);
+  atrebas_geometry_builder_add_ring (builder);
+  atrebas_geometry_builder_add_vertex (builder, 4.0, 4.0);
+  atrebas_geometry_builder_add_vertex (builder, 6.0, 4.0);
+  atrebas_geometry_builder_add_vertex (builder, 6.0, 6.0);
+  atrebas_geometry_builder_add_vertex (builder, 4.0, 6.0);
+  atrebas_geometry_builder_add_part (builder);
+  atrebas_geometry_builder_add_ring (builder);
+  atrebas_geometry_builder_add_vertex (builder, 20.0, 0.0);
+  atrebas_geometry_builder_add_vertex (builder, 25.0, 0.0);
+  atrebas_geometry_builder_add_vertex (builder, 25.0, 5.0);
+  atrebas_geometry_builder_add_vertex (builder, 20.0, 5.0);
+
+  bytes = atrebas_geometry_builder_end (builder);
+  data = g_bytes_get_data (bytes, &size);
+  g_assert_true (atrebas_geometry_validate (data, size));
+  g_assert_false (atrebas_geometry_validate (data, size - sizeof (double)));
+
+  g_assert_cmpuint (atrebas_geometry_get_n_parts (data), ==, 2);
+  g_assert_cmpuint (atrebas_geometry_get_n_rings (data), ==, 3);
+
+  atrebas_geometry_get_part (data, 0, &first_ring, &last_ring);
+  g_assert_cmpuint (first_ring, ==, 0);
+  g_assert_cmpuint (last_ring, ==, 2);
+  atrebas_geometry_get_part (data, 1, &first_ring, &last_ring);
+  g_assert_cmpuint (first_ring, ==, 2);
+  g_assert_cmpuint (last_ring, ==, 3);
+
+  /* Every part and ring has its own extents */
+  atrebas_geometry_get_bounds (data, &min_x, &max_x, &min_y, &max_y);
+  g_assert_cmpfloat (min_x, ==, 0.0);
+  g_assert_cmpfloat (max_x, ==, 25.0);
+  atrebas_geometry_get_part_bounds (data, 1, &min_x, &max_x, &min_y, &max_y);
+  g_assert_cmpfloat (min_x, ==, 20.0);
+  g_assert_cmpfloat (max_y, ==, 5.0);
+  atrebas_geometry_get_ring_bounds (data, 1, &min_x, &max_x, &min_y, &max_y);
+  g_assert_cmpfloat (min_x, ==, 4.0);
+  g_assert_cmpfloat (max_x, ==, 6.0);
+
+  decoded = atrebas_geometry_to_json (data, size);
+  g_assert_cmpuint (json_array_get_length (decoded), ==, 2);
+  g_assert_cmpuint (json_array_get_length (json_array_get_array_element (decoded, 0)), ==, 2);
+
+  /* A point in a hole is outside, as is one between the parts */
+  g_assert_true (atrebas_geometry_contains_point (data, 1.0, 1.0));
+  g_assert_false (atrebas_geometry_contains_point (data, 5.0, 5.0));
+  g_assert_true (atrebas_geometry_contains_point (data, 21.0, 1.0));
+  g_assert_false (atrebas_geometry_contains_point (data, 15.0, 5.0));
+
+  g_assert_cmpuint (atrebas_geometry_contains_points (data, points,
+                                                      G_N_ELEMENTS (results),
+                                                      results), ==, 2);
+
+  for (unsigned int i = 0; i < G_N_ELEMENTS (results); i++)
+    {
+      g_assert_cmpint (results[i], ==,
+                       atrebas_geometry_contains_point (data, points[2 * i], points[2 * i + 1]));
+    }
+}
+
+static void
+test_geometry_antimeridian (void)
+{
+  g_autoptr (AtrebasGeometryBuilder) builder = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (GBytes) cover = NULL;
+  g_autoptr (JsonArray) decoded = NULL;
+  const guint8 *data;
+  const guint8 *cover_data;
+  size_t size;
+  double min_x, max_x, min_y, max_y;
+
+  /* A square from 170°E to 170°W, as it would be written in GeoJSON */
+  builder = atrebas_geometry_builder_new ();
+  atrebas_geometry_builder_add_ring (builder);
+  atrebas_geometry_builder_add_vertex (builder, 170.0, -10.0);
+  atrebas_geometry_builder_add_vertex (builder, -170.0, -10.0);
+  atrebas_geometry_builder_add_vertex (builder, -170.0, 10.0);
+  atrebas_geometry_builder_add_vertex (builder, 170.0, 10.0);
+
+  bytes = atrebas_geometry_builder_end (builder);
+  data = g_bytes_get_data (bytes, &size);
+  g_assert_true (atrebas_geometry_validate (data, size));
+
+  /* Split in two, with extents that wrap */
+  g_assert_cmpuint (atrebas_geometry_get_n_parts (data), ==, 2);
+  atrebas_geometry_get_bounds (data, &min_x, &max_x, &min_y, &max_y);
+  g_assert_cmpfloat (min_x, ==, 170.0);
+  g_assert_cmpfloat (max_x, ==, -170.0);
+  g_assert_cmpfloat (min_y, ==, -10.0);
+  g_assert_cmpfloat (max_y, ==, 10.0);
+
+  for (unsigned int i = 0; i < 2; i++)
+    {
+      atrebas_geometry_get_part_bounds (data, i, &min_x, &max_x, NULL, NULL);
+      g_assert_cmpfloat (min_x, <, max_x);
+      g_assert_cmpfloat (max_x - min_x, ==, 10.0);
+    }
+
+  decoded = atrebas_geometry_to_json (data, size);
+  g_assert_cmpuint (json_array_get_length (decoded), ==, 2);
+
+  /* Containment on both sides, and past the antimeridian */
+  g_assert_true (atrebas_geometry_contains_point (data, 175.0, 0.0));
+  g_assert_true (atrebas_geometry_contains_point (data, -175.0, 0.0));
+  g_assert_true (atrebas_geometry_contains_point (data, 185.0, 0.0));
+  g_assert_false (atrebas_geometry_contains_point (data, 0.0, 0.0));
+  g_assert_false (atrebas_geometry_contains_point (data, 165.0, 0.0));
+
+  g_assert_true (atrebas_geometry_intersects (data, -179.0, 1.0, -178.0, -1.0));
+  g_assert_false (atrebas_geometry_intersects (data, -1.0, 1.0, 1.0, -1.0));
+
+  /* The covering spans both parts */
+  cover = atrebas_geometry_cover (data);
+  cover_data = g_bytes_get_data (cover, &size);
+  g_assert_true (atrebas_geometry_cover_validate (cover_data, size));
+  g_assert_cmpint (atrebas_geometry_cover_locate (cover_data, 175.0, 0.0), ==,
+                   ATREBAS_GEOMETRY_REGION_INSIDE);
+  g_assert_cmpint (atrebas_geometry_cover_locate (cover_data, -175.0, 0.0), ==,
+                   ATREBAS_GEOMETRY_REGION_INSIDE);
+  g_assert_cmpint (atrebas_geometry_cover_locate (cover_data, 0.0, 0.0), ==,
+                   ATREBAS_GEOMETRY_REGION_OUTSIDE);
+}
+
+static void
+test_geometry_label_point (void)
+{
+  g_autoptr (AtrebasGeometryBuilder) builder = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  const guint8 *data;
+  double center_x, center_y;
+  double x, y;
+
+  /* A "U" shape, with the center of its extents in the gap */
+  builder = atrebas_geometry_builder_new ();
+  atrebas_geometry_builder_add_ring (builder);
+  atrebas_geometry_builder_add_vertex (builder, 0.0, 0.0);
+  atrebas_geometry_builder_add_vertex (builder, 6.0, 0.0);
+  atrebas_geometry_builder_add_vertex (builder, 6.0, 6.0);
+  atrebas_geometry_builder_add_vertex (builder, 4.0, 6.0);
+  atrebas_geometry_builder_add_vertex (builder, 4.0, 2.0);
+  atrebas_geometry_builder_add_vertex (builder, 2.0, 2.0);
+  atrebas_geometry_builder_add_vertex (builder, 2.0, 6.0);
+  atrebas_geometry_builder_add_vertex (builder, 0.0, 6.0);
+
+  bytes = atrebas_geometry_builder_end (builder);
+  data = g_bytes_get_data (bytes, NULL);
+
+  atrebas_geometry_get_center (data, &center_x, &center_y);
+  g_assert_false (atrebas_geometry_contains_point (data, center_x, center_y));
+
+  atrebas_geometry_get_label_point (data, &x, &y);
+  g_assert_true (atrebas_geometry_contains_point (data, x, y));
+
+  /* Less the gap, 28 square degrees near the equator */
+  g_assert_cmpfloat_with_epsilon (atrebas_geometry_get_area (data),
+                                  28.0 * 12364.0, 28.0 * 50.0);
+}
+
+static void
+test_geometry_invalid (void)
+{
+  g_autoptr (JsonArray) coordinates = NULL;
+  g_autoptr (JsonArray) ring = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+
+  /* Empty polygon */
+  coordinates = json_array_new ();
+  bytes = atrebas_geometry_encode (coordinates);
+  g_assert_null (bytes);
+
+  /* Malformed point */
+  ring = json_array_new ();
+  json_array_add_double_element (ring, 0.0);
+  json_array_add_array_element (coordinates, json_array_ref (ring));
+  bytes = atrebas_geometry_encode (coordinates);
+  g_assert_null (bytes);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, G_TEST_OPTION_ISOLATE_DIRS, NULL);
+
+  g_test_add_func ("/atrebas/geometry/encode",
+                   test_geometry_encode);
+  g_test_add_func ("/atrebas/geometry/spatial",
+                   test_geometry_spatial);
+  g_test_add_func ("/atrebas/geometry/slabs",
+                   test_geometry_slabs);
+  g_test_add_func ("/atrebas/geometry/contains-points",
+                   test_geometry_contains_points);
+  g_test_add_func ("/atrebas/geometry/cover",
+                   test_geometry_cover);
+  g_test_add_func ("/atrebas/geometry/multipolygon",
+                   test_geometry_multipolygon);
+  g_test_add_func ("/atrebas/geometry/antimeridian",
+                   test_geometry_antimeridian);
+  g_test_add_func ("/atrebas/geometry/label-point",
+                   test_geometry_label_point);
+  g_test_add_func ("/atrebas/geometry/invalid",
+                   test_geometry_invalid);
+
+  return g_test_run ();
+}
+
@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// SPDX-FileCopyrightText: 2022 Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include <gio/gio.h>
+
+#include "atrebas-spatial-index.h"
+
+#include "mock-common.h"
+
+
+#define TEST_GRID_SIZE 40
+
+static gboolean
+test_contains_id (GArray *results,
+                  gint64  id)
+{
+  for (unsigned int i = 0; i < results->len; i++)
+    {
+      if (g_array_index (results, gint64, i) == id)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+test_spatial_index_search (void)
+{
+  g_autoptr (AtrebasSpatialIndexBuilder) builder = NULL;
+  g_autoptr (AtrebasSpatialIndex) index = NULL;
+  g_autoptr (GArray) results = NULL;
+
+  /* A grid of one-degree cells, enough for a tree of several levels */
+  builder = atrebas_spatial_index_builder_new ();
+
+  for (unsigned int x = 0; x < TEST_GRID_SIZE; x++)
+    {
+      for (unsigned int y = 0; y < TEST_GRID_SIZE; y++)
+        {
+          atrebas_spatial_index_builder_add (builder,
+                                             x * TEST_GRID_SIZE + y,
+                                             x, x + 0.5,
+                                             y, y + 0.5);
+        }
+    }
+
+  index = atrebas_spatial_index_builder_end (builder);
+  g_assert_cmpuint (atrebas_spatial_index_get_n_items (index), ==,
+                    TEST_GRID_SIZE * TEST_GRID_SIZE);
+
+  results = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  /* Point inside a cell */
+  g_assert_cmpuint (atrebas_spatial_index_search (index,
+                                                  12.25, 7.25,
+                                                  12.25, 7.25,
+                                                  results), ==, 1);
+  g_assert_cmpint (g_array_index (results, gint64, 0), ==,
+                   12 * TEST_GRID_SIZE + 7);
+  g_array_set_size (results, 0);
+
+  /* Point at x = 12.75 is in the gap between cells 12.0-12.5 and 13.0-13.5 */
+  g_assert_cmpuint (atrebas_spatial_index_search (index,
+                                                  12.75, 7.25,
+                                                  12.75, 7.25,
+                                                  results), ==, 0);
+
+  /* Point outside the grid */
+  g_assert_cmpuint (atrebas_spatial_index_search (index,
+                                                  -103.16, 23.26,
+                                                  -103.16, 23.26,
+                                                  results), ==, 0);
+  g_assert_cmpuint (results->len, ==, 0);
+
+  /* Box spanning four cells */
+  g_assert_cmpuint (atrebas_spatial_index_search (index,
+                                                  3.25, 5.25,
+                                                  4.25, 4.25,
+                                                  results), ==, 4);
+  g_assert_true (test_contains_id (results, 3 * TEST_GRID_SIZE + 4));
+  g_assert_true (test_contains_id (results, 3 * TEST_GRID_SIZE + 5));
+  g_assert_true (test_contains_id (results, 4 * TEST_GRID_SIZE + 4));
+  g_assert_true (test_contains_id (results, 4 * TEST_GRID_SIZE + 5));
+}
+
+static void
+test_spatial_index_empty (void)
+{
+  g_autoptr (AtrebasSpatialIndexBuilder) builder = NULL;
+  g_autoptr (AtrebasSpatialIndex) index = NULL;
+  g_autoptr (AtrebasSpatialIndex) single = NULL;
+  g_autoptr (GArray) results = NULL;
+
+  builder = atrebas_spatial_index_builder_new ();
+  results = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  /* No items */
+  index = atrebas_spatial_index_builder_end (builder);
+  g_assert_cmpuint (atrebas_spatial_index_get_n_items (index), ==, 0);
+  g_assert_cmpuint (atrebas_spatial_index_search (index,
+                                                  -180.0, 90.0,
+                                                  180.0, -90.0,
+                                                  results), ==, 0);
+
+  /* A single item is its own root */
+  atrebas_spatial_index_builder_add (builder, 42, -1.0, 1.0, -1.0, 1.0);
+  single = atrebas_spatial_index_builder_end (builder);
+  g_assert_cmpuint (atrebas_spatial_index_search (single,
+                                                  0.0, 0.0,
+                                                  0.0, 0.0,
+                                                  results), ==, 1);
+  g_assert_cmpint (g_array_index (results, gint64, 0), ==, 42);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, G_TEST_OPTION_ISOLATE_DIRS, NULL);
+
+  g_test_add_func ("/atrebas/spatial-index/search",
+                   test_spatial_index_search);
+  g_test_add_func ("/atrebas/spatial-index/empty",
+                   test_spatial_index_empty);
+
+  return g_test_run ();
+}
+